@@ -0,0 +1,126 @@
+#ifndef LLMO_ALLOCATOR_HPP
+#define LLMO_ALLOCATOR_HPP
+
+#include <cstddef> // std::size_t
+#include <cstdint> // std::uintptr_t
+#include <mutex> // std::mutex
+#include <unordered_map> // std::unordered_map
+#include <vector> // std::vector
+
+#include "rwe.hpp"
+
+namespace llmo
+{
+  namespace rwe
+  {
+    // Allocates small code and data chunks reachable by rel32 from an origin.
+    // Memory is reserved in slabs of the allocation granularity, which are
+    // placed near the origin like MinHook's trampoline blocks and carved
+    // into size classes, so small stubs don't take a page each.
+    // kDualMapped slabs are mapped twice, executable view is never writable,
+    // the chunks are written through getWritable alias without any protection
+    // changes, so generated code never lives on RWX pages.
+    // Thread-safe. Throws rwe::Exception.
+    class NearAllocator
+    {
+    public:
+      enum class Kind
+      {
+        kCode, // Executable, readable and writable.
+        kData, // Readable and writable.
+        kDualMapped, // Executable and readable, writable through alias.
+      };
+
+      // Chunks up to this size are carved from slabs,
+      // larger ones get their own pages.
+      static constexpr std::size_t kMaxChunkSize{2048u};
+
+      NearAllocator() = default;
+
+      NearAllocator(const NearAllocator&) = delete;
+      NearAllocator& operator=(const NearAllocator&) = delete;
+
+      // Releases all the memory.
+      ~NearAllocator();
+
+      // Returns chunk of at least size bytes, aligned to 16 bytes, which
+      // whole lies within MinHook's seeking range from the origin on x64.
+      // Throws kSizeIsZero or kAllocationFailed.
+      void* Allocate(
+        const std::uintptr_t origin,
+        const std::size_t size,
+        const Kind kind = Kind::kCode);
+
+      void* Allocate(
+        const void* origin,
+        const std::size_t size,
+        const Kind kind = Kind::kCode)
+      {
+        return Allocate(reinterpret_cast<std::uintptr_t>(origin), size, kind);
+      }
+
+      // Returns the chunk to its slab. Does nothing for nullptr.
+      void Free(void* pointer);
+
+      // Returns address the chunk should be written at. It's the same
+      // pointer for all kinds, except kDualMapped. Returns nullptr
+      // if the pointer doesn't belong to the allocator.
+      void* getWritable(const void* pointer);
+
+    private:
+      struct Slab
+      {
+        std::uintptr_t base;
+        std::uintptr_t writable; // Writable view, same as base if single.
+        std::size_t size;
+        std::size_t chunkSize; // Zero for a large chunk.
+        std::size_t bump; // Offset of the first never used chunk.
+        std::size_t used; // Count of allocated chunks.
+        void* free; // Intrusive list of freed chunks.
+        Kind kind;
+      };
+
+      // Size classes are powers of two from 16 to kMaxChunkSize.
+      static constexpr std::size_t kClassCount{8u};
+
+      static std::size_t getClass(const std::size_t size);
+
+      // Reserves and commits memory within reach of the origin.
+      // Returns executable or single view, writable view is set to writable.
+      static std::uintptr_t allocateNear(
+        const std::uintptr_t origin,
+        const std::size_t size,
+        const Kind kind,
+        std::uintptr_t& writable);
+
+      // Tries to allocate at the address, anywhere if it's zero.
+      static std::uintptr_t allocateAt(
+        const std::uintptr_t address,
+        const std::size_t size,
+        const Kind kind,
+        std::uintptr_t& writable);
+
+      static void release(const Slab& slab);
+
+      // Returns writable address of the chunk, its free list link lives there.
+      static void** getLink(const Slab& slab, const void* chunk) {
+        return reinterpret_cast<void**>(slab.writable
+          + (reinterpret_cast<std::uintptr_t>(chunk) - slab.base));
+      }
+
+      static bool isReachable(const std::uintptr_t origin, const Slab& slab);
+
+      void* allocateChunk(Slab& slab);
+
+      std::mutex m_mutex{};
+
+      // All slabs and large chunks by base address.
+      std::unordered_map<std::uintptr_t, Slab> m_slabs{};
+
+      // Bases of slabs with free chunks per kind and size class.
+      std::vector<std::uintptr_t> m_partial[3][kClassCount]{};
+    };
+  } // namespace rwe
+} // namespace llmo
+
+#endif // LLMO_ALLOCATOR_HPP
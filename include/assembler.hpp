@@ -0,0 +1,214 @@
+#ifndef LLMO_ASSEMBLER_HPP
+#define LLMO_ASSEMBLER_HPP
+
+#include <cstddef> // std::size_t
+#include <cstdint> // std::uintptr_t, std::int32_t
+#include <stdexcept> // std::exception
+#include <vector> // std::vector
+
+#include "rwe.hpp"
+#include "allocator.hpp"
+
+namespace llmo
+{
+  namespace assembler
+  {
+    // Assembler exception class.
+    class Exception : public std::exception
+    {
+    public:
+      // Assembler exception codes.
+      enum class Code
+      {
+        kInvalidOperand,
+        kInvalidLabel,
+        kLabelAlreadyBound,
+        kLabelIsNotBound,
+        kOutOfRange,
+      };
+
+      Exception(const std::uintptr_t address, const Code code) :
+        std::exception{}, m_address(address), m_code(code) {}
+
+      Exception(const Code code) :
+        std::exception{}, m_code(code) {}
+
+      std::uintptr_t getAddress() {
+        return m_address;
+      }
+
+      Code getCode() {
+        return m_code;
+      }
+
+    private:
+      std::uintptr_t m_address{};
+      Code m_code{Code::kInvalidOperand};
+    };
+
+    using Code = Exception::Code;
+
+    // General purpose registers of the native width,
+    // kR8 - kR15 are available only on x64.
+    enum class Register : std::uint8_t
+    {
+      kAx, kCx, kDx, kBx, kSp, kBp, kSi, kDi,
+      kR8, kR9, kR10, kR11, kR12, kR13, kR14, kR15,
+    };
+
+    // Condition codes in the encoding order.
+    enum class Condition : std::uint8_t
+    {
+      kO, kNo, kB, kAe, kE, kNe, kBe, kA,
+      kS, kNs, kP, kNp, kL, kGe, kLe, kG,
+    };
+
+    // [ base + displacement ] operand.
+    struct Memory
+    {
+      Register base;
+      std::int32_t displacement;
+    };
+
+    // Position in the code, may be bound after it's referenced.
+    struct Label
+    {
+      std::size_t id;
+    };
+
+    // Encodes stubs for the current architecture into a buffer, which is
+    // copied to its final place by Emit, where labels and targets are resolved.
+    // Branches to absolute targets take rel32 form when the target is reachable
+    // from anywhere NearAllocator may place the code for the origin, otherwise
+    // on x64 the same far forms as MinHook's JMP_ABS, CALL_ABS and JCC_ABS.
+    // Branches to labels bound before take rel8 form when possible.
+    // Throws assembler::Exception.
+    class Assembler
+    {
+    public:
+      explicit Assembler(const std::uintptr_t origin = 0u) :
+        m_origin(origin) {}
+
+      explicit Assembler(const void* origin) :
+        m_origin(reinterpret_cast<std::uintptr_t>(origin)) {}
+
+      Label NewLabel();
+
+      // Binds the label to the current position.
+      // Throws kInvalidLabel or kLabelAlreadyBound.
+      void Bind(const Label label);
+
+      void Mov(const Register destination, const Register source);
+      void Mov(const Register destination, const std::uintptr_t immediate);
+      void Mov(const Register destination, const Memory source);
+      void Mov(const Memory destination, const Register source);
+
+      void Lea(const Register destination, const Memory source);
+
+      // RIP-relative on x64, absolute on x86.
+      void Lea(const Register destination, const Label label);
+
+      void Push(const Register source);
+      void Push(const std::int32_t immediate);
+      void Pop(const Register destination);
+
+      void Call(const Register target);
+      void Call(const std::uintptr_t target);
+      void Call(const Label label);
+
+      void Jmp(const Register target);
+      void Jmp(const std::uintptr_t target);
+      void Jmp(const Label label);
+
+      void Jcc(const Condition condition, const std::uintptr_t target);
+      void Jcc(const Condition condition, const Label label);
+
+      void Ret();
+      void Ret(const std::uint16_t bytes);
+
+      void Int3();
+
+      // Fills size bytes with the fewest recommended multi-byte nops.
+      void Nop(const std::size_t size = 1u);
+
+      // Pads with int3 up to the alignment, which is a power of two.
+      // Throws kInvalidOperand otherwise.
+      void Align(const std::size_t alignment);
+
+      // Appends raw bytes, for instance relocated instructions.
+      void Bytes(const void* data, const std::size_t size);
+
+      std::size_t getSize() const {
+        return m_code.size();
+      }
+
+      // Resolves the code for the address and writes it to the writable
+      // address, or to the address itself if writable is nullptr.
+      // Throws kLabelIsNotBound or kOutOfRange without writing anything.
+      void Emit(const std::uintptr_t address, void* writable = nullptr) const;
+
+      // Allocates chunk near the origin, emits the code there,
+      // flushes instruction cache and returns its executable address.
+      // Throws rwe::Exception if allocation fails.
+      void* Emit(
+        rwe::NearAllocator& allocator,
+        const rwe::NearAllocator::Kind kind = rwe::NearAllocator::Kind::kCode) const;
+
+      // Writes size bytes of the recommended multi-byte nops.
+      static void WriteNops(std::uint8_t* destination, std::size_t size);
+
+    private:
+      enum class FixupKind : std::uint8_t
+      {
+        kRel32, // Label, relative to the end of the instruction.
+        kAbsolute32, // Label, absolute address on x86.
+        kTarget32, // Absolute target, relative to the end of the instruction.
+      };
+
+      // The field is always the last one in its instruction.
+      struct Fixup
+      {
+        FixupKind kind;
+        std::size_t offset; // Offset of the field.
+        std::uintptr_t value; // Label id or target.
+      };
+
+      static constexpr std::size_t kUnbound{~std::size_t{0u}};
+
+      // Checks the register exists on the current architecture.
+      static std::uint8_t getIndex(const Register reg);
+
+      bool isNear(const std::uintptr_t target) const;
+
+      void emitByte(const std::uint8_t value) {
+        m_code.push_back(value);
+      }
+
+      void emitValue(const void* value, const std::size_t size);
+
+      // REX prefix with W for the native width on x64, nothing on x86.
+      void emitRex(const std::uint8_t reg, const std::uint8_t base, const bool wide);
+
+      // ModRM, SIB and displacement of [ base + displacement ].
+      void emitMemory(const std::uint8_t reg, const Memory memory);
+
+      void emitLabelBranch(
+        const std::uint8_t shortOpcode,
+        const std::uint8_t* nearOpcode,
+        const std::size_t nearSize,
+        const Label label);
+
+      // Adds the fixup and zero placeholder for its field.
+      void addFixup(const FixupKind kind, const std::uintptr_t value);
+
+      std::size_t getLabel(const Label label) const;
+
+      std::uintptr_t m_origin{0u};
+      std::vector<std::uint8_t> m_code{};
+      std::vector<std::size_t> m_labels{};
+      std::vector<Fixup> m_fixups{};
+    };
+  } // namespace assembler
+} // namespace llmo
+
+#endif // LLMO_ASSEMBLER_HPP
@@ -0,0 +1,94 @@
+#ifndef LLMO_BOUNDARY_HPP
+#define LLMO_BOUNDARY_HPP
+
+#include <cstddef> // std::size_t
+#include <cstdint> // std::uintptr_t, std::uint32_t
+#include <vector> // std::vector
+
+#include "disasm.hpp"
+
+namespace llmo
+{
+  namespace disasm
+  {
+    // One bit per byte of executable sections of a module, set where
+    // an instruction starts. Sections are swept linearly in parallel chunks,
+    // each chunk starts at its first known function start and is stitched
+    // to the end of the previous chunk afterwards. Known starts are the entry
+    // point, .pdata functions on x64 and the given ones, a sweep which runs
+    // over one of them resynchronizes there.
+    // Like any linear sweep, data inside sections is decoded as code.
+    class BoundaryIndex
+    {
+    public:
+      BoundaryIndex() = default;
+
+      // Sweeps the loaded module, threadCount of zero uses all cores.
+      // Throws kInvalidModule.
+      explicit BoundaryIndex(
+        const std::uintptr_t module,
+        const std::vector<std::uintptr_t>& functionStarts = {},
+        const unsigned threadCount = 0u);
+
+      explicit BoundaryIndex(
+        const void* module,
+        const std::vector<std::uintptr_t>& functionStarts = {},
+        const unsigned threadCount = 0u) :
+        BoundaryIndex(reinterpret_cast<std::uintptr_t>(module), functionStarts, threadCount) {}
+
+      // Restores an index saved by Serialize for the same image,
+      // which may be loaded at another base.
+      // Throws kInvalidModule, kInvalidFormat or kModuleMismatch.
+      static BoundaryIndex Deserialize(
+        const std::uintptr_t module,
+        const void* data,
+        const std::size_t size);
+
+      // Header with the image identity followed by the bitmap.
+      std::vector<std::uint8_t> Serialize() const;
+
+      bool contains(const std::uintptr_t address) const {
+        return address - m_begin < m_size;
+      }
+
+      bool isBoundary(const std::uintptr_t address) const
+      {
+        const std::size_t offset{address - m_begin};
+        return offset < m_size && 0u != (m_bits[offset / 32u] >> (offset % 32u) & 1u);
+      }
+
+      bool isBoundary(const void* address) const {
+        return isBoundary(reinterpret_cast<std::uintptr_t>(address));
+      }
+
+      // Returns the first boundary after the address or zero.
+      // Instructions are at most 15 bytes long, so inside a section
+      // it's found in the same or the next bitmap word.
+      std::uintptr_t getNext(const std::uintptr_t address) const;
+
+      // Returns the last boundary before the address or zero.
+      std::uintptr_t getPrevious(const std::uintptr_t address) const;
+
+      // Returns the covered range, from the first executable section
+      // to the end of the last one, empty for the default index.
+      std::uintptr_t getBegin() const {
+        return m_begin;
+      }
+
+      std::size_t getSize() const {
+        return m_size;
+      }
+
+    private:
+      std::uintptr_t m_module{0u};
+      std::uint32_t m_timeDateStamp{0u};
+      std::uint32_t m_sizeOfImage{0u};
+
+      std::uintptr_t m_begin{0u};
+      std::size_t m_size{0u};
+      std::vector<std::uint32_t> m_bits{};
+    };
+  } // namespace disasm
+} // namespace llmo
+
+#endif // LLMO_BOUNDARY_HPP
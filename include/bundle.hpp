@@ -0,0 +1,103 @@
+#ifndef LLMO_BUNDLE_HPP
+#define LLMO_BUNDLE_HPP
+
+#include <cstddef> // std::size_t
+#include <cstdint> // std::uintptr_t
+#include <stdexcept> // std::exception
+
+#include "rwe.hpp"
+#include "bundle_format.hpp"
+
+namespace llmo
+{
+  namespace bundle
+  {
+    // Bundle exception class.
+    class Exception : public std::exception
+    {
+    public:
+      // Bundle exception codes.
+      enum class Code
+      {
+        kCouldNotOpen,
+        kCouldNotMap,
+        kInvalidFormat,
+        kModuleNotFound,
+        kModuleMismatch,
+        kOriginalMismatch,
+      };
+
+      Exception(const std::uintptr_t address, const Code code) :
+        std::exception{}, m_address(address), m_code(code) {}
+
+      Exception(const Code code) :
+        std::exception{}, m_code(code) {}
+
+      std::uintptr_t getAddress() {
+        return m_address;
+      }
+
+      Code getCode() {
+        return m_code;
+      }
+
+    private:
+      std::uintptr_t m_address{};
+      Code m_code{Code::kCouldNotOpen};
+    };
+
+    using Code = Exception::Code;
+
+    // Patch bundle mapped into memory. Patches are applied directly
+    // from the mapping, without parsing or copying.
+    // Throws bundle::Exception and rwe::Exception.
+    class Bundle
+    {
+    public:
+      // Maps the file and validates its layout.
+      explicit Bundle(const wchar_t* path);
+
+      Bundle(const Bundle&) = delete;
+      Bundle& operator=(const Bundle&) = delete;
+
+      // Unmaps the file, but doesn't restore patches.
+      ~Bundle();
+
+      // Returns base of the loaded module the bundle is made for.
+      // Throws kModuleNotFound or kModuleMismatch, or kInvalidFormat
+      // if a patch reaches past SizeOfImage of the module.
+      std::uintptr_t getModule() const;
+
+      // Returns index of the first patch whose bytes in memory don't match
+      // the expected original bytes, or getPatchCount() if all match.
+      std::size_t findMismatch() const;
+
+      // Checks original bytes and writes all patches in address order,
+      // patches on the same pages share one protection change.
+      // Throws kOriginalMismatch without writing anything.
+      void Apply();
+
+      // Writes original bytes back.
+      void Restore();
+
+      std::size_t getPatchCount() const {
+        return m_header->patchCount;
+      }
+
+    private:
+      void write(const std::uintptr_t module, const bool apply);
+
+      const std::uint8_t* getData(const std::uint32_t offset) const {
+        return m_data + offset;
+      }
+
+      const void* m_view{};
+
+      const Header* m_header{};
+      const Record* m_records{};
+      const std::uint8_t* m_data{};
+    };
+  } // namespace bundle
+} // namespace llmo
+
+#endif // LLMO_BUNDLE_HPP
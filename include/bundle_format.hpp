@@ -0,0 +1,51 @@
+#ifndef LLMO_BUNDLE_FORMAT_HPP
+#define LLMO_BUNDLE_FORMAT_HPP
+
+#include <cstddef> // std::size_t
+#include <cstdint> // std::uint32_t
+
+namespace llmo
+{
+  // Binary patch bundles, see bundle.hpp and tools/bundlec.cpp.
+  // Layout: Header, sorted Record array, data with original
+  // and replacement bytes. All values are little-endian.
+  namespace bundle
+  {
+    // "LLPB"
+    constexpr std::uint32_t kMagic{0x42504C4Cu};
+    constexpr std::uint32_t kVersion{1u};
+
+    constexpr std::size_t kModuleNameSize{64u};
+
+    struct Header
+    {
+      std::uint32_t magic;
+      std::uint32_t version;
+
+      // Module identity. Empty name means the main executable,
+      // zero stamp or size matches any module.
+      char module[kModuleNameSize];
+      std::uint32_t timeDateStamp;
+      std::uint32_t sizeOfImage;
+
+      std::uint32_t patchCount;
+      std::uint32_t patchesOffset; // Offset of the Record array.
+      std::uint32_t dataOffset;
+      std::uint32_t dataSize;
+    };
+
+    // Patch records are sorted by rva and don't overlap.
+    struct Record
+    {
+      std::uint32_t rva;
+      std::uint32_t size;
+      std::uint32_t original; // Offset of expected bytes in data.
+      std::uint32_t replacement; // Offset of new bytes in data.
+    };
+
+    static_assert(sizeof(Header) == 96u, "Unexpected bundle header size");
+    static_assert(sizeof(Record) == 16u, "Unexpected bundle record size");
+  } // namespace bundle
+} // namespace llmo
+
+#endif // LLMO_BUNDLE_FORMAT_HPP
@@ -0,0 +1,41 @@
+#ifndef LLMO_CAVE_HPP
+#define LLMO_CAVE_HPP
+
+#include <cstddef> // std::size_t
+#include <cstdint> // std::uintptr_t, std::uint8_t
+#include <vector> // std::vector
+
+#include "rwe.hpp"
+
+namespace llmo
+{
+  namespace rwe
+  {
+    // Run of padding bytes inside executable section.
+    struct CodeCave
+    {
+      std::uintptr_t address;
+      std::size_t size;
+      std::uint8_t filler; // 0x00, 0x90 or 0xCC.
+    };
+
+    // Finds runs of at least minSize equal padding bytes (0x00, 0x90
+    // or 0xCC, the same as MinHook's IsCodePadding accepts) in executable
+    // sections of the module, scanning 16 bytes at a time.
+    // Caves are sorted by distance to the target, nearest first, then by size,
+    // largest first. Without the target they are sorted by size only.
+    // Short zero runs can be immediates, so keep minSize reasonable.
+    // Throws rwe::Exception with kSizeIsZero if minSize is zero.
+    std::vector<CodeCave> FindCodeCaves(
+      const std::uintptr_t module,
+      const std::size_t minSize,
+      const std::uintptr_t target = 0u);
+
+    std::vector<CodeCave> FindCodeCaves(
+      const void* module,
+      const std::size_t minSize,
+      const void* target = nullptr);
+  } // namespace rwe
+} // namespace llmo
+
+#endif // LLMO_CAVE_HPP
@@ -0,0 +1,231 @@
+#ifndef LLMO_CHAIN_HPP
+#define LLMO_CHAIN_HPP
+
+#include <algorithm> // std::find_if
+#include <atomic> // std::atomic
+#include <cstddef> // std::size_t
+#include <cstdint> // std::uintptr_t
+#include <memory> // std::unique_ptr
+#include <mutex> // std::mutex, std::lock_guard
+#include <utility> // std::forward
+#include <vector> // std::vector
+
+#include "hook.hpp"
+
+namespace llmo
+{
+  namespace hook
+  {
+    // Indirect jump through a pointer-sized slot, allocated near the origin.
+    // Retargeted by one atomic store, without touching the code.
+    // Throws rwe::Exception.
+    class JumpSlot
+    {
+    public:
+      explicit JumpSlot(const std::uintptr_t origin);
+
+      // Frees the code, nothing should jump to it anymore.
+      ~JumpSlot();
+
+      JumpSlot(const JumpSlot&) = delete;
+      JumpSlot& operator=(const JumpSlot&) = delete;
+
+      void Set(const void* destination);
+
+      // Address of the jump.
+      const void* getEntry() const {
+        return m_code;
+      }
+
+    private:
+      void* m_code;
+    };
+
+    // Several detours of one target, called by priority, higher first,
+    // and in the order of adding for equal ones. The target is hooked once,
+    // with a jump through JumpSlot to the first detour, so adding and
+    // removing detours only publishes a new copy of the list and retargets
+    // the slot, the code isn't patched again and threads aren't frozen.
+    // Each detour passes itself to Process, which calls the next one
+    // or the original function after the last one.
+    // Process counts itself in m_readers only while it looks up the next
+    // detour, not while calling it. Replaced lists are freed by the next Add
+    // or Remove which sees no lookups after publishing its list, the rest
+    // at the destruction. T should be function prototype.
+    template <class T>
+    class Chain
+    {
+    public:
+      // Doesn't hook, the first Add does.
+      explicit Chain(const std::uintptr_t address) :
+        m_address(address), m_slot(address) {}
+
+      explicit Chain(const void* function) :
+        Chain{reinterpret_cast<std::uintptr_t>(function)} {}
+
+      // Removes the hook.
+      ~Chain()
+      {
+        if (m_isCreated) {
+          Engine::Remove(m_address);
+        }
+      }
+
+      Chain(const Chain&) = delete;
+      Chain& operator=(const Chain&) = delete;
+
+      // Adds the detour, hooking the target at the first call.
+      // Returns false if the detour is in the chain already, Process
+      // couldn't tell its two places apart.
+      // Throws kCouldNotCreate or kCouldNotEnable.
+      bool Add(const T detour, const int priority = 0)
+      {
+        std::lock_guard<std::mutex> lock{m_mutex};
+
+        const Links* current{m_links.load(std::memory_order_relaxed)};
+
+        if (nullptr != current && current->end() != std::find_if(current->begin(),
+          current->end(), [detour](const Link& link) { return link.detour == detour; }))
+        {
+          return false;
+        }
+
+        if (!m_isCreated)
+        {
+          if (!Engine::Create(m_address, m_slot.getEntry(), &m_original)) {
+            throw Exception{m_address, Code::kCouldNotCreate};
+          }
+
+          m_slot.Set(reinterpret_cast<const void*>(m_original));
+
+          if (!Engine::Enable(m_address))
+          {
+            Engine::Remove(m_address);
+            throw Exception{m_address, Code::kCouldNotEnable};
+          }
+
+          m_isCreated = true;
+        }
+
+        std::unique_ptr<Links> links{copyLinks()};
+
+        const auto position = std::find_if(links->begin(), links->end(),
+          [priority](const Link& link) { return link.priority < priority; });
+
+        links->insert(position, Link{detour, priority});
+        publish(std::move(links));
+
+        return true;
+      }
+
+      // Returns false if the detour isn't in the chain. The target stays
+      // hooked, an empty chain goes straight to the original function.
+      // Calls in flight inside the removed detour go to the original function
+      // from its Process, skipping the detours after it.
+      bool Remove(const T detour)
+      {
+        std::lock_guard<std::mutex> lock{m_mutex};
+
+        std::unique_ptr<Links> links{copyLinks()};
+
+        const auto position = std::find_if(links->begin(), links->end(),
+          [detour](const Link& link) { return link.detour == detour; });
+
+        if (position == links->end()) {
+          return false;
+        }
+
+        links->erase(position);
+        publish(std::move(links));
+
+        return true;
+      }
+
+      // Calls the detour after self, or the original function.
+      // A detour removed while it runs goes to the original function.
+      template <typename... Args, class R = detail::return_type_T<T>>
+      R Process(const T self, Args... args)
+      {
+        T next{m_original};
+
+        m_readers.fetch_add(1u, std::memory_order_seq_cst);
+        const Links* links{m_links.load(std::memory_order_seq_cst)};
+
+        if (nullptr != links)
+        {
+          for (std::size_t i{0u}; i + 1u < links->size(); ++i)
+          {
+            if ((*links)[i].detour == self)
+            {
+              next = (*links)[i + 1u].detour;
+              break;
+            }
+          }
+        }
+
+        m_readers.fetch_sub(1u, std::memory_order_release);
+
+        return next(std::forward<Args>(args)...);
+      }
+
+      std::size_t getSize() const
+      {
+        m_readers.fetch_add(1u, std::memory_order_seq_cst);
+
+        const Links* links{m_links.load(std::memory_order_seq_cst)};
+        const std::size_t size{nullptr != links ? links->size() : 0u};
+
+        m_readers.fetch_sub(1u, std::memory_order_release);
+        return size;
+      }
+
+    private:
+      struct Link
+      {
+        T detour;
+        int priority;
+      };
+
+      using Links = std::vector<Link>;
+
+      std::unique_ptr<Links> copyLinks() const
+      {
+        const Links* links{m_links.load(std::memory_order_relaxed)};
+        return std::unique_ptr<Links>{nullptr != links ? new Links{*links} : new Links{}};
+      }
+
+      // The list goes first, so a thread which enters the new first
+      // detour finds it there. Lookups which start after the store see
+      // the new list, so without lookups in flight the old ones are unused.
+      void publish(std::unique_ptr<Links> links)
+      {
+        const Links* published{links.get()};
+
+        m_links.store(published, std::memory_order_seq_cst);
+
+        if (0u == m_readers.load(std::memory_order_seq_cst)) {
+          m_retired.clear();
+        }
+
+        m_retired.push_back(std::move(links));
+
+        m_slot.Set(published->empty()
+          ? reinterpret_cast<const void*>(m_original)
+          : reinterpret_cast<const void*>(published->front().detour));
+      }
+
+      std::uintptr_t m_address{};
+      T m_original{};
+      bool m_isCreated{false};
+
+      JumpSlot m_slot;
+
+      std::atomic<const Links*> m_links{nullptr};
+      std::vector<std::unique_ptr<Links>> m_retired{}; // Including the current one.
+      mutable std::atomic<std::size_t> m_readers{0u}; // Lookups in flight.
+      std::mutex m_mutex{};
+    };
+  } // namespace hook
+} // namespace llmo
+
+#endif // LLMO_CHAIN_HPP
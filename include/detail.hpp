@@ -1,6 +1,13 @@
 #ifndef LLMO_DETAIL_HPP
 #define LLMO_DETAIL_HPP
 
+#include <cstddef> // std::size_t
+#include <cstdint> // std::uint32_t
+
+#ifdef _MSC_VER
+#include <intrin.h> // _BitScanForward, _BitScanReverse
+#endif
+
 namespace llmo
 {
   // Internal data not intended for use outside the library.
@@ -29,6 +36,54 @@ namespace llmo
 
     template <typename T>
     using return_type_T = typename return_type<T>::type;
+
+    // Index of the lowest set bit, the value shouldn't be zero.
+    inline unsigned countTrailingZeros(const std::uint32_t value)
+    {
+#ifdef _MSC_VER
+      unsigned long index{};
+      ::_BitScanForward(&index, value);
+      return static_cast<unsigned>(index);
+#else
+      return static_cast<unsigned>(__builtin_ctz(value));
+#endif
+    }
+
+    // 31 minus index of the highest set bit, the value shouldn't be zero.
+    inline unsigned countLeadingZeros(const std::uint32_t value)
+    {
+#ifdef _MSC_VER
+      unsigned long index{};
+      ::_BitScanReverse(&index, value);
+      return 31u - static_cast<unsigned>(index);
+#else
+      return static_cast<unsigned>(__builtin_clz(value));
+#endif
+    }
+
+    // Bounds of the bytes covered by a list of fields, each field
+    // should provide offset and end constants, see rwe::Field.
+    template <class... Fields>
+    struct fields_span;
+
+    template <class F>
+    struct fields_span<F>
+    {
+      static constexpr std::size_t begin = F::offset;
+      static constexpr std::size_t end = F::end;
+    };
+
+    template <class F, class... Rest>
+    struct fields_span<F, Rest...>
+    {
+      static constexpr std::size_t begin =
+        F::offset < fields_span<Rest...>::begin ?
+          F::offset : fields_span<Rest...>::begin;
+
+      static constexpr std::size_t end =
+        F::end > fields_span<Rest...>::end ?
+          F::end : fields_span<Rest...>::end;
+    };
   } // namespace detail
 } // namespace llmo
 
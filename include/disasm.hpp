@@ -0,0 +1,198 @@
+#ifndef LLMO_DISASM_HPP
+#define LLMO_DISASM_HPP
+
+#include <cstddef> // std::size_t
+#include <cstdint> // std::uintptr_t, std::uint8_t
+#include <stdexcept> // std::exception
+#include <vector> // std::vector
+
+namespace llmo
+{
+  // Length disassembler for the current architecture, built on HDE.
+  // The memory has to be readable, HDE may look up to 15 bytes ahead.
+  namespace disasm
+  {
+    constexpr std::size_t kMaxInstructionSize{15u};
+
+    // Disassembler exception class.
+    class Exception : public std::exception
+    {
+    public:
+      // Disassembler exception codes.
+      enum class Code
+      {
+        kInvalidModule,
+        kInvalidFormat,
+        kModuleMismatch,
+      };
+
+      Exception(const std::uintptr_t address, const Code code) :
+        std::exception{}, m_address(address), m_code(code) {}
+
+      Exception(const Code code) :
+        std::exception{}, m_code(code) {}
+
+      std::uintptr_t getAddress() {
+        return m_address;
+      }
+
+      Code getCode() {
+        return m_code;
+      }
+
+    private:
+      std::uintptr_t m_address{};
+      Code m_code{Code::kInvalidModule};
+    };
+
+    using Code = Exception::Code;
+
+    struct Instruction
+    {
+      std::uintptr_t address;
+      std::uint8_t length;
+      std::uint8_t opcode;
+      std::uint8_t opcode2; // After 0x0F, zero otherwise.
+      std::uint8_t modrm;
+      std::uint8_t sib;
+      std::uint8_t rex; // Always zero on x86.
+      std::uint8_t immediateSize;
+      std::uint8_t displacementSize;
+      std::uint64_t immediate; // Zero-extended.
+      std::int32_t displacement; // Sign-extended.
+      std::uintptr_t target; // Of relative branch or RIP-relative operand, or zero.
+      bool hasModrm;
+      bool hasSib;
+      bool isRelative; // Branch with relative immediate.
+      bool isRipRelative; // [ rip + disp32 ] operand, x64 only.
+      bool isError; // Invalid opcode, length, lock or operand.
+
+      std::uint8_t getMod() const {
+        return static_cast<std::uint8_t>(modrm >> 6);
+      }
+
+      std::uint8_t getReg() const {
+        return static_cast<std::uint8_t>(modrm >> 3 & 7u);
+      }
+
+      std::uint8_t getRm() const {
+        return static_cast<std::uint8_t>(modrm & 7u);
+      }
+
+      std::uintptr_t getNext() const {
+        return address + length;
+      }
+    };
+
+    // Decodes one instruction. Invalid ones have isError set
+    // and the length HDE has reached.
+    Instruction Decode(const std::uintptr_t address);
+
+    Instruction Decode(const void* address);
+
+    // Decodes consecutive instructions until they cover size bytes,
+    // stops before the first invalid one.
+    std::vector<Instruction> DecodeRange(
+      const std::uintptr_t address,
+      const std::size_t size);
+
+    std::vector<Instruction> DecodeRange(
+      const void* address,
+      const std::size_t size);
+
+    // Compact result of the batch decoding, 8 bytes per instruction.
+    // Displacement and immediate are always the last bytes of instruction,
+    // so their offsets follow from the sizes.
+    struct Record
+    {
+      enum Flags : std::uint8_t
+      {
+        kTwoByte = 0x01, // Opcode is the byte after 0x0F.
+        kModrm = 0x02,
+        kRelative = 0x04,
+        kRipRelative = 0x08,
+        kError = 0x10,
+      };
+
+      std::uint32_t offset; // From the beginning of the batch.
+      std::uint8_t length;
+      std::uint8_t opcode;
+      std::uint8_t flags;
+      std::uint8_t sizes; // Displacement size << 4 | total immediate size.
+
+      std::uint8_t getDisplacementSize() const {
+        return static_cast<std::uint8_t>(sizes >> 4);
+      }
+
+      std::uint8_t getImmediateSize() const {
+        return static_cast<std::uint8_t>(sizes & 0x0Fu);
+      }
+    };
+
+    // Decodes consecutive instructions of the buffer into records until
+    // size bytes or capacity records are consumed, returns count of records.
+    // Invalid instructions get kError and decoding goes on after them,
+    // lengths and flags are the same as HDE gives. Never reads past the buffer.
+    // On x64 common instructions are decoded by flat tables built from
+    // HDE's ones, rare prefixes and opcodes fall back to hde64.
+    std::size_t DecodeBatch(
+      const void* code,
+      const std::size_t size,
+      Record* records,
+      const std::size_t capacity);
+
+    std::vector<Record> DecodeBatch(const void* code, const std::size_t size);
+
+    // Direct-mapped cache of decoded instructions keyed by address,
+    // for repeated queries on hot code. Each hit is checked against
+    // the current bytes, so patched code is decoded again, not served stale.
+    // Not thread-safe, use one cache per thread.
+    class Cache
+    {
+    public:
+      // Capacity is rounded up to a power of two.
+      explicit Cache(const std::size_t capacity = 4096u);
+
+      Instruction Decode(const std::uintptr_t address);
+
+      Instruction Decode(const void* address) {
+        return Decode(reinterpret_cast<std::uintptr_t>(address));
+      }
+
+      std::vector<Instruction> DecodeRange(
+        const std::uintptr_t address,
+        const std::size_t size);
+
+      std::vector<Instruction> DecodeRange(
+        const void* address,
+        const std::size_t size)
+      {
+        return DecodeRange(reinterpret_cast<std::uintptr_t>(address), size);
+      }
+
+      void Clear();
+
+      std::size_t getHits() const {
+        return m_hits;
+      }
+
+      std::size_t getMisses() const {
+        return m_misses;
+      }
+
+    private:
+      struct Entry
+      {
+        Instruction instruction; // Empty if the address is zero.
+        std::uint8_t bytes[kMaxInstructionSize];
+      };
+
+      std::vector<Entry> m_entries{};
+      std::size_t m_mask{0u};
+      std::size_t m_hits{0u};
+      std::size_t m_misses{0u};
+    };
+  } // namespace disasm
+} // namespace llmo
+
+#endif // LLMO_DISASM_HPP
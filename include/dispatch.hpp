@@ -0,0 +1,153 @@
+#ifndef LLMO_DISPATCH_HPP
+#define LLMO_DISPATCH_HPP
+
+#include <cstddef> // std::size_t
+#include <cstdint> // std::uintptr_t
+#include <memory> // std::unique_ptr
+#include <utility> // std::forward, std::move
+
+#include "hook.hpp"
+
+namespace llmo
+{
+  namespace hook
+  {
+    // Slot of the process-wide dispatch tables with a jump through it,
+    // allocated near the origin. There are two tables, the active one
+    // and the bypass one, and the jump reads the active table pointer
+    // first, so setBypassed switches all slots with one store.
+    // On x64 the jump uses rax, which carries no arguments there, on x86
+    // it saves and restores eax. At most kCapacity slots exist at once.
+    class DispatchSlot
+    {
+    public:
+      static constexpr std::size_t kCapacity{4096u};
+
+      // Both destinations are null until set.
+      // Throws kNoDispatchSlot or rwe::Exception.
+      explicit DispatchSlot(const std::uintptr_t origin);
+
+      // Frees the slot, nothing should jump to it anymore.
+      ~DispatchSlot();
+
+      DispatchSlot(const DispatchSlot&) = delete;
+      DispatchSlot& operator=(const DispatchSlot&) = delete;
+
+      // Release-store of the destination while not bypassed.
+      void Set(const void* destination);
+
+      // Release-store of the destination while bypassed.
+      void SetBypass(const void* destination);
+
+      // Address of the jump.
+      const void* getEntry() const {
+        return m_code;
+      }
+
+      // Makes every slot jump to its bypass destination, or back.
+      static void setBypassed(const bool bypassed);
+
+      static bool isBypassed();
+
+    private:
+      std::size_t m_index;
+      void* m_code{nullptr};
+    };
+
+    // Hook whose target is patched once, at the first Enable, to jump
+    // through a DispatchSlot. Then enabling, disabling and replacing
+    // the detour only store the slot, the code isn't written again and
+    // threads aren't frozen, so it suits hooks toggled often.
+    // The bypass destination is the original function, so
+    // DispatchSlot::setBypassed(true) turns off all such hooks at once.
+    // T should be function prototype.
+    template <class T>
+    class DispatchedHook
+    {
+    public:
+      // Doesn't create hook, just initialises the address.
+      DispatchedHook(const std::uintptr_t address) : m_address(address) {}
+
+      // Doesn't create hook, just initialises the address.
+      DispatchedHook(const void* function) :
+        DispatchedHook{reinterpret_cast<std::uintptr_t>(function)} {}
+
+      // Removes hook, the slot is freed after it.
+      ~DispatchedHook()
+      {
+        if (m_isCreated) {
+          Engine::Remove(m_address);
+        }
+      }
+
+      DispatchedHook(const DispatchedHook&) = delete;
+      DispatchedHook& operator=(const DispatchedHook&) = delete;
+
+      // Enables hook or replaces the detour of the enabled one.
+      // Hook will be created and patched at the first call.
+      // Throws kNoDispatchSlot, kCouldNotCreate or kCouldNotEnable.
+      void Enable(const void* function)
+      {
+        if (!m_isCreated) {
+          create();
+        }
+
+        m_slot->Set(function);
+        m_isEnabled = true;
+      }
+
+      // Sends the target to the original function, the patch stays.
+      void Disable()
+      {
+        if (m_isCreated) {
+          m_slot->Set(reinterpret_cast<const void*>(m_original));
+        }
+
+        m_isEnabled = false;
+      }
+
+      bool isEnabled() {
+        return m_isEnabled;
+      }
+
+      // You should pass callback's params to it.
+      // Should be called anyway.
+      template <typename... Args, class R = detail::return_type_T<T>>
+      R Process(Args... args) {
+        return m_original(std::forward<Args>(args)...);
+      }
+
+    private:
+      void create()
+      {
+        std::unique_ptr<DispatchSlot> slot{new DispatchSlot{m_address}};
+
+        if (!Engine::Create(m_address, slot->getEntry(), &m_original)) {
+          throw Exception{m_address, Code::kCouldNotCreate};
+        }
+
+        slot->SetBypass(reinterpret_cast<const void*>(m_original));
+        slot->Set(reinterpret_cast<const void*>(m_original));
+
+        if (!Engine::Enable(m_address))
+        {
+          Engine::Remove(m_address);
+          throw Exception{m_address, Code::kCouldNotEnable};
+        }
+
+        m_slot = std::move(slot);
+        m_isCreated = true;
+      }
+
+      bool m_isCreated{false};
+      bool m_isEnabled{false};
+
+      std::uintptr_t m_address{};
+      T m_original{};
+
+      std::unique_ptr<DispatchSlot> m_slot{};
+    };
+  } // namespace hook
+} // namespace llmo
+
+#endif // LLMO_DISPATCH_HPP
@@ -0,0 +1,73 @@
+#ifndef LLMO_FUNCTION_TABLE_HPP
+#define LLMO_FUNCTION_TABLE_HPP
+
+#include <cstddef> // std::size_t
+#include <cstdint> // std::uintptr_t
+#include <vector> // std::vector
+
+namespace llmo
+{
+  namespace module
+  {
+    // Code range of a function, [ begin, end ).
+    struct Function
+    {
+      std::uintptr_t begin;
+      std::uintptr_t end;
+
+      bool contains(const std::uintptr_t address) const {
+        return address >= begin && address < end;
+      }
+
+      std::size_t getSize() const {
+        return end - begin;
+      }
+    };
+
+    // Functions of the loaded image from its exception directory,
+    // sorted by address. Fragments chained to the previous function
+    // and starting right at its end are merged into it.
+    // x86 images have no such directory, so the table is always empty there.
+    class FunctionTable
+    {
+    public:
+      FunctionTable() = default;
+
+      // Empty if the image isn't valid or has no exception directory.
+      explicit FunctionTable(const std::uintptr_t module);
+
+      explicit FunctionTable(const void* module) :
+        FunctionTable(reinterpret_cast<std::uintptr_t>(module)) {}
+
+      // Returns the function containing the address or nullptr, O(log n).
+      const Function* Find(const std::uintptr_t address) const;
+
+      const Function* Find(const void* address) const {
+        return Find(reinterpret_cast<std::uintptr_t>(address));
+      }
+
+      // Returns count of bytes from the address to the end of its function,
+      // zero if the address isn't in a known function.
+      std::size_t getRemainingSize(const std::uintptr_t address) const
+      {
+        const Function* function{Find(address)};
+        return nullptr != function ? function->end - address : 0u;
+      }
+
+      const std::vector<Function>& getFunctions() const {
+        return m_functions;
+      }
+
+      bool isEmpty() const {
+        return m_functions.empty();
+      }
+
+    private:
+      std::vector<Function> m_functions{};
+    };
+  } // namespace module
+
+  using module::FunctionTable;
+} // namespace llmo
+
+#endif // LLMO_FUNCTION_TABLE_HPP
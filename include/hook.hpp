@@ -1,11 +1,16 @@
 #ifndef LLMO_HOOK_HPP
 #define LLMO_HOOK_HPP
 
+#include <cstddef> // std::size_t
 #include <cstdint> // std::uintptr_t
 #include <stdexcept> // std::exception
+#include <mutex> // std::mutex, std::lock_guard
+#include <set> // std::set
+#include <vector> // std::vector
 
-#include "rwe.hpp"
-#include "../third-party/minhook/include/MinHook.h"
+#include "detail.hpp" // return_type_T
+#include "function_table.hpp"
+#include "hook_backend.hpp"
 
 namespace llmo
 {
@@ -23,6 +28,9 @@ namespace llmo
         kCouldNotCreate,
         kCouldNotEnable,
         kCouldNotDisable,
+        kFunctionTooShort,
+        kCouldNotApply,
+        kNoDispatchSlot,
       };
 
       Exception(const std::uintptr_t address, const Code code) :
@@ -46,23 +54,26 @@ namespace llmo
 
     using Code = Exception::Code;
 
-    // Hook engine, MinHook by default.
+    // Hook engine, MinHook on Win32, see hook_backend.hpp.
     // Throws llmo::Hook::Exception.
     class Engine
     {
     private:
+      // Size of JMP_REL, the hot patch area has the same size.
+      static constexpr std::uintptr_t kPatchSize{5u};
+
       // Initialises hook engine.
       // It's private because should be called exactly once.
       // That's constructor's business.
       static bool Initialize() {
-        return MH_OK == MH_Initialize();
+        return backend::Initialize();
       }
 
       // Uninitialises hook engine.
       // It's private because should be called exactly once.
       // That's destructor's business.
       static bool Uninitialize() {
-        return MH_OK == MH_Uninitialize();
+        return backend::Uninitialize();
       }
 
       // Private constructor.
@@ -74,6 +85,19 @@ namespace llmo
         }
       }
 
+      // Targets of the created hooks, sorted for range queries.
+      static std::set<std::uintptr_t>& getTargets()
+      {
+        static std::set<std::uintptr_t> targets{};
+        return targets;
+      }
+
+      static std::mutex& getTargetsMutex()
+      {
+        static std::mutex mutex{};
+        return mutex;
+      }
+
     public:
       // Uninitializes hook engine.
       ~Engine() {
@@ -88,9 +112,14 @@ namespace llmo
       {
         static Engine instance{};
 
-        return MH_OK == MH_CreateHook(
-          reinterpret_cast<::LPVOID>(address), 
-          const_cast<::LPVOID>(function), original);
+        if (!backend::Create(address, function, original)) {
+          return false;
+        }
+
+        std::lock_guard<std::mutex> lock{getTargetsMutex()};
+        getTargets().insert(address);
+
+        return true;
       }
       
       // Template for create function.
@@ -107,25 +136,89 @@ namespace llmo
 
       // Enables hook. Should be called after the creation.
       static bool Enable(const std::uintptr_t address) {
-        return MH_OK == MH_EnableHook(reinterpret_cast<::LPVOID>(address));
+        return backend::Enable(address);
       }
 
       // Disables hook, but doesn't remove.
       static bool Disable(const std::uintptr_t address) {
-        return MH_OK == MH_DisableHook(reinterpret_cast<::LPVOID>(address));
+        return backend::Disable(address);
+      }
+
+      // Queues enabling of the created hook until ApplyQueued.
+      static bool QueueEnable(const std::uintptr_t address) {
+        return backend::QueueEnable(address);
+      }
+
+      // Queues disabling of the created hook until ApplyQueued.
+      static bool QueueDisable(const std::uintptr_t address) {
+        return backend::QueueDisable(address);
+      }
+
+      // Applies every queued change with one freeze of the threads.
+      // Either all of them are applied or none, the queue is dropped then.
+      static bool ApplyQueued() {
+        return backend::ApplyQueued();
       }
 
       // Removes hook.
-      static bool Remove(const std::uintptr_t address) {
-        return MH_OK == MH_RemoveHook(reinterpret_cast<::LPVOID>(address));
+      static bool Remove(const std::uintptr_t address)
+      {
+        if (!backend::Remove(address)) {
+          return false;
+        }
+
+        std::lock_guard<std::mutex> lock{getTargetsMutex()};
+        getTargets().erase(address);
+
+        return true;
+      }
+
+      // Enables and disables hooks with int3 and cross-processor syncs
+      // instead of freezing every thread, see MH_PATCH_MODE_BREAKPOINT.
+      // Win32 only, the Linux backend always freezes.
+      static void UseBreakpointPatching(const bool use) {
+        backend::UseBreakpointPatching(use);
+      }
+
+      // Returns true if the hook is created and enabled.
+      // Doesn't wait for other lookups, only for changes of the hooks.
+      static bool isEnabled(const std::uintptr_t address) {
+        return backend::isEnabled(address);
+      }
+
+      // Returns true if the range overlaps bytes which a created hook
+      // patches, including the hot patch area above the target.
+      static bool isHooked(const std::uintptr_t address, const std::size_t size)
+      {
+        std::lock_guard<std::mutex> lock{getTargetsMutex()};
+
+        const std::set<std::uintptr_t>& targets = getTargets();
+        const auto target = targets.lower_bound(
+          address >= kPatchSize ? address - kPatchSize + 1u : 0u);
+
+        return target != targets.end() && *target < address + size + kPatchSize;
+      }
+
+      // Returns false if the table knows the function of the address
+      // and it ends before the patch does.
+      static bool fitsFunction(
+        const module::FunctionTable& functions,
+        const std::uintptr_t address)
+      {
+        const module::Function* function{functions.Find(address)};
+        return nullptr == function || function->end - address >= kPatchSize;
       }
     };
 
+    class Transaction;
+
     // Template class for MinHook API.
     // T should be function prototype.
     template <class T>
     class Hook
     {
+      friend class Transaction;
+
     public:
       // Doesn't create hook, just initialises the address.
       Hook(const std::uintptr_t address) : m_address(address) {}
@@ -161,6 +254,17 @@ namespace llmo
         }
       }
 
+      // Same, but first checks the patch ends inside the target function.
+      // Throws kFunctionTooShort.
+      void Enable(const void* function, const module::FunctionTable& functions)
+      {
+        if (!m_isCreated && !Engine::fitsFunction(functions, m_address)) {
+          throw Exception{m_address, Code::kFunctionTooShort};
+        }
+
+        Enable(function);
+      }
+
       // Disables hook, but doesn't remove. Can be recalled.
       void Disable()
       {
@@ -192,6 +296,155 @@ namespace llmo
       std::uintptr_t m_address{};
       T m_original{};
     };
+
+    // Collects enabling and disabling of several hooks and commits them
+    // with one freeze of the threads and one batch of protection changes,
+    // so no thread sees a half-applied set. The last operation wins
+    // for a hook given twice. Hooks should outlive the transaction.
+    // Changes queued directly with MinHook are applied by the commit too,
+    // unless the commit has nothing to change itself.
+    class Transaction
+    {
+    public:
+      Transaction() = default;
+
+      Transaction(const Transaction&) = delete;
+      Transaction& operator=(const Transaction&) = delete;
+
+      // Enables hook at the commit, creating it if needed.
+      template <class T>
+      void Enable(Hook<T>& hook, const void* function)
+      {
+        m_operations.push_back(Operation{hook.m_address, function,
+          reinterpret_cast<void**>(&hook.m_original),
+          &hook.m_isCreated, &hook.m_isEnabled, true});
+      }
+
+      // Disables hook at the commit, doesn't remove.
+      template <class T>
+      void Disable(Hook<T>& hook)
+      {
+        m_operations.push_back(Operation{hook.m_address, nullptr, nullptr,
+          &hook.m_isCreated, &hook.m_isEnabled, false});
+      }
+
+      // Applies the operations and clears them.
+      // On failure every hook stays as it was, hooks created by the commit
+      // are removed and the operations are kept.
+      // Throws kCouldNotCreate with the address or kCouldNotApply,
+      // with the address if the hook couldn't be queued.
+      void Commit()
+      {
+        std::vector<Operation> operations{};
+        operations.reserve(m_operations.size());
+
+        for (std::size_t i{m_operations.size()}; i > 0u; --i)
+        {
+          const Operation& operation = m_operations[i - 1u];
+          bool isDuplicate{false};
+
+          for (const Operation& added : operations) {
+            isDuplicate = isDuplicate || added.address == operation.address;
+          }
+
+          if (!isDuplicate) {
+            operations.push_back(operation);
+          }
+        }
+
+        std::vector<std::uintptr_t> created{};
+
+        for (const Operation& operation : operations)
+        {
+          if (operation.enable && !*operation.isCreated)
+          {
+            if (!Engine::Create(operation.address, operation.function, operation.original))
+            {
+              rollback(created);
+              throw Exception{operation.address, Code::kCouldNotCreate};
+            }
+
+            created.push_back(operation.address);
+          }
+        }
+
+        std::vector<const Operation*> queued{};
+
+        for (const Operation& operation : operations)
+        {
+          // Disabling of a hook which wasn't created is a no-op.
+          if (operation.enable != *operation.isEnabled
+            && (operation.enable || *operation.isCreated))
+          {
+            if (!queue(operation.address, operation.enable))
+            {
+              unqueue(queued);
+              rollback(created);
+              throw Exception{operation.address, Code::kCouldNotApply};
+            }
+
+            queued.push_back(&operation);
+          }
+        }
+
+        if (!queued.empty() && !Engine::ApplyQueued())
+        {
+          unqueue(queued);
+          rollback(created);
+          throw Exception{Code::kCouldNotApply};
+        }
+
+        for (const Operation& operation : operations)
+        {
+          *operation.isCreated = *operation.isCreated || operation.enable;
+          *operation.isEnabled = operation.enable && *operation.isCreated;
+        }
+
+        m_operations.clear();
+      }
+
+      // Drops the operations without applying.
+      void Clear() {
+        m_operations.clear();
+      }
+
+      bool isEmpty() const {
+        return m_operations.empty();
+      }
+
+    private:
+      struct Operation
+      {
+        std::uintptr_t address;
+        const void* function;
+        void** original;
+        bool* isCreated;
+        bool* isEnabled;
+        bool enable;
+      };
+
+      static bool queue(const std::uintptr_t address, const bool enable)
+      {
+        return enable ? Engine::QueueEnable(address) : Engine::QueueDisable(address);
+      }
+
+      // Queues the current state back, so a later ApplyQueued skips them.
+      static void unqueue(const std::vector<const Operation*>& queued)
+      {
+        for (const Operation* operation : queued) {
+          queue(operation->address, !operation->enable);
+        }
+      }
+
+      static void rollback(const std::vector<std::uintptr_t>& created)
+      {
+        for (const std::uintptr_t address : created) {
+          Engine::Remove(address);
+        }
+      }
+
+      std::vector<Operation> m_operations{};
+    };
   } // namespace hook
 
   using hook::Hook;
@@ -0,0 +1,103 @@
+#ifndef LLMO_HOOK_BACKEND_HPP
+#define LLMO_HOOK_BACKEND_HPP
+
+#include <cstdint> // std::uintptr_t
+
+#if _WIN32
+#include "../third-party/minhook/include/MinHook.h"
+#elif !defined(__linux__) || !defined(__x86_64__)
+#error Hooking is implemented only for Win32 and Linux x86-64
+#endif
+
+namespace llmo
+{
+  namespace hook
+  {
+    // Platform seam under hook::Engine. MinHook on Win32,
+    // src/hook_linux.cpp on Linux x86-64. Calls return false on failure,
+    // with the same rules as the MinHook functions of the same names.
+    namespace backend
+    {
+#if _WIN32
+      inline bool Initialize() {
+        return MH_OK == MH_Initialize();
+      }
+
+      inline bool Uninitialize() {
+        return MH_OK == MH_Uninitialize();
+      }
+
+      inline bool Create(const std::uintptr_t address, const void* function, void** original)
+      {
+        return MH_OK == MH_CreateHook(
+          reinterpret_cast<::LPVOID>(address), const_cast<::LPVOID>(function), original);
+      }
+
+      inline bool Remove(const std::uintptr_t address) {
+        return MH_OK == MH_RemoveHook(reinterpret_cast<::LPVOID>(address));
+      }
+
+      inline bool Enable(const std::uintptr_t address) {
+        return MH_OK == MH_EnableHook(reinterpret_cast<::LPVOID>(address));
+      }
+
+      inline bool Disable(const std::uintptr_t address) {
+        return MH_OK == MH_DisableHook(reinterpret_cast<::LPVOID>(address));
+      }
+
+      inline bool QueueEnable(const std::uintptr_t address) {
+        return MH_OK == MH_QueueEnableHook(reinterpret_cast<::LPVOID>(address));
+      }
+
+      inline bool QueueDisable(const std::uintptr_t address) {
+        return MH_OK == MH_QueueDisableHook(reinterpret_cast<::LPVOID>(address));
+      }
+
+      inline bool ApplyQueued() {
+        return MH_OK == MH_ApplyQueued();
+      }
+
+      inline void UseBreakpointPatching(const bool use) {
+        MH_SetPatchMode(use ? MH_PATCH_MODE_BREAKPOINT : MH_PATCH_MODE_FREEZE);
+      }
+
+      inline bool isEnabled(const std::uintptr_t address)
+      {
+        ::BOOL isEnabled{FALSE};
+
+        return MH_OK == MH_IsHookEnabled(reinterpret_cast<::LPVOID>(address), &isEnabled)
+          && FALSE != isEnabled;
+      }
+#else
+      // Installs the handler of the freeze signal, see src/hook_linux.cpp.
+      bool Initialize();
+
+      // Disables and removes every hook, restores the signal handler.
+      bool Uninitialize();
+
+      // Builds the trampoline in a slot mapped within 1 GB of the target.
+      bool Create(const std::uintptr_t address, const void* function, void** original);
+
+      bool Remove(const std::uintptr_t address);
+
+      bool Enable(const std::uintptr_t address);
+
+      bool Disable(const std::uintptr_t address);
+
+      bool QueueEnable(const std::uintptr_t address);
+
+      bool QueueDisable(const std::uintptr_t address);
+
+      // All queued changes under one freeze, all or none.
+      bool ApplyQueued();
+
+      // Does nothing, hooks are always patched with the threads stopped.
+      void UseBreakpointPatching(const bool use);
+
+      bool isEnabled(const std::uintptr_t address);
+#endif
+    } // namespace backend
+  } // namespace hook
+} // namespace llmo
+
+#endif // LLMO_HOOK_BACKEND_HPP
@@ -0,0 +1,84 @@
+#ifndef LLMO_JOURNAL_HPP
+#define LLMO_JOURNAL_HPP
+
+#include <cstddef> // std::size_t
+#include <cstdint> // std::uintptr_t, std::uint8_t
+#include <vector> // std::vector
+
+#include "rwe.hpp"
+
+namespace llmo
+{
+  namespace rwe
+  {
+    // Records original bytes of every Write, Copy, Set and Nop while active,
+    // so they can be undone. Records are appended to one contiguous log,
+    // a write which overlaps or continues the last record is merged into it.
+    // Not thread-safe, only one journal can be active at a time.
+    class Journal
+    {
+    public:
+      // Position in the log to roll back to.
+      using Checkpoint = std::size_t;
+
+      Journal() = default;
+
+      Journal(const Journal&) = delete;
+      Journal& operator=(const Journal&) = delete;
+
+      // Deactivates the journal, but doesn't roll back.
+      ~Journal();
+
+      // Makes the journal active, rwe mutations are recorded from now on.
+      void Activate();
+
+      // Stops recording, if the journal is active.
+      void Deactivate();
+
+      bool isActive() const;
+
+      // Returns current position in the log.
+      // Records made later are never merged with earlier ones.
+      Checkpoint CreateCheckpoint();
+
+      // Appends original bytes of the range to the log.
+      // Called by rwe functions, the range should be readable.
+      void Record(const std::uintptr_t address, const std::size_t size);
+
+      // Restores original bytes recorded after the checkpoint
+      // in reverse order and discards those records.
+      // Records on the same pages share one protection change.
+      // Throws rwe::Exception if some region can't be unprotected.
+      void Rollback(const Checkpoint checkpoint = 0u);
+
+      // Discards all records without restoring them.
+      void Clear();
+
+      // Returns size of the log in bytes.
+      std::size_t getSize() const {
+        return m_log.size();
+      }
+
+    private:
+      // Placed in the log before original bytes of each record.
+      struct RecordHeader
+      {
+        std::uintptr_t address;
+        std::size_t size;
+        std::size_t previous; // Offset of the previous record.
+      };
+
+      static constexpr std::size_t kNoRecord = static_cast<std::size_t>(-1);
+
+      RecordHeader readHeader(const std::size_t offset) const;
+      void writeHeader(const std::size_t offset, const RecordHeader& header);
+
+      std::vector<std::uint8_t> m_log{};
+
+      std::size_t m_last{kNoRecord};
+      Checkpoint m_checkpoint{0u};
+    };
+  } // namespace rwe
+} // namespace llmo
+
+#endif // LLMO_JOURNAL_HPP
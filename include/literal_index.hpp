@@ -0,0 +1,124 @@
+#ifndef LLMO_LITERAL_INDEX_HPP
+#define LLMO_LITERAL_INDEX_HPP
+
+#include <cstddef> // std::size_t
+#include <cstdint> // std::uintptr_t, std::uint64_t, std::uint32_t
+#include <vector> // std::vector
+
+#include "boundary.hpp"
+#include "function_table.hpp"
+#include "xref.hpp"
+
+namespace llmo
+{
+  namespace xref
+  {
+    // Null-terminated string literal in a read-only section.
+    struct String
+    {
+      enum class Encoding : std::uint8_t
+      {
+        kAscii,
+        kUtf16,
+      };
+
+      std::uintptr_t address;
+      std::uint32_t length; // In characters, without the terminator.
+      Encoding encoding;
+
+      std::size_t getSize() const {
+        return length * (Encoding::kAscii == encoding ? 1u : 2u);
+      }
+    };
+
+    // String literals of the module joined with the code which references
+    // them, and immediate constants of the code, for finding addresses
+    // by "the function which uses this string or this magic number".
+    // Strings are runs of printable ASCII characters, tab, CR or LF with
+    // the terminator, as bytes or as UTF-16 code units, in initialized
+    // read-only sections, found 16 bytes at a time.
+    // References are RIP-relative operands on x64, pointer-sized immediates
+    // and displacements on x86, or imm64 on x64, which hit a string.
+    // Constants are immediates of 4 or 8 bytes, as encoded, zero-extended.
+    // Code is decoded in parallel chunks which start at instruction
+    // boundaries from the boundary index.
+    // Immutable after the build, queries are thread-safe.
+    class LiteralIndex
+    {
+    public:
+      LiteralIndex() = default;
+
+      // Builds the boundary index of the module if none is given,
+      // minLength is in characters. Throws disasm::Exception.
+      explicit LiteralIndex(
+        const std::uintptr_t module,
+        const std::size_t minLength = 4u,
+        const disasm::BoundaryIndex* boundaries = nullptr,
+        const unsigned threadCount = 0u);
+
+      explicit LiteralIndex(
+        const void* module,
+        const std::size_t minLength = 4u,
+        const disasm::BoundaryIndex* boundaries = nullptr,
+        const unsigned threadCount = 0u) :
+        LiteralIndex(reinterpret_cast<std::uintptr_t>(module),
+          minLength, boundaries, threadCount) {}
+
+      // Restores an index saved by Serialize for the same image,
+      // which may be loaded at another base.
+      // Throws kInvalidModule, kInvalidFormat or kModuleMismatch.
+      static LiteralIndex Deserialize(
+        const std::uintptr_t module,
+        const void* data,
+        const std::size_t size);
+
+      // Header with the image identity followed by strings, references
+      // and constants, addresses are stored as RVAs.
+      std::vector<std::uint8_t> Serialize() const;
+
+      // Strings whose characters are the text, in both encodings,
+      // found by hash. The module should stay loaded.
+      std::vector<String> FindStrings(const char* text) const;
+
+      // References to the string, including ones into its middle,
+      // which some linkers produce for shared suffixes.
+      References getReferencesTo(const String& string) const;
+
+      // References to strings whose characters are the text.
+      std::vector<Reference> getReferencesTo(const char* text) const;
+
+      // Immediates equal to the value.
+      References getConstantReferences(const std::uint64_t value) const;
+
+      // Returns sorted begins of the functions which contain the sources,
+      // or the sources themselves if the table doesn't know them.
+      static std::vector<std::uintptr_t> getFunctions(
+        const std::vector<Reference>& references,
+        const module::FunctionTable& functions);
+
+      const std::vector<String>& getStrings() const {
+        return m_strings;
+      }
+
+    private:
+      struct Hash
+      {
+        std::uint64_t hash;
+        std::size_t string; // Index in m_strings.
+      };
+
+      void buildHashes();
+
+      std::uintptr_t m_module{0u};
+      std::uint32_t m_timeDateStamp{0u};
+      std::uint32_t m_sizeOfImage{0u};
+
+      std::vector<String> m_strings{}; // Sorted by address.
+      std::vector<Hash> m_hashes{}; // Sorted by hash.
+      std::vector<Reference> m_references{}; // Sorted by target.
+      std::vector<Reference> m_constants{}; // Sorted by value in target.
+    };
+  } // namespace xref
+} // namespace llmo
+
+#endif // LLMO_LITERAL_INDEX_HPP
@@ -0,0 +1,51 @@
+#ifndef LLMO_MODULE_HPP
+#define LLMO_MODULE_HPP
+
+#if !_WIN32
+#error Compatible only with Win32
+#endif
+
+#include <cstddef> // std::size_t
+#include <cstdint> // std::uintptr_t, std::uint32_t
+#include <vector> // std::vector
+
+#include <windows.h> // IMAGE_NT_HEADERS
+
+namespace llmo
+{
+  // Loaded PE images.
+  namespace module
+  {
+    // Section of the loaded image.
+    struct Section
+    {
+      std::uintptr_t address;
+      std::size_t size;
+      std::uint32_t characteristics;
+
+      bool isExecutable() const {
+        return 0u != (characteristics & IMAGE_SCN_MEM_EXECUTE);
+      }
+
+      bool isWritable() const {
+        return 0u != (characteristics & IMAGE_SCN_MEM_WRITE);
+      }
+
+      bool contains(const std::uintptr_t pointer) const {
+        return pointer >= address && pointer - address < size;
+      }
+    };
+
+    // Returns NT headers of the loaded image or nullptr
+    // if there are no valid DOS and NT signatures.
+    const ::IMAGE_NT_HEADERS* getNtHeaders(const std::uintptr_t module);
+
+    // Returns sections of the loaded image in the header order,
+    // empty if the image isn't valid.
+    std::vector<Section> getSections(const std::uintptr_t module);
+
+    std::vector<Section> getSections(const void* module);
+  } // namespace module
+} // namespace llmo
+
+#endif // LLMO_MODULE_HPP
@@ -0,0 +1,61 @@
+#ifndef LLMO_NOP_HPP
+#define LLMO_NOP_HPP
+
+#include <cstddef> // std::size_t
+#include <cstdint> // std::uintptr_t, std::uint8_t
+#include <vector> // std::vector
+
+#include "rwe.hpp"
+#include "boundary.hpp"
+
+namespace llmo
+{
+  namespace rwe
+  {
+    // Whole instructions replaced by nops and their original bytes.
+    struct NoppedRange
+    {
+      std::uintptr_t address;
+      std::vector<std::uint8_t> original;
+
+      std::size_t getSize() const {
+        return original.size();
+      }
+
+      // Writes the original bytes back.
+      void Restore() const;
+    };
+
+    // Replaces count instructions starting at the address with the fewest
+    // recommended multi-byte nops per instruction, so every instruction start
+    // stays one. If the range is longer than two of the longest nops,
+    // the first instruction long enough for it starts with a jmp to the end.
+    // Writes through Copy, so the active rwe::Journal records it too.
+    // If the index is given, the address has to be an instruction start in it.
+    // Throws kInvalidInstruction or kRegionIsNotAvailable without writing
+    // anything, and other rwe::Exception codes like Copy.
+    NoppedRange NopInstructions(
+      const std::uintptr_t address,
+      const std::size_t count,
+      const disasm::BoundaryIndex* index = nullptr);
+
+    // Same, but replaces as many instructions as cover at least size bytes,
+    // so the range ends on an instruction boundary.
+    NoppedRange NopInstructionBytes(
+      const std::uintptr_t address,
+      const std::size_t size,
+      const disasm::BoundaryIndex* index = nullptr);
+
+    NoppedRange NopInstructions(
+      const void* pointer,
+      const std::size_t count,
+      const disasm::BoundaryIndex* index = nullptr);
+
+    NoppedRange NopInstructionBytes(
+      const void* pointer,
+      const std::size_t size,
+      const disasm::BoundaryIndex* index = nullptr);
+  } // namespace rwe
+} // namespace llmo
+
+#endif // LLMO_NOP_HPP
@@ -0,0 +1,121 @@
+#ifndef LLMO_PATCH_HPP
+#define LLMO_PATCH_HPP
+
+#include <cstddef> // std::size_t
+#include <cstdint> // std::uintptr_t, std::uint8_t
+#include <map> // std::map
+#include <string> // std::string
+#include <unordered_map> // std::unordered_map
+#include <vector> // std::vector
+
+#include "rwe.hpp"
+
+namespace llmo
+{
+  namespace rwe
+  {
+    // Named byte patches which can be turned on and off.
+    // Patches can't overlap each other or created hooks.
+    // Throws rwe::Exception.
+    class PatchSet
+    {
+    public:
+      // Index of the patch, stays valid until the patch is removed.
+      // Handles of removed patches are given to later ones.
+      using Handle = std::size_t;
+
+      PatchSet() = default;
+
+      PatchSet(const PatchSet&) = delete;
+      PatchSet& operator=(const PatchSet&) = delete;
+
+      // Restores original bytes of the enabled patches.
+      ~PatchSet();
+
+      // Registers patch, but doesn't enable.
+      // If original is nullptr, current bytes are saved as original.
+      // Throws kPatchAlreadyRegistered if the name is taken,
+      // kPatchOverlaps or kHookOverlaps if the range is patched already.
+      Handle Register(
+        const std::string& name,
+        const std::uintptr_t address,
+        const void* replacement,
+        const void* original,
+        const std::size_t size);
+
+      Handle Register(
+        const std::string& name,
+        const void* pointer,
+        const void* replacement,
+        const void* original,
+        const std::size_t size)
+      {
+        return Register(name, reinterpret_cast<std::uintptr_t>(pointer),
+          replacement, original, size);
+      }
+
+      // Disables patch and forgets it, its bytes are reused by the next
+      // registered patch which fits in them.
+      void Remove(const Handle handle);
+
+      // Returns handle of the patch with such name.
+      // Throws kPatchIsNotRegistered if there is none.
+      Handle Find(const std::string& name) const;
+
+      // Writes replacement bytes.
+      void Enable(const Handle handle);
+
+      // Writes original bytes.
+      void Disable(const Handle handle);
+
+      void Toggle(const Handle handle);
+
+      bool isEnabled(const Handle handle) const;
+
+      // Queues patch to be enabled by ApplyQueued.
+      void QueueEnable(const Handle handle);
+
+      // Queues patch to be disabled by ApplyQueued.
+      void QueueDisable(const Handle handle);
+
+      // Applies queued changes in address order. Patches which share pages
+      // are unprotected together, so every page changes protection once.
+      void ApplyQueued();
+
+    private:
+      struct Patch
+      {
+        std::uintptr_t address;
+        std::size_t size;
+        std::size_t bytes; // Offset of replacement, original follows it.
+        std::size_t capacity; // Largest size which fits at bytes.
+        std::string name;
+
+        bool isRegistered;
+        bool isEnabled;
+        bool isQueued;
+        bool queueEnable;
+      };
+
+      Patch& getPatch(const Handle handle);
+      const Patch& getPatch(const Handle handle) const;
+
+      void queue(const Handle handle, const bool enable);
+
+      const std::uint8_t* getBytes(const Patch& patch, const bool enable) const {
+        return &m_bytes[patch.bytes + (enable ? 0u : patch.size)];
+      }
+
+      std::vector<Patch> m_patches{};
+      std::vector<std::uint8_t> m_bytes{};
+      std::vector<Handle> m_queued{};
+      std::vector<Handle> m_freeHandles{};
+
+      // Patches sorted by address, for overlap checks.
+      std::map<std::uintptr_t, Handle> m_index{};
+      std::unordered_map<std::string, Handle> m_names{};
+    };
+  } // namespace rwe
+} // namespace llmo
+
+#endif // LLMO_PATCH_HPP
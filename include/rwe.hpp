@@ -12,12 +12,21 @@
 #include <cstdint> // std::uintptr_t
 #include <cstring> // std::memcpy, std::memset
 
+#include <xmmintrin.h> // _mm_prefetch
+
 #include <windows.h> // VirtualProtect
 
 #include "detail.hpp" // return_type
 
 namespace llmo
 {
+  namespace detail
+  {
+    // Appends original bytes of the range to the active rwe::Journal, if any.
+    // Should be called when the range is already unprotected.
+    void journalRange(const std::uintptr_t address, const std::size_t size);
+  } // namespace detail
+
   // Read, write, execute.
   namespace rwe
   {
@@ -51,6 +60,12 @@ namespace llmo
           kRegionIsNotAvailable,
           kSizeIsZero,
           kVirtualProtectFailed,
+          kPatchOverlaps,
+          kHookOverlaps,
+          kPatchAlreadyRegistered,
+          kPatchIsNotRegistered,
+          kAllocationFailed,
+          kInvalidInstruction,
         };
 
         Exception(const std::uintptr_t address, const Code code) :
@@ -93,6 +108,14 @@ namespace llmo
       const std::uintptr_t address, 
       const std::size_t size);
 
+    // Calls FlushProcessWriteBuffers, which interrupts every processor
+    // running a thread of the process. The interrupt drains its store
+    // buffer and serializes its instruction stream. Costs microseconds,
+    // unlike suspending the threads. Called where code which other threads
+    // may be running is written: the assembler, jump and dispatch slots,
+    // patch sets and bundles. Plain reads and writes don't call it.
+    void synchronizeProcessors();
+
     // Calls VirtualQuery and returns true if mbi.State is MEM_COMMIT.
     // It's necessary to call always when you're going to work with the memory.
     bool isRegionAvailable(const std::uintptr_t address);
@@ -106,6 +129,73 @@ namespace llmo
       const MemoryProtection next,
       MemoryProtection& previous);
 
+    // Unprotects pages for a sequence of writes, consecutive ranges
+    // which lie on already unprotected pages share one protection change.
+    // Restores protection and flushes instruction cache in destructor.
+    class BatchedProtectionRemover
+    {
+    public:
+      BatchedProtectionRemover() = default;
+
+      BatchedProtectionRemover(const BatchedProtectionRemover&) = delete;
+      BatchedProtectionRemover& operator=(const BatchedProtectionRemover&) = delete;
+
+      ~BatchedProtectionRemover() {
+        Restore();
+      }
+
+      // Makes the range writable. Unprotects its pages if the current
+      // ones don't cover it, restoring the previous pages first.
+      // Throws rwe::Exception like ScopedProtectionRemover.
+      void Unprotect(const std::uintptr_t address, const std::size_t size);
+
+      // Restores protection of the current pages, if any.
+      void Restore();
+
+    private:
+      std::uintptr_t m_begin{};
+      std::uintptr_t m_end{};
+
+      MemoryProtection m_protectionLevel{
+        MemoryProtection::kPageExecuteReadWrite};
+    };
+
+    // Returns count of bytes which can be read from the address without a fault,
+    // but no more than size. Walks VirtualQuery regions and stops at the first
+    // one which is not committed, guarded or not readable.
+    std::size_t getReadableSize(
+      const std::uintptr_t address,
+      const std::size_t size);
+
+    // Copies null-terminated string from the address to the buffer.
+    // Copies no more than maxLen - 1 characters, never reads past the end
+    // of readable memory and always terminates the buffer.
+    // Returns length of the copied string, doesn't allocate.
+    std::size_t ReadString(
+      const std::uintptr_t address,
+      char* buffer,
+      const std::size_t maxLen);
+
+    // Wide-character variant of ReadString.
+    std::size_t ReadString(
+      const std::uintptr_t address,
+      wchar_t* buffer,
+      const std::size_t maxLen);
+
+    // Compares memory at the address with the bytes 16 bytes at a time.
+    // Returns false if they differ or the memory isn't readable.
+    bool isEqual(
+      const std::uintptr_t address,
+      const void* bytes,
+      const std::size_t size);
+
+    // Gets bounds of the readable region which contains the address.
+    // Returns false if the address isn't readable.
+    bool getReadableRegion(
+      const std::uintptr_t address,
+      std::uintptr_t& begin,
+      std::uintptr_t& end);
+
     // Reads value from the address and returns it.
     // Absolutely safe, but be accurate to typename T.
     template <typename T>
@@ -127,6 +217,7 @@ namespace llmo
     void Write(const std::uintptr_t address, const T in)
     {
       ScopedProtectionRemover instance{address, sizeof(in)};
+      detail::journalRange(address, sizeof(in));
       std::memcpy(reinterpret_cast<void*>(address), &in, sizeof(in));
       flushInstructionCache(address, sizeof(in));
     }
@@ -138,6 +229,7 @@ namespace llmo
       const std::size_t size);
 
     // Absolutely safe alternative for std::memset with nop opcode [ 0x90 ].
+    // May split instructions, rwe::NopInstructions (nop.hpp) doesn't.
     void Nop(
       const std::uintptr_t address,
       const std::size_t size);
@@ -150,6 +242,7 @@ namespace llmo
       const std::size_t size)
     {
       ScopedProtectionRemover instance{address, size};
+      detail::journalRange(address, size);
       std::memcpy(reinterpret_cast<void*>(address), source, size);
       flushInstructionCache(address, size);
     }
@@ -162,6 +255,77 @@ namespace llmo
       return reinterpret_cast<T>(address)(std::forward<Args>(args) ...);
     }
 
+    // Describes a field for Gather: offset from the object base and type.
+    template <std::size_t Offset, typename T>
+    struct Field
+    {
+      using type = T;
+
+      static constexpr std::size_t offset = Offset;
+      static constexpr std::size_t end = Offset + sizeof(T);
+    };
+
+    // Reads the same fields from many objects in one call.
+    // Fields is a list of rwe::Field, outputs are arrays of count elements,
+    // one per field in the same order (structure of arrays).
+    // Objects ahead are prefetched, readability is checked once per region
+    // instead of once per field. Fields of null or unreadable objects are
+    // value-initialized. Returns count of objects which were read.
+    template <class... Fields>
+    std::size_t Gather(
+      const std::uintptr_t* bases,
+      const std::size_t count,
+      typename Fields::type* ... outputs)
+    {
+      using Span = detail::fields_span<Fields...>;
+      using Swallow = int[];
+
+      constexpr std::size_t kPrefetchDistance{8u};
+
+      std::uintptr_t regionBegin{0u};
+      std::uintptr_t regionEnd{0u};
+      std::size_t gathered{0u};
+
+      for (std::size_t i{0u}; i < count; ++i)
+      {
+        if (i + kPrefetchDistance < count)
+        {
+          _mm_prefetch(reinterpret_cast<const char*>(
+            bases[i + kPrefetchDistance] + Span::begin), _MM_HINT_T0);
+        }
+
+        const std::uintptr_t base{bases[i]};
+        const std::uintptr_t begin{base + Span::begin};
+        const std::uintptr_t end{base + Span::end};
+
+        bool isReadable{0u != base};
+
+        if (isReadable && (begin < regionBegin || end > regionEnd))
+        {
+          isReadable = getReadableRegion(begin, regionBegin, regionEnd);
+
+          // The object lies across several regions, check it separately.
+          if (isReadable && end > regionEnd) {
+            isReadable = getReadableSize(begin, end - begin) == end - begin;
+          }
+        }
+
+        if (isReadable)
+        {
+          (void)Swallow{0, (std::memcpy(&outputs[i],
+            reinterpret_cast<const void*>(base + Fields::offset),
+            sizeof(typename Fields::type)), 0) ...};
+
+          ++gathered;
+        }
+        else {
+          (void)Swallow{0, (outputs[i] = typename Fields::type{}, 0) ...};
+        }
+      }
+
+      return gathered;
+    }
+
     // overloads with void* instead of std::uintptr_t as address
 
     template <typename T>
@@ -181,6 +345,16 @@ namespace llmo
 
     void Nop(const void* pointer, const std::size_t size);
 
+    std::size_t ReadString(
+      const void* pointer,
+      char* buffer,
+      const std::size_t maxLen);
+
+    std::size_t ReadString(
+      const void* pointer,
+      wchar_t* buffer,
+      const std::size_t maxLen);
+
     template <typename T>
     void Copy(const void* address, const T source, const std::size_t size) {
       Copy(reinterpret_cast<std::uintptr_t>(address), source, size);
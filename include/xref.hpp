@@ -0,0 +1,107 @@
+#ifndef LLMO_XREF_HPP
+#define LLMO_XREF_HPP
+
+#include <cstddef> // std::size_t
+#include <cstdint> // std::uintptr_t, std::uint8_t
+#include <vector> // std::vector
+
+#include "boundary.hpp"
+
+namespace llmo
+{
+  // Cross-references of code in executable sections of a module.
+  namespace xref
+  {
+    enum class Kind : std::uint8_t
+    {
+      kCall, // E8 rel32.
+      kJump, // E9 rel32.
+      kConditionalJump, // 0F 80 - 0F 8F rel32.
+      kRipRelative, // [ rip + disp32 ] operand, x64 only.
+      kAbsolute, // Immediate or displacement holding the address, see LiteralIndex.
+      kImmediate, // Immediate of 4 or 8 bytes holding the value, see LiteralIndex.
+    };
+
+    struct Reference
+    {
+      std::uintptr_t source; // Address of the instruction.
+      std::uintptr_t target;
+      Kind kind;
+      std::uint8_t length; // Of the instruction.
+    };
+
+    // Consecutive references of the index.
+    class References
+    {
+    public:
+      References(const Reference* first, const Reference* last) :
+        m_first(first), m_last(last) {}
+
+      const Reference* begin() const {
+        return m_first;
+      }
+
+      const Reference* end() const {
+        return m_last;
+      }
+
+      std::size_t size() const {
+        return static_cast<std::size_t>(m_last - m_first);
+      }
+
+      bool empty() const {
+        return m_first == m_last;
+      }
+
+    private:
+      const Reference* m_first;
+      const Reference* m_last;
+    };
+
+    // Every direct call, jmp and jcc with rel32 and, on x64, every
+    // RIP-relative operand in executable sections, sorted by target,
+    // so queries are binary searches. Sections are scanned 16 bytes at a time
+    // for opcode and ModRM candidates, each is confirmed by decoding the
+    // instruction which contains it, taken from the boundary index.
+    // Immutable after the build, queries are thread-safe.
+    class Index
+    {
+    public:
+      Index() = default;
+
+      // Builds the boundary index of the module if none is given.
+      // Throws disasm::Exception like disasm::BoundaryIndex.
+      explicit Index(
+        const std::uintptr_t module,
+        const disasm::BoundaryIndex* boundaries = nullptr);
+
+      explicit Index(
+        const void* module,
+        const disasm::BoundaryIndex* boundaries = nullptr) :
+        Index(reinterpret_cast<std::uintptr_t>(module), boundaries) {}
+
+      // References whose target is the address.
+      References getReferencesTo(const std::uintptr_t target) const;
+
+      // References whose target is in [ begin, end ).
+      References getReferencesTo(
+        const std::uintptr_t begin,
+        const std::uintptr_t end) const;
+
+      // Addresses of calls to the target.
+      std::vector<std::uintptr_t> getCallers(const std::uintptr_t target) const;
+
+      // Returns true if some call, jmp or jcc goes to the address.
+      bool isBranchTarget(const std::uintptr_t address) const;
+
+      const std::vector<Reference>& getReferences() const {
+        return m_references;
+      }
+
+    private:
+      std::vector<Reference> m_references{};
+    };
+  } // namespace xref
+} // namespace llmo
+
+#endif // LLMO_XREF_HPP
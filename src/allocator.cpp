@@ -0,0 +1,335 @@
+#include "../include/allocator.hpp"
+
+#include "../third-party/minhook/src/buffer.h" // FindPrevFreeRegion
+
+namespace llmo {
+namespace rwe {
+
+namespace {
+
+constexpr std::size_t kPageSize{4096u};
+
+// Size of the smallest class, also alignment of all chunks.
+constexpr std::size_t kMinChunkSize{16u};
+
+#if defined(_M_X64) || defined(__x86_64__)
+// Max range for seeking a slab, same as MAX_MEMORY_RANGE in buffer.c.
+constexpr std::uintptr_t kMaxMemoryRange{0x40000000u};
+#endif
+
+// Slabs take exactly one allocation granularity, so every slab
+// and large chunk starts at a granularity boundary.
+std::size_t getGranularity()
+{
+  static const std::size_t granularity{[]()
+  {
+    ::SYSTEM_INFO si{};
+    ::GetSystemInfo(&si);
+    return static_cast<std::size_t>(si.dwAllocationGranularity);
+  }()};
+
+  return granularity;
+}
+
+} // namespace
+
+constexpr std::size_t NearAllocator::kMaxChunkSize;
+constexpr std::size_t NearAllocator::kClassCount;
+
+NearAllocator::~NearAllocator()
+{
+  for (const auto& slab : m_slabs) {
+    release(slab.second);
+  }
+}
+
+void* NearAllocator::Allocate(
+  const std::uintptr_t origin,
+  const std::size_t size,
+  const Kind kind)
+{
+  if (0u == size) {
+    throw Exception{origin, Code::kSizeIsZero};
+  }
+
+  std::lock_guard<std::mutex> lock{m_mutex};
+
+  if (size > kMaxChunkSize)
+  {
+    const std::size_t pages{(size + kPageSize - 1u) & ~(kPageSize - 1u)};
+
+    std::uintptr_t writable{0u};
+    const std::uintptr_t base{allocateNear(origin, pages, kind, writable)};
+
+    if (0u == base) {
+      throw Exception{origin, Code::kAllocationFailed};
+    }
+
+    m_slabs.emplace(base, Slab{base, writable, pages, 0u, pages, 1u, nullptr, kind});
+    return reinterpret_cast<void*>(base);
+  }
+
+  const std::size_t sizeClass{getClass(size)};
+  std::vector<std::uintptr_t>& partial{
+    m_partial[static_cast<std::size_t>(kind)][sizeClass]};
+
+  // The most recent slabs are the most likely to be near.
+  for (std::size_t i{partial.size()}; i-- > 0u;)
+  {
+    Slab& slab{m_slabs.find(partial[i])->second};
+
+    if (isReachable(origin, slab))
+    {
+      void* chunk{allocateChunk(slab)};
+
+      if (nullptr == slab.free && slab.bump + slab.chunkSize > slab.size)
+      {
+        partial[i] = partial.back();
+        partial.pop_back();
+      }
+
+      return chunk;
+    }
+  }
+
+  std::uintptr_t writable{0u};
+  const std::uintptr_t base{allocateNear(origin, getGranularity(), kind, writable)};
+
+  if (0u == base) {
+    throw Exception{origin, Code::kAllocationFailed};
+  }
+
+  Slab& slab{m_slabs.emplace(base, Slab{base, writable, getGranularity(),
+    kMinChunkSize << sizeClass, 0u, 0u, nullptr, kind}).first->second};
+
+  partial.push_back(base);
+
+  return allocateChunk(slab);
+}
+
+void NearAllocator::Free(void* pointer)
+{
+  if (nullptr == pointer) {
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock{m_mutex};
+
+  const std::uintptr_t base{
+    reinterpret_cast<std::uintptr_t>(pointer) & ~(getGranularity() - 1u)};
+
+  const auto found = m_slabs.find(base);
+
+  if (found == m_slabs.end()) {
+    return;
+  }
+
+  Slab& slab{found->second};
+
+  if (0u != slab.chunkSize)
+  {
+    std::vector<std::uintptr_t>& partial{m_partial
+      [static_cast<std::size_t>(slab.kind)][getClass(slab.chunkSize)]};
+
+    const bool wasFull{
+      nullptr == slab.free && slab.bump + slab.chunkSize > slab.size};
+
+    *getLink(slab, pointer) = slab.free;
+    slab.free = pointer;
+    --slab.used;
+
+    if (0u != slab.used)
+    {
+      if (wasFull) {
+        partial.push_back(base);
+      }
+
+      return;
+    }
+
+    for (std::size_t i{0u}; i < partial.size(); ++i)
+    {
+      if (partial[i] == base)
+      {
+        partial[i] = partial.back();
+        partial.pop_back();
+        break;
+      }
+    }
+  }
+
+  release(slab);
+  m_slabs.erase(found);
+}
+
+void* NearAllocator::getWritable(const void* pointer)
+{
+  std::lock_guard<std::mutex> lock{m_mutex};
+
+  const std::uintptr_t base{
+    reinterpret_cast<std::uintptr_t>(pointer) & ~(getGranularity() - 1u)};
+
+  const auto found = m_slabs.find(base);
+
+  if (found == m_slabs.end()) {
+    return nullptr;
+  }
+
+  return getLink(found->second, pointer);
+}
+
+std::size_t NearAllocator::getClass(const std::size_t size)
+{
+  std::size_t sizeClass{0u};
+
+  while ((kMinChunkSize << sizeClass) < size) {
+    ++sizeClass;
+  }
+
+  return sizeClass;
+}
+
+std::uintptr_t NearAllocator::allocateNear(
+  const std::uintptr_t origin,
+  const std::size_t size,
+  const Kind kind,
+  std::uintptr_t& writable)
+{
+#if defined(_M_X64) || defined(__x86_64__)
+  ::SYSTEM_INFO si{};
+  ::GetSystemInfo(&si);
+
+  std::uintptr_t minAddr{reinterpret_cast<std::uintptr_t>(si.lpMinimumApplicationAddress)};
+  std::uintptr_t maxAddr{reinterpret_cast<std::uintptr_t>(si.lpMaximumApplicationAddress)};
+
+  if (origin > kMaxMemoryRange && minAddr < origin - kMaxMemoryRange) {
+    minAddr = origin - kMaxMemoryRange;
+  }
+
+  if (maxAddr > origin + kMaxMemoryRange) {
+    maxAddr = origin + kMaxMemoryRange;
+  }
+
+  // Make room for the whole allocation.
+  maxAddr -= size - 1u;
+
+  ::LPVOID pAlloc{reinterpret_cast<::LPVOID>(origin)};
+
+  while (reinterpret_cast<std::uintptr_t>(pAlloc) >= minAddr)
+  {
+    pAlloc = ::FindPrevFreeRegion(pAlloc,
+      reinterpret_cast<::LPVOID>(minAddr), si.dwAllocationGranularity);
+
+    if (nullptr == pAlloc) {
+      break;
+    }
+
+    const std::uintptr_t base{allocateAt(
+      reinterpret_cast<std::uintptr_t>(pAlloc), size, kind, writable)};
+
+    if (0u != base) {
+      return base;
+    }
+  }
+
+  pAlloc = reinterpret_cast<::LPVOID>(origin);
+
+  while (reinterpret_cast<std::uintptr_t>(pAlloc) <= maxAddr)
+  {
+    pAlloc = ::FindNextFreeRegion(pAlloc,
+      reinterpret_cast<::LPVOID>(maxAddr), si.dwAllocationGranularity);
+
+    if (nullptr == pAlloc) {
+      break;
+    }
+
+    const std::uintptr_t base{allocateAt(
+      reinterpret_cast<std::uintptr_t>(pAlloc), size, kind, writable)};
+
+    if (0u != base) {
+      return base;
+    }
+  }
+
+  return 0u;
+#else
+  // In x86 mode, a chunk can be placed anywhere.
+  static_cast<void>(origin);
+
+  return allocateAt(0u, size, kind, writable);
+#endif
+}
+
+std::uintptr_t NearAllocator::allocateAt(
+  const std::uintptr_t address,
+  const std::size_t size,
+  const Kind kind,
+  std::uintptr_t& writable)
+{
+  ::LPVOID pAddress{reinterpret_cast<::LPVOID>(address)};
+
+  if (Kind::kDualMapped == kind)
+  {
+    ::LPVOID pWritable{nullptr};
+    const ::LPVOID pExecutable{::MapDualView(pAddress, size, &pWritable)};
+
+    writable = reinterpret_cast<std::uintptr_t>(pWritable);
+    return reinterpret_cast<std::uintptr_t>(pExecutable);
+  }
+
+  const ::DWORD protection{static_cast<::DWORD>(
+    Kind::kCode == kind ? PAGE_EXECUTE_READWRITE : PAGE_READWRITE)};
+
+  writable = reinterpret_cast<std::uintptr_t>(
+    ::VirtualAlloc(pAddress, size, MEM_COMMIT | MEM_RESERVE, protection));
+
+  return writable;
+}
+
+void NearAllocator::release(const Slab& slab)
+{
+  if (Kind::kDualMapped == slab.kind)
+  {
+    ::UnmapViewOfFile(reinterpret_cast<::LPCVOID>(slab.base));
+    ::UnmapViewOfFile(reinterpret_cast<::LPCVOID>(slab.writable));
+  }
+  else {
+    ::VirtualFree(reinterpret_cast<::LPVOID>(slab.base), 0u, MEM_RELEASE);
+  }
+}
+
+bool NearAllocator::isReachable(const std::uintptr_t origin, const Slab& slab)
+{
+#if defined(_M_X64) || defined(__x86_64__)
+  const std::uintptr_t minAddr{origin > kMaxMemoryRange ? origin - kMaxMemoryRange : 0u};
+
+  return slab.base >= minAddr
+    && slab.base + slab.size <= origin + kMaxMemoryRange;
+#else
+  static_cast<void>(origin);
+  static_cast<void>(slab);
+
+  return true;
+#endif
+}
+
+void* NearAllocator::allocateChunk(Slab& slab)
+{
+  void* chunk{slab.free};
+
+  if (nullptr != chunk) {
+    slab.free = *getLink(slab, chunk);
+  }
+  else
+  {
+    chunk = reinterpret_cast<void*>(slab.base + slab.bump);
+    slab.bump += slab.chunkSize;
+  }
+
+  ++slab.used;
+
+  return chunk;
+}
+
+} // namespace rwe
+} // namespace llmo
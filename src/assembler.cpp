@@ -0,0 +1,512 @@
+#include "../include/assembler.hpp"
+
+namespace llmo {
+namespace assembler {
+
+namespace {
+
+#if defined(_M_X64) || defined(__x86_64__)
+constexpr bool kIs64Bit{true};
+
+// Max distance from the origin NearAllocator places chunks at,
+// targets closer than it are reachable by rel32 from the whole range.
+constexpr std::uintptr_t kMaxMemoryRange{0x40000000u};
+#else
+constexpr bool kIs64Bit{false};
+#endif
+
+// Intel's recommended nops from 1 to 9 bytes.
+constexpr std::size_t kMaxNopSize{9u};
+
+const std::uint8_t kNops[kMaxNopSize][kMaxNopSize]{
+  {0x90},
+  {0x66, 0x90},
+  {0x0F, 0x1F, 0x00},
+  {0x0F, 0x1F, 0x40, 0x00},
+  {0x0F, 0x1F, 0x44, 0x00, 0x00},
+  {0x66, 0x0F, 0x1F, 0x44, 0x00, 0x00},
+  {0x0F, 0x1F, 0x80, 0x00, 0x00, 0x00, 0x00},
+  {0x0F, 0x1F, 0x84, 0x00, 0x00, 0x00, 0x00, 0x00},
+  {0x66, 0x0F, 0x1F, 0x84, 0x00, 0x00, 0x00, 0x00, 0x00},
+};
+
+bool isInt8(const std::intptr_t value)
+{
+  return value >= -128 && value <= 127;
+}
+
+} // namespace
+
+constexpr std::size_t Assembler::kUnbound;
+
+Label Assembler::NewLabel()
+{
+  m_labels.push_back(kUnbound);
+  return Label{m_labels.size() - 1u};
+}
+
+void Assembler::Bind(const Label label)
+{
+  if (label.id >= m_labels.size()) {
+    throw Exception{Code::kInvalidLabel};
+  }
+
+  if (kUnbound != m_labels[label.id]) {
+    throw Exception{Code::kLabelAlreadyBound};
+  }
+
+  m_labels[label.id] = m_code.size();
+}
+
+void Assembler::Mov(const Register destination, const Register source)
+{
+  const std::uint8_t dst{getIndex(destination)};
+  const std::uint8_t src{getIndex(source)};
+
+  emitRex(src, dst, true);
+  emitByte(0x89);
+  emitByte(static_cast<std::uint8_t>(0xC0 | (src & 7u) << 3 | (dst & 7u)));
+}
+
+void Assembler::Mov(const Register destination, const std::uintptr_t immediate)
+{
+  const std::uint8_t dst{getIndex(destination)};
+
+  // mov r32, imm32 zero-extends on x64.
+  if (!kIs64Bit || immediate <= 0xFFFFFFFFu)
+  {
+    emitRex(0u, dst, false);
+    emitByte(static_cast<std::uint8_t>(0xB8 + (dst & 7u)));
+
+    const std::uint32_t value{static_cast<std::uint32_t>(immediate)};
+    emitValue(&value, sizeof(value));
+    return;
+  }
+
+  const std::intptr_t value{static_cast<std::intptr_t>(immediate)};
+
+  // mov r64, imm32 sign-extends.
+  if (value < 0 && value >= INT32_MIN)
+  {
+    emitRex(0u, dst, true);
+    emitByte(0xC7);
+    emitByte(static_cast<std::uint8_t>(0xC0 | (dst & 7u)));
+
+    const std::int32_t value32{static_cast<std::int32_t>(value)};
+    emitValue(&value32, sizeof(value32));
+    return;
+  }
+
+  emitRex(0u, dst, true);
+  emitByte(static_cast<std::uint8_t>(0xB8 + (dst & 7u)));
+  emitValue(&immediate, sizeof(immediate));
+}
+
+void Assembler::Mov(const Register destination, const Memory source)
+{
+  const std::uint8_t dst{getIndex(destination)};
+
+  emitRex(dst, getIndex(source.base), true);
+  emitByte(0x8B);
+  emitMemory(dst, source);
+}
+
+void Assembler::Mov(const Memory destination, const Register source)
+{
+  const std::uint8_t src{getIndex(source)};
+
+  emitRex(src, getIndex(destination.base), true);
+  emitByte(0x89);
+  emitMemory(src, destination);
+}
+
+void Assembler::Lea(const Register destination, const Memory source)
+{
+  const std::uint8_t dst{getIndex(destination)};
+
+  emitRex(dst, getIndex(source.base), true);
+  emitByte(0x8D);
+  emitMemory(dst, source);
+}
+
+void Assembler::Lea(const Register destination, const Label label)
+{
+  const std::uint8_t dst{getIndex(destination)};
+
+  // mod 00, rm 101 is [ rip + disp32 ] on x64 and [ disp32 ] on x86.
+  emitRex(dst, 0u, true);
+  emitByte(0x8D);
+  emitByte(static_cast<std::uint8_t>(0x05 | (dst & 7u) << 3));
+  addFixup(kIs64Bit ? FixupKind::kRel32 : FixupKind::kAbsolute32, label.id);
+}
+
+void Assembler::Push(const Register source)
+{
+  const std::uint8_t src{getIndex(source)};
+
+  emitRex(0u, src, false);
+  emitByte(static_cast<std::uint8_t>(0x50 + (src & 7u)));
+}
+
+void Assembler::Push(const std::int32_t immediate)
+{
+  if (isInt8(immediate))
+  {
+    emitByte(0x6A);
+    emitByte(static_cast<std::uint8_t>(immediate));
+    return;
+  }
+
+  emitByte(0x68);
+  emitValue(&immediate, sizeof(immediate));
+}
+
+void Assembler::Pop(const Register destination)
+{
+  const std::uint8_t dst{getIndex(destination)};
+
+  emitRex(0u, dst, false);
+  emitByte(static_cast<std::uint8_t>(0x58 + (dst & 7u)));
+}
+
+void Assembler::Call(const Register target)
+{
+  const std::uint8_t index{getIndex(target)};
+
+  emitRex(0u, index, false);
+  emitByte(0xFF);
+  emitByte(static_cast<std::uint8_t>(0xD0 | (index & 7u)));
+}
+
+void Assembler::Call(const std::uintptr_t target)
+{
+  if (isNear(target))
+  {
+    emitByte(0xE8);
+    addFixup(FixupKind::kTarget32, target);
+    return;
+  }
+
+  // CALL_ABS: call [ rip + 2 ], jmp +8, dq target.
+  const std::uint8_t code[]{0xFF, 0x15, 0x02, 0x00, 0x00, 0x00, 0xEB, 0x08};
+
+  Bytes(code, sizeof(code));
+  emitValue(&target, sizeof(target));
+}
+
+void Assembler::Call(const Label label)
+{
+  emitByte(0xE8);
+  addFixup(FixupKind::kRel32, label.id);
+}
+
+void Assembler::Jmp(const Register target)
+{
+  const std::uint8_t index{getIndex(target)};
+
+  emitRex(0u, index, false);
+  emitByte(0xFF);
+  emitByte(static_cast<std::uint8_t>(0xE0 | (index & 7u)));
+}
+
+void Assembler::Jmp(const std::uintptr_t target)
+{
+  if (isNear(target))
+  {
+    emitByte(0xE9);
+    addFixup(FixupKind::kTarget32, target);
+    return;
+  }
+
+  // JMP_ABS: jmp [ rip ], dq target.
+  const std::uint8_t code[]{0xFF, 0x25, 0x00, 0x00, 0x00, 0x00};
+
+  Bytes(code, sizeof(code));
+  emitValue(&target, sizeof(target));
+}
+
+void Assembler::Jmp(const Label label)
+{
+  const std::uint8_t nearOpcode[]{0xE9};
+
+  emitLabelBranch(0xEB, nearOpcode, sizeof(nearOpcode), label);
+}
+
+void Assembler::Jcc(const Condition condition, const std::uintptr_t target)
+{
+  const std::uint8_t cc{static_cast<std::uint8_t>(condition)};
+
+  if (isNear(target))
+  {
+    emitByte(0x0F);
+    emitByte(static_cast<std::uint8_t>(0x80 | cc));
+    addFixup(FixupKind::kTarget32, target);
+    return;
+  }
+
+  // JCC_ABS: inverted jcc over jmp [ rip ], dq target.
+  const std::uint8_t code[]{static_cast<std::uint8_t>(0x70 | (cc ^ 1u)), 0x0E,
+    0xFF, 0x25, 0x00, 0x00, 0x00, 0x00};
+
+  Bytes(code, sizeof(code));
+  emitValue(&target, sizeof(target));
+}
+
+void Assembler::Jcc(const Condition condition, const Label label)
+{
+  const std::uint8_t cc{static_cast<std::uint8_t>(condition)};
+  const std::uint8_t nearOpcode[]{0x0F, static_cast<std::uint8_t>(0x80 | cc)};
+
+  emitLabelBranch(static_cast<std::uint8_t>(0x70 | cc),
+    nearOpcode, sizeof(nearOpcode), label);
+}
+
+void Assembler::Ret()
+{
+  emitByte(0xC3);
+}
+
+void Assembler::Ret(const std::uint16_t bytes)
+{
+  emitByte(0xC2);
+  emitValue(&bytes, sizeof(bytes));
+}
+
+void Assembler::Int3()
+{
+  emitByte(0xCC);
+}
+
+void Assembler::Nop(const std::size_t size)
+{
+  const std::size_t offset{m_code.size()};
+
+  m_code.resize(offset + size);
+  WriteNops(m_code.data() + offset, size);
+}
+
+void Assembler::Align(const std::size_t alignment)
+{
+  if (0u == alignment || 0u != (alignment & (alignment - 1u))) {
+    throw Exception{Code::kInvalidOperand};
+  }
+
+  while (0u != (m_code.size() & (alignment - 1u))) {
+    Int3();
+  }
+}
+
+void Assembler::Bytes(const void* data, const std::size_t size)
+{
+  const std::uint8_t* bytes{static_cast<const std::uint8_t*>(data)};
+  m_code.insert(m_code.end(), bytes, bytes + size);
+}
+
+void Assembler::Emit(const std::uintptr_t address, void* writable) const
+{
+  std::vector<std::uint8_t> code{m_code};
+
+  for (const Fixup& fixup : m_fixups)
+  {
+    const std::uintptr_t next{address + fixup.offset + 4u};
+    std::uint32_t field{0u};
+
+    switch (fixup.kind)
+    {
+    case FixupKind::kRel32:
+      field = static_cast<std::uint32_t>(address + getLabel(Label{fixup.value}) - next);
+      break;
+
+    case FixupKind::kAbsolute32:
+      field = static_cast<std::uint32_t>(address + getLabel(Label{fixup.value}));
+      break;
+
+    case FixupKind::kTarget32:
+    {
+#if defined(_M_X64) || defined(__x86_64__)
+      const std::intptr_t distance{static_cast<std::intptr_t>(fixup.value - next)};
+
+      if (distance < INT32_MIN || distance > INT32_MAX) {
+        throw Exception{fixup.value, Code::kOutOfRange};
+      }
+#endif
+
+      field = static_cast<std::uint32_t>(fixup.value - next);
+      break;
+    }
+    }
+
+    std::memcpy(code.data() + fixup.offset, &field, sizeof(field));
+  }
+
+  std::memcpy(nullptr != writable ? writable : reinterpret_cast<void*>(address),
+    code.data(), code.size());
+}
+
+void* Assembler::Emit(
+  rwe::NearAllocator& allocator,
+  const rwe::NearAllocator::Kind kind) const
+{
+  const std::size_t size{0u != m_code.size() ? m_code.size() : 1u};
+  void* pointer{allocator.Allocate(m_origin, size, kind)};
+
+  try {
+    Emit(reinterpret_cast<std::uintptr_t>(pointer), allocator.getWritable(pointer));
+  }
+  catch (...)
+  {
+    allocator.Free(pointer);
+    throw;
+  }
+
+  rwe::flushInstructionCache(reinterpret_cast<std::uintptr_t>(pointer), size);
+  rwe::synchronizeProcessors();
+
+  return pointer;
+}
+
+void Assembler::WriteNops(std::uint8_t* destination, std::size_t size)
+{
+  while (0u != size)
+  {
+    const std::size_t nopSize{size < kMaxNopSize ? size : kMaxNopSize};
+
+    std::memcpy(destination, kNops[nopSize - 1u], nopSize);
+    destination += nopSize;
+    size -= nopSize;
+  }
+}
+
+std::uint8_t Assembler::getIndex(const Register reg)
+{
+  const std::uint8_t index{static_cast<std::uint8_t>(reg)};
+
+  if (!kIs64Bit && index >= 8u) {
+    throw Exception{Code::kInvalidOperand};
+  }
+
+  return index;
+}
+
+bool Assembler::isNear(const std::uintptr_t target) const
+{
+#if defined(_M_X64) || defined(__x86_64__)
+  if (0u == m_origin) {
+    return false;
+  }
+
+  const std::uintptr_t distance{
+    target > m_origin ? target - m_origin : m_origin - target};
+
+  return distance < kMaxMemoryRange;
+#else
+  // In x86 mode, everything is reachable.
+  static_cast<void>(target);
+
+  return true;
+#endif
+}
+
+void Assembler::emitValue(const void* value, const std::size_t size)
+{
+  Bytes(value, size);
+}
+
+void Assembler::emitRex(
+  const std::uint8_t reg,
+  const std::uint8_t base,
+  const bool wide)
+{
+  if (!kIs64Bit) {
+    return;
+  }
+
+  const std::uint8_t rex{static_cast<std::uint8_t>(0x40
+    | (wide ? 0x08 : 0x00) | (reg & 8u ? 0x04 : 0x00) | (base & 8u ? 0x01 : 0x00))};
+
+  if (0x40 != rex) {
+    emitByte(rex);
+  }
+}
+
+void Assembler::emitMemory(const std::uint8_t reg, const Memory memory)
+{
+  const std::uint8_t base{static_cast<std::uint8_t>(getIndex(memory.base) & 7u)};
+  std::uint8_t mod{0x80};
+
+  // [ rbp ] and [ r13 ] have no form without displacement.
+  if (0 == memory.displacement && 5u != base) {
+    mod = 0x00;
+  }
+  else if (isInt8(memory.displacement)) {
+    mod = 0x40;
+  }
+
+  emitByte(static_cast<std::uint8_t>(mod | (reg & 7u) << 3 | base));
+
+  // [ rsp ] and [ r12 ] need SIB without index.
+  if (4u == base) {
+    emitByte(0x24);
+  }
+
+  if (0x40 == mod) {
+    emitByte(static_cast<std::uint8_t>(memory.displacement));
+  }
+  else if (0x80 == mod) {
+    emitValue(&memory.displacement, sizeof(memory.displacement));
+  }
+}
+
+void Assembler::emitLabelBranch(
+  const std::uint8_t shortOpcode,
+  const std::uint8_t* nearOpcode,
+  const std::size_t nearSize,
+  const Label label)
+{
+  if (label.id >= m_labels.size()) {
+    throw Exception{Code::kInvalidLabel};
+  }
+
+  const std::size_t position{m_labels[label.id]};
+
+  // Bound labels don't move, so backward short branches are final.
+  if (kUnbound != position)
+  {
+    const std::intptr_t distance{static_cast<std::intptr_t>(position)
+      - static_cast<std::intptr_t>(m_code.size() + 2u)};
+
+    if (isInt8(distance))
+    {
+      emitByte(shortOpcode);
+      emitByte(static_cast<std::uint8_t>(distance));
+      return;
+    }
+  }
+
+  Bytes(nearOpcode, nearSize);
+  addFixup(FixupKind::kRel32, label.id);
+}
+
+void Assembler::addFixup(const FixupKind kind, const std::uintptr_t value)
+{
+  if (FixupKind::kTarget32 != kind && value >= m_labels.size()) {
+    throw Exception{Code::kInvalidLabel};
+  }
+
+  m_fixups.push_back(Fixup{kind, m_code.size(), value});
+  m_code.resize(m_code.size() + 4u);
+}
+
+std::size_t Assembler::getLabel(const Label label) const
+{
+  const std::size_t position{m_labels[label.id]};
+
+  if (kUnbound == position) {
+    throw Exception{Code::kLabelIsNotBound};
+  }
+
+  return position;
+}
+
+} // namespace assembler
+} // namespace llmo
@@ -0,0 +1,460 @@
+#include "../include/boundary.hpp"
+
+#include <algorithm> // std::sort, std::unique, std::lower_bound, std::min
+#include <atomic> // std::atomic
+#include <cstring> // std::memcpy
+#include <thread> // std::thread
+
+#include "../include/detail.hpp"
+#include "../include/module.hpp"
+#include "../include/rwe.hpp"
+
+namespace llmo {
+namespace disasm {
+
+namespace {
+
+// "LLBI"
+constexpr std::uint32_t kMagic{0x49424C4Cu};
+constexpr std::uint32_t kVersion{1u};
+
+struct Header
+{
+  std::uint32_t magic;
+  std::uint32_t version;
+
+  // Image identity.
+  std::uint32_t timeDateStamp;
+  std::uint32_t sizeOfImage;
+
+  std::uint32_t rva; // Of the first covered byte.
+  std::uint32_t size; // Covered bytes, the bitmap follows.
+};
+
+static_assert(sizeof(Header) == 24u, "Unexpected boundary index header size");
+
+// Chunks are multiples of the bitmap word, so threads never share one.
+constexpr std::size_t kMinChunkSize{64u * 1024u};
+constexpr std::size_t kBatchSize{256u};
+
+// Offsets are from the beginning of the index.
+struct Chunk
+{
+  std::size_t begin;
+  std::size_t end;
+  std::size_t sectionEnd;
+  std::size_t entry; // Where the sweep starts.
+  std::size_t exit; // First instruction start at or after the end.
+  bool isKnownEntry; // Section or function start, not a guess.
+  const std::size_t* firstStart; // Known starts after the entry.
+  const std::size_t* lastStart;
+};
+
+bool testBit(const std::uint32_t* bits, const std::size_t offset)
+{
+  return 0u != (bits[offset / 32u] >> (offset % 32u) & 1u);
+}
+
+void setBit(std::uint32_t* bits, const std::size_t offset)
+{
+  bits[offset / 32u] |= 1u << (offset % 32u);
+}
+
+void clearBit(std::uint32_t* bits, const std::size_t offset)
+{
+  bits[offset / 32u] &= ~(1u << (offset % 32u));
+}
+
+std::size_t decodeLength(const std::uint8_t* code, const std::size_t size)
+{
+  Record record{};
+  DecodeBatch(code, size, &record, 1u);
+  return record.length;
+}
+
+// Entry point, functions of the exception directory on x64 and the given
+// starts, as sorted offsets of those inside executable sections.
+std::vector<std::size_t> getKnownStarts(
+  const std::uintptr_t module,
+  const ::IMAGE_NT_HEADERS& ntHeaders,
+  const std::vector<module::Section>& sections,
+  const std::uintptr_t begin,
+  const std::vector<std::uintptr_t>& functionStarts)
+{
+  std::vector<std::uintptr_t> addresses{functionStarts};
+
+  if (0u != ntHeaders.OptionalHeader.AddressOfEntryPoint) {
+    addresses.push_back(module + ntHeaders.OptionalHeader.AddressOfEntryPoint);
+  }
+
+#if defined(_M_X64) || defined(__x86_64__)
+  const ::IMAGE_DATA_DIRECTORY& directory{
+    ntHeaders.OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_EXCEPTION]};
+
+  if (0u != directory.VirtualAddress)
+  {
+    const ::IMAGE_RUNTIME_FUNCTION_ENTRY* functions{
+      reinterpret_cast<const ::IMAGE_RUNTIME_FUNCTION_ENTRY*>(
+        module + directory.VirtualAddress)};
+
+    const std::size_t count{directory.Size / sizeof(::IMAGE_RUNTIME_FUNCTION_ENTRY)};
+
+    for (std::size_t i{0u}; i < count; ++i) {
+      addresses.push_back(module + functions[i].BeginAddress);
+    }
+  }
+#endif
+
+  std::vector<std::size_t> starts{};
+  starts.reserve(addresses.size());
+
+  for (const std::uintptr_t address : addresses)
+  {
+    for (const module::Section& section : sections)
+    {
+      if (section.contains(address))
+      {
+        starts.push_back(address - begin);
+        break;
+      }
+    }
+  }
+
+  std::sort(starts.begin(), starts.end());
+  starts.erase(std::unique(starts.begin(), starts.end()), starts.end());
+
+  return starts;
+}
+
+// Linear sweep from the entry of the chunk up to its end.
+void sweepChunk(const std::uint8_t* code, std::uint32_t* bits, Chunk& chunk)
+{
+  Record records[kBatchSize];
+
+  const std::size_t* start{chunk.firstStart};
+  std::size_t offset{chunk.entry};
+
+  while (offset < chunk.end)
+  {
+    const std::size_t count{
+      DecodeBatch(code + offset, chunk.sectionEnd - offset, records, kBatchSize)};
+
+    std::size_t next{offset};
+
+    for (std::size_t i{0u}; i < count; ++i)
+    {
+      const std::size_t position{offset + records[i].offset};
+
+      // The previous instruction runs over a known start, go on from there.
+      if (start != chunk.lastStart && *start < position)
+      {
+        next = *start;
+        break;
+      }
+
+      if (position >= chunk.end)
+      {
+        next = position;
+        break;
+      }
+
+      if (start != chunk.lastStart && *start == position) {
+        ++start;
+      }
+
+      setBit(bits, position);
+      next = position + records[i].length;
+    }
+
+    offset = next;
+  }
+
+  chunk.exit = offset;
+}
+
+// Continues the sweep of the previous chunk into this one. Bytes before
+// a known entry aren't swept yet, a guessed entry is right since the first
+// start both sweeps share, starts before it are replaced.
+void stitchChunk(
+  const std::uint8_t* code,
+  std::uint32_t* bits,
+  const Chunk& previous,
+  Chunk& chunk)
+{
+  std::size_t offset{previous.exit};
+
+  if (chunk.isKnownEntry)
+  {
+    while (offset < chunk.entry)
+    {
+      setBit(bits, offset);
+      offset += decodeLength(code + offset, chunk.sectionEnd - offset);
+    }
+
+    return;
+  }
+
+  // Covered by the last instruction of the previous chunk.
+  for (std::size_t i{chunk.begin}; i < offset && i < chunk.end; ++i) {
+    clearBit(bits, i);
+  }
+
+  while (offset < chunk.end && !testBit(bits, offset))
+  {
+    const std::size_t next{
+      offset + decodeLength(code + offset, chunk.sectionEnd - offset)};
+
+    setBit(bits, offset);
+
+    for (std::size_t i{offset + 1u}; i < next && i < chunk.end; ++i) {
+      clearBit(bits, i);
+    }
+
+    offset = next;
+  }
+
+  // Never met, the previous sweep goes on to the next chunk.
+  if (offset >= chunk.end) {
+    chunk.exit = offset;
+  }
+}
+
+} // namespace
+
+BoundaryIndex::BoundaryIndex(
+  const std::uintptr_t module,
+  const std::vector<std::uintptr_t>& functionStarts,
+  const unsigned threadCount)
+{
+  const ::IMAGE_NT_HEADERS* ntHeaders{module::getNtHeaders(module)};
+
+  if (nullptr == ntHeaders) {
+    throw Exception{module, Code::kInvalidModule};
+  }
+
+  std::vector<module::Section> sections{};
+
+  for (const module::Section& section : module::getSections(module))
+  {
+    const std::size_t size{rwe::getReadableSize(section.address, section.size)};
+
+    if (section.isExecutable() && 0u != size) {
+      sections.push_back(module::Section{section.address, size, section.characteristics});
+    }
+  }
+
+  m_module = module;
+  m_timeDateStamp = ntHeaders->FileHeader.TimeDateStamp;
+  m_sizeOfImage = ntHeaders->OptionalHeader.SizeOfImage;
+
+  if (sections.empty()) {
+    return;
+  }
+
+  std::sort(sections.begin(), sections.end(),
+    [](const module::Section& left, const module::Section& right) {
+      return left.address < right.address;
+    });
+
+  m_begin = sections.front().address;
+  m_size = sections.back().address + sections.back().size - m_begin;
+  m_bits.assign((m_size + 31u) / 32u, 0u);
+
+  const std::vector<std::size_t> starts{
+    getKnownStarts(module, *ntHeaders, sections, m_begin, functionStarts)};
+
+  unsigned threads{0u != threadCount ? threadCount : std::thread::hardware_concurrency()};
+
+  if (0u == threads) {
+    threads = 1u;
+  }
+
+  std::size_t chunkSize{(m_size + threads - 1u) / threads};
+  chunkSize = std::max(kMinChunkSize, (chunkSize + 31u) & ~std::size_t{31u});
+
+  std::vector<Chunk> chunks{};
+
+  for (const module::Section& section : sections)
+  {
+    const std::size_t sectionBegin{section.address - m_begin};
+    const std::size_t sectionEnd{sectionBegin + section.size};
+
+    for (std::size_t begin{sectionBegin}; begin < sectionEnd; begin += chunkSize)
+    {
+      Chunk chunk{};
+      chunk.begin = begin;
+      chunk.end = std::min(begin + chunkSize, sectionEnd);
+      chunk.sectionEnd = sectionEnd;
+
+      const std::size_t* first{std::lower_bound(starts.data(), starts.data() + starts.size(), begin)};
+      const std::size_t* last{std::lower_bound(first, starts.data() + starts.size(), chunk.end)};
+
+      chunk.isKnownEntry = begin == sectionBegin || first != last;
+      chunk.entry = begin == sectionBegin || first == last ? begin : *first;
+      chunk.firstStart = std::lower_bound(first, last, chunk.entry);
+      chunk.lastStart = last;
+
+      chunks.push_back(chunk);
+    }
+  }
+
+  const std::uint8_t* code{reinterpret_cast<const std::uint8_t*>(m_begin)};
+  std::uint32_t* bits{m_bits.data()};
+
+  std::atomic<std::size_t> nextChunk{0u};
+
+  const auto sweep = [&]()
+  {
+    for (std::size_t i{nextChunk++}; i < chunks.size(); i = nextChunk++) {
+      sweepChunk(code, bits, chunks[i]);
+    }
+  };
+
+  std::vector<std::thread> workers{};
+
+  for (unsigned i{1u}; i < threads && i < chunks.size(); ++i) {
+    workers.emplace_back(sweep);
+  }
+
+  sweep();
+
+  for (std::thread& worker : workers) {
+    worker.join();
+  }
+
+  for (std::size_t i{1u}; i < chunks.size(); ++i)
+  {
+    if (chunks[i].sectionEnd == chunks[i - 1u].sectionEnd) {
+      stitchChunk(code, bits, chunks[i - 1u], chunks[i]);
+    }
+  }
+}
+
+BoundaryIndex BoundaryIndex::Deserialize(
+  const std::uintptr_t module,
+  const void* data,
+  const std::size_t size)
+{
+  const ::IMAGE_NT_HEADERS* ntHeaders{module::getNtHeaders(module)};
+
+  if (nullptr == ntHeaders) {
+    throw Exception{module, Code::kInvalidModule};
+  }
+
+  Header header{};
+
+  if (size < sizeof(header)) {
+    throw Exception{Code::kInvalidFormat};
+  }
+
+  std::memcpy(&header, data, sizeof(header));
+
+  const std::size_t wordCount{(static_cast<std::size_t>(header.size) + 31u) / 32u};
+
+  if (kMagic != header.magic || kVersion != header.version
+    || size - sizeof(header) != wordCount * sizeof(std::uint32_t))
+  {
+    throw Exception{Code::kInvalidFormat};
+  }
+
+  if (header.timeDateStamp != ntHeaders->FileHeader.TimeDateStamp
+    || header.sizeOfImage != ntHeaders->OptionalHeader.SizeOfImage
+    || header.rva > header.sizeOfImage || header.size > header.sizeOfImage - header.rva)
+  {
+    throw Exception{module, Code::kModuleMismatch};
+  }
+
+  BoundaryIndex index{};
+  index.m_module = module;
+  index.m_timeDateStamp = header.timeDateStamp;
+  index.m_sizeOfImage = header.sizeOfImage;
+
+  if (0u != header.size)
+  {
+    index.m_begin = module + header.rva;
+    index.m_size = header.size;
+    index.m_bits.resize(wordCount);
+
+    std::memcpy(index.m_bits.data(),
+      static_cast<const std::uint8_t*>(data) + sizeof(header),
+      wordCount * sizeof(std::uint32_t));
+  }
+
+  return index;
+}
+
+std::vector<std::uint8_t> BoundaryIndex::Serialize() const
+{
+  Header header{};
+  header.magic = kMagic;
+  header.version = kVersion;
+  header.timeDateStamp = m_timeDateStamp;
+  header.sizeOfImage = m_sizeOfImage;
+
+  if (0u != m_size)
+  {
+    header.rva = static_cast<std::uint32_t>(m_begin - m_module);
+    header.size = static_cast<std::uint32_t>(m_size);
+  }
+
+  const std::size_t bitsSize{m_bits.size() * sizeof(std::uint32_t)};
+  std::vector<std::uint8_t> data(sizeof(header) + bitsSize);
+
+  std::memcpy(data.data(), &header, sizeof(header));
+
+  if (0u != bitsSize) {
+    std::memcpy(data.data() + sizeof(header), m_bits.data(), bitsSize);
+  }
+
+  return data;
+}
+
+std::uintptr_t BoundaryIndex::getNext(const std::uintptr_t address) const
+{
+  if (0u == m_size || address >= m_begin + m_size - 1u) {
+    return 0u;
+  }
+
+  const std::size_t offset{address < m_begin ? 0u : address - m_begin + 1u};
+
+  std::size_t word{offset / 32u};
+  std::uint32_t bits{m_bits[word] & ~0u << (offset % 32u)};
+
+  // Only gaps between sections take more than two words.
+  while (0u == bits)
+  {
+    if (++word == m_bits.size()) {
+      return 0u;
+    }
+
+    bits = m_bits[word];
+  }
+
+  return m_begin + word * 32u + detail::countTrailingZeros(bits);
+}
+
+std::uintptr_t BoundaryIndex::getPrevious(const std::uintptr_t address) const
+{
+  if (0u == m_size || address <= m_begin) {
+    return 0u;
+  }
+
+  const std::size_t offset{std::min(address - m_begin, m_size) - 1u};
+
+  std::size_t word{offset / 32u};
+  std::uint32_t bits{m_bits[word] & ~0u >> (31u - offset % 32u)};
+
+  while (0u == bits)
+  {
+    if (0u == word--) {
+      return 0u;
+    }
+
+    bits = m_bits[word];
+  }
+
+  return m_begin + word * 32u + 31u - detail::countLeadingZeros(bits);
+}
+
+} // namespace disasm
+} // namespace llmo
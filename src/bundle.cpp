@@ -0,0 +1,200 @@
+#include "../include/bundle.hpp"
+
+#include <cstring> // std::memchr, std::memcpy
+
+namespace llmo {
+namespace bundle {
+
+namespace {
+
+// Returns true if the records are sorted, don't overlap
+// and their bytes lie within the data.
+bool areRecordsValid(
+  const Record* records,
+  const std::uint32_t count,
+  const std::uint32_t dataSize)
+{
+  std::uint64_t previousEnd{0u};
+
+  for (std::uint32_t i{0u}; i < count; ++i)
+  {
+    const Record& record{records[i]};
+
+    if (0u == record.size
+      || record.rva < previousEnd
+      || std::uint64_t{record.original} + record.size > dataSize
+      || std::uint64_t{record.replacement} + record.size > dataSize)
+    {
+      return false;
+    }
+
+    previousEnd = std::uint64_t{record.rva} + record.size;
+  }
+
+  return true;
+}
+
+} // namespace
+
+Bundle::Bundle(const wchar_t* path)
+{
+  const ::HANDLE file{::CreateFileW(path, GENERIC_READ, FILE_SHARE_READ,
+    nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr)};
+
+  if (INVALID_HANDLE_VALUE == file) {
+    throw Exception{Code::kCouldNotOpen};
+  }
+
+  ::LARGE_INTEGER fileSize{};
+
+  if (!::GetFileSizeEx(file, &fileSize))
+  {
+    ::CloseHandle(file);
+    throw Exception{Code::kCouldNotOpen};
+  }
+
+  const ::HANDLE mapping{::CreateFileMappingW(
+    file, nullptr, PAGE_READONLY, 0u, 0u, nullptr)};
+
+  ::CloseHandle(file);
+
+  if (nullptr == mapping) {
+    throw Exception{Code::kCouldNotMap};
+  }
+
+  // The view keeps the mapping alive.
+  m_view = ::MapViewOfFile(mapping, FILE_MAP_READ, 0u, 0u, 0u);
+  ::CloseHandle(mapping);
+
+  if (nullptr == m_view) {
+    throw Exception{Code::kCouldNotMap};
+  }
+
+  const std::uint8_t* view{static_cast<const std::uint8_t*>(m_view)};
+  const std::uint64_t size{static_cast<std::uint64_t>(fileSize.QuadPart)};
+
+  m_header = reinterpret_cast<const Header*>(view);
+
+  if (size < sizeof(Header)
+    || m_header->magic != kMagic
+    || m_header->version != kVersion
+    || nullptr == std::memchr(m_header->module, '\0', kModuleNameSize)
+    || 0u != m_header->patchesOffset % alignof(Record)
+    || std::uint64_t{m_header->patchesOffset}
+      + std::uint64_t{m_header->patchCount} * sizeof(Record) > size
+    || std::uint64_t{m_header->dataOffset} + m_header->dataSize > size)
+  {
+    ::UnmapViewOfFile(m_view);
+    throw Exception{Code::kInvalidFormat};
+  }
+
+  m_records = reinterpret_cast<const Record*>(view + m_header->patchesOffset);
+  m_data = view + m_header->dataOffset;
+
+  if (!areRecordsValid(m_records, m_header->patchCount, m_header->dataSize))
+  {
+    ::UnmapViewOfFile(m_view);
+    throw Exception{Code::kInvalidFormat};
+  }
+}
+
+Bundle::~Bundle()
+{
+  ::UnmapViewOfFile(m_view);
+}
+
+std::uintptr_t Bundle::getModule() const
+{
+  const ::HMODULE module{::GetModuleHandleA(
+    '\0' != m_header->module[0] ? m_header->module : nullptr)};
+
+  if (nullptr == module) {
+    throw Exception{Code::kModuleNotFound};
+  }
+
+  const std::uintptr_t base{reinterpret_cast<std::uintptr_t>(module)};
+
+  const ::IMAGE_DOS_HEADER* dosHeader{
+    reinterpret_cast<const ::IMAGE_DOS_HEADER*>(base)};
+
+  const ::IMAGE_NT_HEADERS* ntHeaders{
+    reinterpret_cast<const ::IMAGE_NT_HEADERS*>(base + dosHeader->e_lfanew)};
+
+  if ((0u != m_header->timeDateStamp
+      && ntHeaders->FileHeader.TimeDateStamp != m_header->timeDateStamp)
+    || (0u != m_header->sizeOfImage
+      && ntHeaders->OptionalHeader.SizeOfImage != m_header->sizeOfImage))
+  {
+    throw Exception{base, Code::kModuleMismatch};
+  }
+
+  // The records are sorted and don't overlap, so the last one ends farthest.
+  if (0u != m_header->patchCount)
+  {
+    const Record& last{m_records[m_header->patchCount - 1u]};
+
+    if (std::uint64_t{last.rva} + last.size > ntHeaders->OptionalHeader.SizeOfImage) {
+      throw Exception{base, Code::kInvalidFormat};
+    }
+  }
+
+  return base;
+}
+
+std::size_t Bundle::findMismatch() const
+{
+  const std::uintptr_t module{getModule()};
+
+  for (std::size_t i{0u}; i < m_header->patchCount; ++i)
+  {
+    const Record& record{m_records[i]};
+
+    if (!rwe::isEqual(module + record.rva,
+      getData(record.original), record.size))
+    {
+      return i;
+    }
+  }
+
+  return m_header->patchCount;
+}
+
+void Bundle::Apply()
+{
+  const std::size_t mismatch{findMismatch()};
+
+  if (mismatch != m_header->patchCount) {
+    throw Exception{getModule() + m_records[mismatch].rva, Code::kOriginalMismatch};
+  }
+
+  write(getModule(), true);
+}
+
+void Bundle::Restore()
+{
+  write(getModule(), false);
+}
+
+void Bundle::write(const std::uintptr_t module, const bool apply)
+{
+  {
+    rwe::BatchedProtectionRemover remover{};
+
+    for (std::size_t i{0u}; i < m_header->patchCount; ++i)
+    {
+      const Record& record{m_records[i]};
+      const std::uintptr_t address{module + record.rva};
+
+      remover.Unprotect(address, record.size);
+      detail::journalRange(address, record.size);
+
+      std::memcpy(reinterpret_cast<void*>(address),
+        getData(apply ? record.replacement : record.original), record.size);
+    }
+  }
+
+  rwe::synchronizeProcessors();
+}
+
+} // namespace bundle
+} // namespace llmo
@@ -0,0 +1,164 @@
+#include "../include/cave.hpp"
+
+#include <algorithm> // std::sort
+
+#include <emmintrin.h> // SSE2
+
+#include "../include/module.hpp"
+
+namespace llmo {
+namespace rwe {
+
+namespace {
+
+bool isPadding(const std::uint8_t value)
+{
+  return 0x00u == value || 0x90u == value || 0xCCu == value;
+}
+
+// Appends runs of at least minSize equal padding bytes
+// from [ begin, begin + size ) to caves.
+void findPaddingRuns(
+  const std::uint8_t* begin,
+  const std::size_t size,
+  const std::size_t minSize,
+  std::vector<CodeCave>& caves)
+{
+  const __m128i zeros{_mm_set1_epi8(0x00)};
+  const __m128i nops{_mm_set1_epi8(static_cast<char>(0x90))};
+  const __m128i int3s{_mm_set1_epi8(static_cast<char>(0xCC))};
+
+  std::size_t runStart{0u};
+  std::size_t runLength{0u};
+  std::uint8_t runByte{0u};
+
+  std::size_t i{0u};
+
+  while (i < size)
+  {
+    if (i + 16u <= size)
+    {
+      const __m128i block{
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(begin + i))};
+
+      if (0u == runLength)
+      {
+        // No padding at all in the block, nothing to start.
+        const int mask{_mm_movemask_epi8(_mm_or_si128(_mm_or_si128(
+          _mm_cmpeq_epi8(block, zeros),
+          _mm_cmpeq_epi8(block, nops)),
+          _mm_cmpeq_epi8(block, int3s)))};
+
+        if (0 == mask)
+        {
+          i += 16u;
+          continue;
+        }
+      }
+      else
+      {
+        // The whole block continues the run.
+        const int mask{_mm_movemask_epi8(
+          _mm_cmpeq_epi8(block, _mm_set1_epi8(static_cast<char>(runByte))))};
+
+        if (0xFFFF == mask)
+        {
+          runLength += 16u;
+          i += 16u;
+          continue;
+        }
+      }
+    }
+
+    // Mixed block or tail, go byte by byte up to the next block.
+    const std::size_t end{i + 16u <= size ? i + 16u : size};
+
+    for (; i < end; ++i)
+    {
+      const std::uint8_t value{begin[i]};
+
+      if (0u != runLength && value == runByte)
+      {
+        ++runLength;
+        continue;
+      }
+
+      if (runLength >= minSize) {
+        caves.push_back(CodeCave{
+          reinterpret_cast<std::uintptr_t>(begin + runStart), runLength, runByte});
+      }
+
+      runLength = 0u;
+
+      if (isPadding(value))
+      {
+        runStart = i;
+        runLength = 1u;
+        runByte = value;
+      }
+    }
+  }
+
+  if (0u != runLength && runLength >= minSize) {
+    caves.push_back(CodeCave{
+      reinterpret_cast<std::uintptr_t>(begin + runStart), runLength, runByte});
+  }
+}
+
+std::uintptr_t getDistance(const std::uintptr_t left, const std::uintptr_t right)
+{
+  return left > right ? left - right : right - left;
+}
+
+} // namespace
+
+std::vector<CodeCave> FindCodeCaves(
+  const std::uintptr_t module,
+  const std::size_t minSize,
+  const std::uintptr_t target)
+{
+  if (0u == minSize) {
+    throw Exception{module, Code::kSizeIsZero};
+  }
+
+  std::vector<CodeCave> caves{};
+
+  for (const module::Section& section : module::getSections(module))
+  {
+    if (section.isExecutable())
+    {
+      findPaddingRuns(reinterpret_cast<const std::uint8_t*>(section.address),
+        getReadableSize(section.address, section.size), minSize, caves);
+    }
+  }
+
+  std::sort(caves.begin(), caves.end(),
+    [target](const CodeCave& left, const CodeCave& right)
+    {
+      if (0u != target)
+      {
+        const std::uintptr_t leftDistance{getDistance(left.address, target)};
+        const std::uintptr_t rightDistance{getDistance(right.address, target)};
+
+        if (leftDistance != rightDistance) {
+          return leftDistance < rightDistance;
+        }
+      }
+
+      return left.size > right.size;
+    });
+
+  return caves;
+}
+
+std::vector<CodeCave> FindCodeCaves(
+  const void* module,
+  const std::size_t minSize,
+  const void* target)
+{
+  return FindCodeCaves(reinterpret_cast<std::uintptr_t>(module),
+    minSize, reinterpret_cast<std::uintptr_t>(target));
+}
+
+} // namespace rwe
+} // namespace llmo
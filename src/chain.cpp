@@ -0,0 +1,67 @@
+#include "../include/chain.hpp"
+
+#include <cstring> // std::memcpy, std::memset
+
+#include "../include/allocator.hpp"
+
+namespace llmo {
+namespace hook {
+
+namespace {
+
+// jmp [ slot ], rip-relative on x64, absolute on x86.
+constexpr std::uint8_t kJmpIndirect[]{0xFFu, 0x25u};
+
+// Keeps the slot aligned, so its stores and loads are atomic.
+constexpr std::size_t kSlotOffset{8u};
+constexpr std::size_t kCodeSize{kSlotOffset + sizeof(void*)};
+
+constexpr std::uint8_t kInt3{0xCCu};
+
+rwe::NearAllocator& getAllocator()
+{
+  static rwe::NearAllocator allocator{};
+  return allocator;
+}
+
+} // namespace
+
+JumpSlot::JumpSlot(const std::uintptr_t origin) :
+  m_code(getAllocator().Allocate(origin, kCodeSize))
+{
+  std::uint8_t code[kCodeSize]{};
+  std::memset(code, kInt3, sizeof(code));
+  std::memcpy(code, kJmpIndirect, sizeof(kJmpIndirect));
+
+#if defined(_M_X64) || defined(__x86_64__)
+  const std::uint32_t operand{static_cast<std::uint32_t>(
+    kSlotOffset - sizeof(kJmpIndirect) - sizeof(operand))};
+#else
+  const std::uint32_t operand{static_cast<std::uint32_t>(
+    reinterpret_cast<std::uintptr_t>(m_code) + kSlotOffset)};
+#endif
+
+  std::memcpy(code + sizeof(kJmpIndirect), &operand, sizeof(operand));
+  std::memset(code + kSlotOffset, 0, sizeof(void*));
+
+  std::memcpy(m_code, code, sizeof(code));
+  rwe::flushInstructionCache(reinterpret_cast<std::uintptr_t>(m_code), sizeof(code));
+  rwe::synchronizeProcessors();
+}
+
+JumpSlot::~JumpSlot()
+{
+  getAllocator().Free(m_code);
+}
+
+void JumpSlot::Set(const void* destination)
+{
+  // A full barrier, threads which jump after it see the destination
+  // and everything written before.
+  ::InterlockedExchangePointer(
+    reinterpret_cast<void* volatile*>(static_cast<std::uint8_t*>(m_code) + kSlotOffset),
+    const_cast<void*>(destination));
+}
+
+} // namespace hook
+} // namespace llmo
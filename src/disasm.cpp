@@ -0,0 +1,732 @@
+#include "../include/disasm.hpp"
+
+#include <cstring> // std::memcpy, std::memcmp
+
+#if defined(_M_X64) || defined(__x86_64__)
+#include "../third-party/minhook/src/hde/hde64.h"
+#else
+#include "../third-party/minhook/src/hde/hde32.h"
+#endif
+
+namespace llmo {
+namespace disasm {
+
+namespace {
+
+#if defined(_M_X64) || defined(__x86_64__)
+using Hde = ::hde64s;
+#else
+using Hde = ::hde32s;
+#endif
+
+void decode(const std::uintptr_t address, Instruction& instruction)
+{
+  Hde hs{};
+
+#if defined(_M_X64) || defined(__x86_64__)
+  ::hde64_disasm(reinterpret_cast<const void*>(address), &hs);
+#else
+  ::hde32_disasm(reinterpret_cast<const void*>(address), &hs);
+#endif
+
+  instruction = Instruction{};
+  instruction.address = address;
+  instruction.length = hs.len;
+  instruction.opcode = hs.opcode;
+  instruction.opcode2 = hs.opcode2;
+  instruction.modrm = hs.modrm;
+  instruction.sib = hs.sib;
+  instruction.hasModrm = 0u != (hs.flags & F_MODRM);
+  instruction.hasSib = 0u != (hs.flags & F_SIB);
+  instruction.isRelative = 0u != (hs.flags & F_RELATIVE);
+  instruction.isError = 0u != (hs.flags & F_ERROR);
+
+#if defined(_M_X64) || defined(__x86_64__)
+  instruction.rex = hs.rex;
+
+  if (0u != (hs.flags & F_IMM64))
+  {
+    instruction.immediateSize = 8u;
+    instruction.immediate = hs.imm.imm64;
+  }
+  else
+#endif
+  if (0u != (hs.flags & F_IMM32))
+  {
+    instruction.immediateSize = 4u;
+    instruction.immediate = hs.imm.imm32;
+  }
+  else if (0u != (hs.flags & F_IMM16))
+  {
+    instruction.immediateSize = 2u;
+    instruction.immediate = hs.imm.imm16;
+  }
+  else if (0u != (hs.flags & F_IMM8))
+  {
+    instruction.immediateSize = 1u;
+    instruction.immediate = hs.imm.imm8;
+  }
+
+  if (0u != (hs.flags & F_DISP32))
+  {
+    instruction.displacementSize = 4u;
+    instruction.displacement = static_cast<std::int32_t>(hs.disp.disp32);
+  }
+  else if (0u != (hs.flags & F_DISP16))
+  {
+    instruction.displacementSize = 2u;
+    instruction.displacement = static_cast<std::int16_t>(hs.disp.disp16);
+  }
+  else if (0u != (hs.flags & F_DISP8))
+  {
+    instruction.displacementSize = 1u;
+    instruction.displacement = static_cast<std::int8_t>(hs.disp.disp8);
+  }
+
+  if (instruction.isError) {
+    return;
+  }
+
+  if (instruction.isRelative)
+  {
+    std::intptr_t offset{0};
+
+    switch (instruction.immediateSize)
+    {
+    case 1u:
+      offset = static_cast<std::int8_t>(instruction.immediate);
+      break;
+
+    case 2u:
+      offset = static_cast<std::int16_t>(instruction.immediate);
+      break;
+
+    default:
+      offset = static_cast<std::int32_t>(instruction.immediate);
+      break;
+    }
+
+    instruction.target = instruction.getNext() + offset;
+  }
+
+#if defined(_M_X64) || defined(__x86_64__)
+  // The same check as trampoline.c does for relative addressing.
+  if (instruction.hasModrm && 0x05 == (instruction.modrm & 0xC7))
+  {
+    instruction.isRipRelative = true;
+    instruction.target = instruction.getNext() + instruction.displacement;
+  }
+#endif
+}
+
+// HDE reads at most 32 bytes: 16 prefixes, 2 opcode bytes,
+// ModRM, SIB, disp32 and imm64, and so does the fast path.
+constexpr std::size_t kMaxRead{32u};
+
+// Converts HDE result to the compact record.
+template<class T>
+void toRecord(const T& hs, Record& record)
+{
+  record.length = hs.len;
+  record.opcode = 0x0Fu == hs.opcode ? hs.opcode2 : hs.opcode;
+  record.flags = 0u;
+
+  if (0x0Fu == hs.opcode) {
+    record.flags |= Record::kTwoByte;
+  }
+
+  if (0u != (hs.flags & F_MODRM)) {
+    record.flags |= Record::kModrm;
+  }
+
+  if (0u != (hs.flags & F_RELATIVE)) {
+    record.flags |= Record::kRelative;
+  }
+
+  if (0u != (hs.flags & F_ERROR)) {
+    record.flags |= Record::kError;
+  }
+
+  std::uint8_t displacementSize{0u};
+
+  if (0u != (hs.flags & F_DISP32)) {
+    displacementSize = 4u;
+  }
+  else if (0u != (hs.flags & F_DISP16)) {
+    displacementSize = 2u;
+  }
+  else if (0u != (hs.flags & F_DISP8)) {
+    displacementSize = 1u;
+  }
+
+  std::uint8_t immediateSize{0u};
+
+#if defined(_M_X64) || defined(__x86_64__)
+  if (0u != (hs.flags & F_IMM64)) {
+    immediateSize += 8u;
+  }
+
+  if (4u == displacementSize && 0x05u == (hs.modrm & 0xC7u)) {
+    record.flags |= Record::kRipRelative;
+  }
+#else
+  // Second imm16 of far pointers and ENTER.
+  if (0u != (hs.flags & F_2IMM16)) {
+    immediateSize += 2u;
+  }
+#endif
+
+  if (0u != (hs.flags & F_IMM32)) {
+    immediateSize += 4u;
+  }
+
+  if (0u != (hs.flags & F_IMM16)) {
+    immediateSize += 2u;
+  }
+
+  if (0u != (hs.flags & F_IMM8)) {
+    immediateSize += 1u;
+  }
+
+  record.sizes = static_cast<std::uint8_t>(displacementSize << 4 | immediateSize);
+}
+
+#if defined(_M_X64) || defined(__x86_64__)
+
+// HDE's tables, private copy for the flat ones.
+namespace hde {
+#include "../third-party/minhook/src/hde/table64.h"
+} // namespace hde
+
+// Everything the fast path needs to know about an opcode,
+// resolved from HDE's nested tables once.
+struct OpcodeInfo
+{
+  // Record::kModrm, kRelative and kError, so they are copied as is.
+  static constexpr std::uint8_t kRecordFlags{
+    Record::kModrm | Record::kRelative | Record::kError};
+
+  static constexpr std::uint8_t kSlow{0x80u}; // Needs checks done only by hde64.
+
+  std::uint8_t flags;
+  std::uint8_t immediateSize[2]; // Without and with 0x66 prefix.
+  std::uint8_t lowRegImmediateSize[2]; // Added by F6 and F7 if ModRM.reg < 2.
+  std::uint8_t groupMask; // Invalid ModRM.reg values, MSB for 0.
+  std::uint8_t prefixMask; // Invalid prefixes.
+  std::uint8_t memoryPrefixMask; // Prefixes that make mod 3 invalid...
+  std::uint8_t memoryRegMask; // ...unless ModRM.reg is in the mask.
+};
+
+struct Tables
+{
+  std::uint8_t prefixes[256];
+  std::uint8_t modrms[256]; // Displacement size in low 3 bits, kRip and kSib.
+  OpcodeInfo opcodes[2][256];
+};
+
+constexpr std::uint8_t kRip{Record::kRipRelative};
+constexpr std::uint8_t kSib{0x10u};
+
+// Size of immediates hde64 reads for the flags, except imm64.
+std::uint8_t getImmediateSize(const std::uint8_t cflags, const bool has66)
+{
+  using namespace hde;
+
+  if (0u != (cflags & C_IMM_P66) && 0u != (cflags & C_REL32)) {
+    return has66 ? 2u : 4u;
+  }
+
+  std::uint8_t size{0u};
+  bool hasImm16{0u != (cflags & C_IMM16)};
+
+  if (0u != (cflags & C_IMM_P66))
+  {
+    if (has66) {
+      hasImm16 = true;
+    }
+    else {
+      size += 4u;
+    }
+  }
+
+  if (hasImm16) {
+    size += 2u;
+  }
+
+  if (0u != (cflags & C_IMM8)) {
+    size += 1u;
+  }
+
+  if (0u != (cflags & C_REL32)) {
+    size += 4u;
+  }
+  else if (0u != (cflags & C_REL8)) {
+    size += 1u;
+  }
+
+  return size;
+}
+
+Tables buildTables()
+{
+  using namespace hde;
+
+  Tables tables{};
+
+  for (const std::uint8_t prefix : {0x26, 0x2E, 0x36, 0x3E, 0x64, 0x65}) {
+    tables.prefixes[prefix] = PRE_SEG;
+  }
+
+  tables.prefixes[0xF3] = PRE_F3;
+  tables.prefixes[0xF2] = PRE_F2;
+  tables.prefixes[0xF0] = PRE_LOCK;
+  tables.prefixes[0x66] = PRE_66;
+  tables.prefixes[0x67] = PRE_67;
+
+  for (std::size_t modrm{0u}; modrm < 256u; ++modrm)
+  {
+    const std::size_t mod{modrm >> 6};
+    const std::size_t rm{modrm & 7u};
+    std::uint8_t info{0u};
+
+    if (0u == mod && 5u == rm) {
+      info = 4u | kRip;
+    }
+    else if (1u == mod) {
+      info = 1u;
+    }
+    else if (2u == mod) {
+      info = 4u;
+    }
+
+    if (3u != mod && 4u == rm) {
+      info |= kSib;
+    }
+
+    tables.modrms[modrm] = info;
+  }
+
+  for (std::size_t map{0u}; map < 2u; ++map)
+  {
+    const std::uint8_t* ht{hde64_table + (0u != map ? DELTA_OPCODES : 0u)};
+
+    for (std::size_t opcode{0u}; opcode < 256u; ++opcode)
+    {
+      OpcodeInfo& info{tables.opcodes[map][opcode]};
+      std::uint8_t cflags{ht[ht[opcode / 4u] + opcode % 4u]};
+
+      if (C_ERROR == cflags)
+      {
+        info.flags |= Record::kError;
+        cflags = 0x24u == (opcode & 0xFDu) ? C_MODRM : C_NONE;
+      }
+      else if (0u != (cflags & C_GROUP))
+      {
+        const std::uint8_t* group{ht + (cflags & 0x7Fu)};
+
+        cflags = group[0];
+        info.groupMask = group[1];
+      }
+
+      if (0u != (cflags & C_MODRM)) {
+        info.flags |= Record::kModrm;
+      }
+
+      if (0u != (cflags & (C_REL8 | C_REL32))) {
+        info.flags |= Record::kRelative;
+      }
+
+      for (std::size_t has66{0u}; has66 < 2u; ++has66)
+      {
+        info.immediateSize[has66] = getImmediateSize(cflags, 0u != has66);
+
+        // Like hde64, regardless of the map.
+        if (0xF6u == opcode || 0xF7u == opcode)
+        {
+          const std::uint8_t extra{static_cast<std::uint8_t>(
+            0xF6u == opcode ? C_IMM8 : C_IMM_P66)};
+
+          info.lowRegImmediateSize[has66] = static_cast<std::uint8_t>(
+            getImmediateSize(static_cast<std::uint8_t>(cflags | extra), 0u != has66)
+            - info.immediateSize[has66]);
+        }
+      }
+
+      // hde64 tells maps by opcode2, which is zero for 0F 00.
+      const bool hasOpcode2{0u != map && 0u != opcode};
+
+      if (hasOpcode2)
+      {
+        const std::uint8_t* pt{hde64_table + DELTA_PREFIXES};
+        info.prefixMask = pt[pt[opcode / 4u] + opcode % 4u];
+      }
+
+      const std::uint8_t* it{hde64_table
+        + (hasOpcode2 ? DELTA_OP2_ONLY_MEM : DELTA_OP_ONLY_MEM)};
+
+      const std::uint8_t* end{hasOpcode2 ? hde64_table + sizeof(hde64_table)
+        : hde64_table + DELTA_OP2_ONLY_MEM};
+
+      for (; it != end; it += 3)
+      {
+        if (opcode == it[0])
+        {
+          info.memoryPrefixMask = it[1];
+          info.memoryRegMask = it[2];
+          break;
+        }
+      }
+
+      // Operand checks of hde64, moffs and FPU opcodes.
+      const bool isSlow{hasOpcode2
+        ? (opcode >= 0x20u && opcode <= 0x23u) || 0x50u == opcode || 0xC5u == opcode
+          || 0xD6u == opcode || 0xD7u == opcode || 0xF7u == opcode
+        : 0u == map && (0x8Cu == opcode || 0x8Eu == opcode
+          || (opcode >= 0xA0u && opcode <= 0xA3u) || (opcode >= 0xD9u && opcode <= 0xDFu))};
+
+      if (isSlow) {
+        info.flags |= OpcodeInfo::kSlow;
+      }
+    }
+  }
+
+  return tables;
+}
+
+const Tables& getTables()
+{
+  static const Tables tables{buildTables()};
+  return tables;
+}
+
+// More prefixes are left to hde64.
+constexpr std::size_t kMaxPrefixes{4u};
+
+std::size_t decodeSlow(const std::uint8_t* code, Record& record)
+{
+  ::hde64s hs{};
+  ::hde64_disasm(code, &hs);
+
+  toRecord(hs, record);
+  return hs.len;
+}
+
+// Decodes the same way hde64 does, checks which only hde64 does
+// are left to it, for the rare prefixes and opcodes. Returns the length,
+// so the next offset doesn't depend on reading the record back.
+std::size_t decodeRecord(const std::uint8_t* code, const Tables& tables, Record& record)
+{
+  using namespace hde;
+
+  // Up to ModRM and SIB everything lies in the first 16 bytes, they are
+  // read at once, so the next byte doesn't wait for a load every time.
+  std::uint64_t low{};
+  std::uint64_t high{};
+
+  std::memcpy(&low, code, sizeof(low));
+  std::memcpy(&high, code + sizeof(low), sizeof(high));
+
+  const auto at = [low, high](const std::size_t offset)
+  {
+    return static_cast<std::uint8_t>((offset < 8u ? low : high) >> (offset % 8u * 8u));
+  };
+
+  std::size_t n{0u};
+  std::uint8_t pref{0u};
+
+  while (0u != tables.prefixes[at(n)])
+  {
+    pref |= tables.prefixes[at(n++)];
+
+    if (n > kMaxPrefixes) {
+      return decodeSlow(code, record);
+    }
+  }
+
+  if (0u != (pref & (PRE_67 | PRE_LOCK))) {
+    return decodeSlow(code, record);
+  }
+
+  if (0u == pref) {
+    pref = PRE_NONE;
+  }
+
+  // REX, 0F and ModRM are taken without branches,
+  // they are too frequent and too random to be predicted.
+  const std::uint8_t first{at(n)};
+  const std::size_t hasRex{0x40u == (first & 0xF0u) ? 1u : 0u};
+  n += hasRex;
+
+  const std::uint8_t second{at(n)};
+
+  if (0u != hasRex && 0x40u == (second & 0xF0u)) {
+    return decodeSlow(code, record);
+  }
+
+  const bool isOp64{0u != hasRex && 0u != (first & 0x08u) && 0xB8u == (second & 0xF8u)};
+  const std::size_t map{0x0Fu == second ? 1u : 0u};
+  n += map;
+
+  const std::uint8_t c{at(n++)};
+  const OpcodeInfo& info{tables.opcodes[map][c]};
+
+  if (0u != (info.flags & OpcodeInfo::kSlow)) {
+    return decodeSlow(code, record);
+  }
+
+  const std::size_t has66{0u != (pref & PRE_66) ? 1u : 0u};
+  const std::size_t hasModrm{0u != (info.flags & Record::kModrm) ? 1u : 0u};
+
+  const std::uint8_t modrm{at(n)};
+  const std::uint8_t reg{static_cast<std::uint8_t>(modrm >> 3 & 7u)};
+  const std::uint8_t modrmInfo{
+    static_cast<std::uint8_t>(tables.modrms[modrm] & (0u - hasModrm))};
+
+  n += hasModrm;
+
+  const std::size_t hasSib{0u != (modrmInfo & kSib) ? 1u : 0u};
+
+  // [ disp32 + index ] without base for mod 0 and base 5.
+  const bool hasSibDisplacement{
+    0u != hasSib && 5u == (at(n) & 7u) && modrm < 0x40u};
+
+  n += hasSib;
+
+  const std::size_t displacementSize{
+    hasSibDisplacement ? 4u : static_cast<std::size_t>(modrmInfo & 0x07u)};
+
+  n += displacementSize;
+
+  const bool isError{0u != (info.prefixMask & pref)
+    || (0u != hasModrm && (0u != (static_cast<std::uint8_t>(info.groupMask << reg) & 0x80u)
+      || (modrm >= 0xC0u && 0u != (info.memoryPrefixMask & pref)
+        && 0u == (static_cast<std::uint8_t>(info.memoryRegMask << reg) & 0x80u))))};
+
+  std::size_t immediateSize{isOp64 ? 8u : info.immediateSize[has66]};
+
+  if (0u != hasModrm && reg <= 1u) {
+    immediateSize += info.lowRegImmediateSize[has66];
+  }
+
+  std::uint8_t flags{static_cast<std::uint8_t>(map
+    | (info.flags & OpcodeInfo::kRecordFlags) | (modrmInfo & kRip))};
+
+  if (isError) {
+    flags |= Record::kError;
+  }
+
+  std::size_t length{n + immediateSize};
+
+  if (length > kMaxInstructionSize)
+  {
+    flags |= Record::kError;
+    length = kMaxInstructionSize;
+  }
+
+  record.length = static_cast<std::uint8_t>(length);
+  record.opcode = c;
+  record.flags = flags;
+  record.sizes = static_cast<std::uint8_t>(displacementSize << 4 | immediateSize);
+
+  return length;
+}
+
+#else
+
+struct Tables {};
+
+const Tables& getTables()
+{
+  static const Tables tables{};
+  return tables;
+}
+
+std::size_t decodeRecord(const std::uint8_t* code, const Tables&, Record& record)
+{
+  ::hde32s hs{};
+  ::hde32_disasm(code, &hs);
+
+  toRecord(hs, record);
+  return hs.len;
+}
+
+#endif
+
+// Decodes from the offset on, moves the offset past the last record.
+std::size_t decodeBatch(
+  const std::uint8_t* code,
+  const std::size_t size,
+  std::size_t& offset,
+  Record* records,
+  const std::size_t capacity)
+{
+  const Tables& tables{getTables()};
+  std::size_t current{offset};
+  std::size_t count{0u};
+
+  for (; count < capacity && current < size; ++count)
+  {
+    Record& record{records[count]};
+    record.offset = static_cast<std::uint32_t>(current);
+
+    if (size - current >= kMaxRead) {
+      current += decodeRecord(code + current, tables, record);
+    }
+    else
+    {
+      // The tail is decoded from a zero-padded copy.
+      std::uint8_t tail[kMaxRead]{};
+      std::memcpy(tail, code + current, size - current);
+
+      current += decodeRecord(tail, tables, record);
+    }
+  }
+
+  offset = current;
+  return count;
+}
+
+} // namespace
+
+Instruction Decode(const std::uintptr_t address)
+{
+  Instruction instruction{};
+  decode(address, instruction);
+
+  return instruction;
+}
+
+Instruction Decode(const void* address)
+{
+  return Decode(reinterpret_cast<std::uintptr_t>(address));
+}
+
+std::vector<Instruction> DecodeRange(
+  const std::uintptr_t address,
+  const std::size_t size)
+{
+  std::vector<Instruction> instructions{};
+  std::uintptr_t current{address};
+
+  while (current - address < size)
+  {
+    const Instruction instruction{Decode(current)};
+
+    if (instruction.isError) {
+      break;
+    }
+
+    instructions.push_back(instruction);
+    current = instruction.getNext();
+  }
+
+  return instructions;
+}
+
+std::vector<Instruction> DecodeRange(
+  const void* address,
+  const std::size_t size)
+{
+  return DecodeRange(reinterpret_cast<std::uintptr_t>(address), size);
+}
+
+std::size_t DecodeBatch(
+  const void* code,
+  const std::size_t size,
+  Record* records,
+  const std::size_t capacity)
+{
+  std::size_t offset{0u};
+
+  return decodeBatch(static_cast<const std::uint8_t*>(code),
+    size, offset, records, capacity);
+}
+
+std::vector<Record> DecodeBatch(const void* code, const std::size_t size)
+{
+  // Instructions are about 4 bytes on average.
+  std::vector<Record> records(size / 4u + 1u);
+  std::size_t offset{0u};
+  std::size_t count{0u};
+
+  while (true)
+  {
+    count += decodeBatch(static_cast<const std::uint8_t*>(code),
+      size, offset, records.data() + count, records.size() - count);
+
+    if (offset >= size) {
+      break;
+    }
+
+    records.resize(records.size() * 2u);
+  }
+
+  records.resize(count);
+  return records;
+}
+
+Cache::Cache(const std::size_t capacity)
+{
+  std::size_t size{1u};
+
+  while (size < capacity) {
+    size <<= 1;
+  }
+
+  m_entries.resize(size);
+  m_mask = size - 1u;
+}
+
+Instruction Cache::Decode(const std::uintptr_t address)
+{
+  Entry& entry{m_entries[(address ^ address >> 16) & m_mask]};
+  const void* bytes{reinterpret_cast<const void*>(address)};
+
+  if (address == entry.instruction.address
+    && 0 == std::memcmp(entry.bytes, bytes, entry.instruction.length))
+  {
+    ++m_hits;
+    return entry.instruction;
+  }
+
+  ++m_misses;
+  decode(address, entry.instruction);
+  std::memcpy(entry.bytes, bytes, entry.instruction.length);
+
+  return entry.instruction;
+}
+
+std::vector<Instruction> Cache::DecodeRange(
+  const std::uintptr_t address,
+  const std::size_t size)
+{
+  std::vector<Instruction> instructions{};
+  std::uintptr_t current{address};
+
+  while (current - address < size)
+  {
+    const Instruction instruction{Decode(current)};
+
+    if (instruction.isError) {
+      break;
+    }
+
+    instructions.push_back(instruction);
+    current = instruction.getNext();
+  }
+
+  return instructions;
+}
+
+void Cache::Clear()
+{
+  for (Entry& entry : m_entries) {
+    entry.instruction.address = 0u;
+  }
+
+  m_hits = 0u;
+  m_misses = 0u;
+}
+
+} // namespace disasm
+} // namespace llmo
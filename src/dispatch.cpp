@@ -0,0 +1,183 @@
+#include "../include/dispatch.hpp"
+
+#include <atomic> // std::atomic
+#include <cstring> // std::memcpy, std::memset
+#include <mutex> // std::mutex, std::lock_guard
+#include <vector> // std::vector
+
+#include "../include/allocator.hpp"
+
+namespace llmo {
+namespace hook {
+
+namespace {
+
+using Table = std::atomic<const void*>[DispatchSlot::kCapacity];
+
+// The jump reads them as plain pointers.
+static_assert(sizeof(std::atomic<const void*>) == sizeof(void*),
+  "std::atomic<const void*> should have the size of a pointer");
+static_assert(sizeof(std::atomic<const std::atomic<const void*>*>) == sizeof(void*),
+  "std::atomic of a table pointer should have the size of a pointer");
+
+#if defined(_M_X64) || defined(__x86_64__)
+// rax is volatile and carries no arguments in the x64 ABI, so it's
+// free to use.
+
+// mov rax, [ moffs64 ]
+constexpr std::uint8_t kMovAccumulator[]{0x48u, 0xA1u};
+
+// jmp [ rax + disp32 ]
+constexpr std::uint8_t kJmpIndirect[]{0xFFu, 0xA0u};
+#else
+// eax carries arguments in regparm, Borland fastcall and compiler-chosen
+// conventions, so it's saved and the destination is swapped in for it.
+
+// push eax
+constexpr std::uint8_t kPushAccumulator[]{0x50u};
+
+// mov eax, [ moffs32 ]
+constexpr std::uint8_t kMovAccumulator[]{0xA1u};
+
+// mov eax, [ eax + disp32 ]
+constexpr std::uint8_t kLoadIndirect[]{0x8Bu, 0x80u};
+
+// xchg eax, [ esp ]
+// ret
+constexpr std::uint8_t kSwapReturn[]{0x87u, 0x04u, 0x24u, 0xC3u};
+#endif
+
+constexpr std::size_t kCodeSize{16u};
+
+constexpr std::uint8_t kInt3{0xCCu};
+
+Table activeTable{};
+Table bypassTable{};
+
+// Table the jumps read, activeTable or bypassTable.
+std::atomic<const std::atomic<const void*>*> currentTable{activeTable};
+
+rwe::NearAllocator& getAllocator()
+{
+  static rwe::NearAllocator allocator{};
+  return allocator;
+}
+
+std::mutex& getSlotsMutex()
+{
+  static std::mutex mutex{};
+  return mutex;
+}
+
+// Indices of the freed slots, used first.
+std::vector<std::size_t>& getFreeSlots()
+{
+  static std::vector<std::size_t> slots{};
+  return slots;
+}
+
+std::size_t usedSlots{0u};
+
+} // namespace
+
+constexpr std::size_t DispatchSlot::kCapacity;
+
+DispatchSlot::DispatchSlot(const std::uintptr_t origin)
+{
+  {
+    std::lock_guard<std::mutex> lock{getSlotsMutex()};
+    std::vector<std::size_t>& freeSlots = getFreeSlots();
+
+    if (!freeSlots.empty())
+    {
+      m_index = freeSlots.back();
+      freeSlots.pop_back();
+    }
+    else if (usedSlots < kCapacity) {
+      m_index = usedSlots++;
+    }
+    else {
+      throw Exception{origin, Code::kNoDispatchSlot};
+    }
+  }
+
+  activeTable[m_index].store(nullptr, std::memory_order_relaxed);
+  bypassTable[m_index].store(nullptr, std::memory_order_relaxed);
+
+  try {
+    m_code = getAllocator().Allocate(origin, kCodeSize);
+  }
+  catch (...)
+  {
+    std::lock_guard<std::mutex> lock{getSlotsMutex()};
+    getFreeSlots().push_back(m_index);
+    throw;
+  }
+
+  std::uint8_t code[kCodeSize]{};
+  std::memset(code, kInt3, sizeof(code));
+
+  const std::uintptr_t table{reinterpret_cast<std::uintptr_t>(&currentTable)};
+  const std::uint32_t offset{static_cast<std::uint32_t>(m_index * sizeof(void*))};
+
+  std::size_t size{0u};
+
+#if !defined(_M_X64) && !defined(__x86_64__)
+  std::memcpy(code + size, kPushAccumulator, sizeof(kPushAccumulator));
+  size += sizeof(kPushAccumulator);
+#endif
+
+  std::memcpy(code + size, kMovAccumulator, sizeof(kMovAccumulator));
+  size += sizeof(kMovAccumulator);
+
+  std::memcpy(code + size, &table, sizeof(table));
+  size += sizeof(table);
+
+#if defined(_M_X64) || defined(__x86_64__)
+  std::memcpy(code + size, kJmpIndirect, sizeof(kJmpIndirect));
+  size += sizeof(kJmpIndirect);
+
+  std::memcpy(code + size, &offset, sizeof(offset));
+#else
+  std::memcpy(code + size, kLoadIndirect, sizeof(kLoadIndirect));
+  size += sizeof(kLoadIndirect);
+
+  std::memcpy(code + size, &offset, sizeof(offset));
+  size += sizeof(offset);
+
+  std::memcpy(code + size, kSwapReturn, sizeof(kSwapReturn));
+#endif
+
+  std::memcpy(m_code, code, sizeof(code));
+  rwe::flushInstructionCache(reinterpret_cast<std::uintptr_t>(m_code), sizeof(code));
+  rwe::synchronizeProcessors();
+}
+
+DispatchSlot::~DispatchSlot()
+{
+  getAllocator().Free(m_code);
+
+  std::lock_guard<std::mutex> lock{getSlotsMutex()};
+  getFreeSlots().push_back(m_index);
+}
+
+void DispatchSlot::Set(const void* destination) {
+  activeTable[m_index].store(destination, std::memory_order_release);
+}
+
+void DispatchSlot::SetBypass(const void* destination) {
+  bypassTable[m_index].store(destination, std::memory_order_release);
+}
+
+void DispatchSlot::setBypassed(const bool bypassed)
+{
+  currentTable.store(bypassed ? bypassTable : activeTable,
+    std::memory_order_release);
+}
+
+bool DispatchSlot::isBypassed() {
+  return bypassTable == currentTable.load(std::memory_order_acquire);
+}
+
+} // namespace hook
+} // namespace llmo
@@ -0,0 +1,136 @@
+#include "../include/function_table.hpp"
+
+#include <algorithm> // std::upper_bound
+
+#include "../include/module.hpp"
+
+namespace llmo {
+namespace module {
+
+namespace {
+
+#if defined(_M_X64) || defined(__x86_64__)
+// UNW_FLAG_CHAININFO, the primary entry follows the unwind codes.
+constexpr std::uint8_t kChainInfo{0x04u};
+
+// Limits walks along malformed chains.
+constexpr std::size_t kMaxChainLength{32u};
+
+// Returns begin of the function the entry is a fragment of,
+// or of the entry itself if it isn't chained.
+std::uint32_t getPrimaryBegin(
+  const std::uintptr_t module,
+  const std::uint32_t sizeOfImage,
+  const ::IMAGE_RUNTIME_FUNCTION_ENTRY* entry)
+{
+  for (std::size_t i{0u}; i < kMaxChainLength; ++i)
+  {
+    // Version and flags, prolog size, count of codes, frame register.
+    if (entry->UnwindData > sizeOfImage - 4u) {
+      break;
+    }
+
+    const std::uint8_t* info{
+      reinterpret_cast<const std::uint8_t*>(module + entry->UnwindData)};
+
+    if (0u == (info[0] >> 3 & kChainInfo)) {
+      break;
+    }
+
+    // Codes are 2 bytes each, their count is rounded up to even.
+    const std::uint32_t chainOffset{static_cast<std::uint32_t>(
+      entry->UnwindData + 4u + ((info[2] + 1u) & ~1u) * 2u)};
+
+    if (chainOffset > sizeOfImage - sizeof(::IMAGE_RUNTIME_FUNCTION_ENTRY)) {
+      break;
+    }
+
+    entry = reinterpret_cast<const ::IMAGE_RUNTIME_FUNCTION_ENTRY*>(module + chainOffset);
+  }
+
+  return entry->BeginAddress;
+}
+#endif
+
+} // namespace
+
+FunctionTable::FunctionTable(const std::uintptr_t module)
+{
+#if defined(_M_X64) || defined(__x86_64__)
+  const ::IMAGE_NT_HEADERS* ntHeaders{getNtHeaders(module)};
+
+  if (nullptr == ntHeaders
+    || ntHeaders->OptionalHeader.NumberOfRvaAndSizes <= IMAGE_DIRECTORY_ENTRY_EXCEPTION)
+  {
+    return;
+  }
+
+  const ::IMAGE_DATA_DIRECTORY& directory{
+    ntHeaders->OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_EXCEPTION]};
+
+  const std::uint32_t sizeOfImage{
+    static_cast<std::uint32_t>(ntHeaders->OptionalHeader.SizeOfImage)};
+
+  if (0u == directory.VirtualAddress || directory.VirtualAddress > sizeOfImage
+    || directory.Size > sizeOfImage - directory.VirtualAddress)
+  {
+    return;
+  }
+
+  const ::IMAGE_RUNTIME_FUNCTION_ENTRY* entries{
+    reinterpret_cast<const ::IMAGE_RUNTIME_FUNCTION_ENTRY*>(module + directory.VirtualAddress)};
+
+  const std::size_t count{directory.Size / sizeof(::IMAGE_RUNTIME_FUNCTION_ENTRY)};
+
+  m_functions.reserve(count);
+
+  // Entries are sorted by begin, as the unwinder requires.
+  std::uint32_t lastBegin{0u};
+
+  for (std::size_t i{0u}; i < count; ++i)
+  {
+    const ::IMAGE_RUNTIME_FUNCTION_ENTRY& entry{entries[i]};
+
+    if (entry.BeginAddress >= entry.EndAddress || entry.EndAddress > sizeOfImage) {
+      continue;
+    }
+
+    const std::uintptr_t begin{module + entry.BeginAddress};
+    const std::uintptr_t end{module + entry.EndAddress};
+
+    if (!m_functions.empty() && m_functions.back().end == begin
+      && getPrimaryBegin(module, sizeOfImage, &entry) == lastBegin)
+    {
+      m_functions.back().end = end;
+      continue;
+    }
+
+    if (!m_functions.empty() && m_functions.back().end > begin) {
+      continue;
+    }
+
+    m_functions.push_back(Function{begin, end});
+    lastBegin = entry.BeginAddress;
+  }
+#else
+  static_cast<void>(module);
+#endif
+}
+
+const Function* FunctionTable::Find(const std::uintptr_t address) const
+{
+  // The first function which begins after the address, the previous one may contain it.
+  const auto function = std::upper_bound(m_functions.begin(), m_functions.end(), address,
+    [](const std::uintptr_t value, const Function& function) {
+      return value < function.begin;
+    });
+
+  if (function == m_functions.begin() || !(function - 1)->contains(address)) {
+    return nullptr;
+  }
+
+  return &*(function - 1);
+}
+
+} // namespace module
+} // namespace llmo
@@ -0,0 +1,1184 @@
+#include "../include/hook_backend.hpp"
+
+#if !_WIN32 // Linux x86-64, see hook_backend.hpp
+
+#include <algorithm> // std::sort, std::upper_bound
+#include <atomic> // std::atomic
+#include <cerrno> // errno
+#include <csignal> // sigaction, SIGRTMIN
+#include <cstdio> // std::fopen, std::fgets, std::sscanf
+#include <cstring> // std::memcpy, std::memset, std::strchr
+#include <ctime> // clock_gettime
+#include <mutex> // std::mutex, std::lock_guard
+#include <new> // placement new
+#include <unordered_map> // std::unordered_map
+#include <vector> // std::vector
+
+#include <fcntl.h> // open
+#include <linux/futex.h> // FUTEX_WAIT_PRIVATE, FUTEX_WAKE_PRIVATE
+#include <sched.h> // sched_yield
+#include <sys/mman.h> // mmap, mprotect
+#include <sys/syscall.h> // SYS_*
+#include <ucontext.h> // ucontext_t, REG_RIP
+#include <unistd.h> // syscall, getpid, pwrite
+
+#include "../third-party/minhook/src/hde/hde64.h"
+
+namespace llmo {
+namespace hook {
+namespace backend {
+
+namespace {
+
+constexpr std::size_t kPageSize{4096u};
+
+// Same as MEMORY_SLOT_SIZE and MAX_MEMORY_RANGE of MinHook's buffer.c.
+constexpr std::size_t kSlotSize{64u};
+constexpr std::uintptr_t kMaxMemoryRange{0x40000000u};
+
+// Lowest address mmap hands out with the default vm.mmap_min_addr.
+constexpr std::uintptr_t kMinAddress{0x10000u};
+
+// Top of the user half of the address space.
+constexpr std::uintptr_t kMaxAddress{0x7FFFFFFFF000u};
+
+constexpr std::size_t kJmpRelSize{5u}; // E9 rel32
+constexpr std::size_t kJmpRelShortSize{2u}; // EB rel8
+constexpr std::size_t kJmpAbsSize{14u}; // FF 25 00000000, imm64
+constexpr std::size_t kCallAbsSize{16u}; // FF 15 00000002, EB 08, imm64
+constexpr std::size_t kJccAbsSize{16u}; // 7* 0E, FF 25 00000000, imm64
+
+// The relay to the detour follows the trampoline in the slot.
+constexpr std::size_t kMaxTrampolineSize{kSlotSize - kJmpAbsSize};
+constexpr std::size_t kMaxInstructions{8u};
+
+// Jump above the function and the short jump to it, see MinHook.
+constexpr std::size_t kMaxPatchSize{kJmpRelSize + kJmpRelShortSize};
+
+// How long a freeze waits for threads to stop, they are skipped after it.
+constexpr long kFreezeTimeoutNs{1000000000};
+
+struct Mapping
+{
+  std::uintptr_t begin;
+  std::uintptr_t end;
+  int protection; // PROT_*
+};
+
+// Mappings of /proc/self/maps, sorted by address.
+// Allocates, so it shouldn't be called with the threads frozen.
+std::vector<Mapping> readMappings()
+{
+  std::vector<Mapping> mappings{};
+  std::FILE* file{std::fopen("/proc/self/maps", "r")};
+
+  if (nullptr == file) {
+    return mappings;
+  }
+
+  char line[512]{};
+  bool isLineStart{true};
+
+  while (nullptr != std::fgets(line, sizeof(line), file))
+  {
+    // Long paths come in several pieces, only the first one is parsed.
+    const bool wasLineStart{isLineStart};
+    isLineStart = nullptr != std::strchr(line, '\n');
+
+    unsigned long begin{0u};
+    unsigned long end{0u};
+    char permissions[5]{};
+
+    if (wasLineStart && 3 == std::sscanf(line, "%lx-%lx %4s", &begin, &end, permissions))
+    {
+      mappings.push_back(Mapping{begin, end,
+        ('r' == permissions[0] ? PROT_READ : 0)
+        | ('w' == permissions[1] ? PROT_WRITE : 0)
+        | ('x' == permissions[2] ? PROT_EXEC : 0)});
+    }
+  }
+
+  std::fclose(file);
+  return mappings;
+}
+
+const Mapping* findMapping(const std::vector<Mapping>& mappings, const std::uintptr_t address)
+{
+  const auto next = std::upper_bound(mappings.begin(), mappings.end(), address,
+    [](const std::uintptr_t value, const Mapping& mapping) { return value < mapping.begin; });
+
+  if (next == mappings.begin() || address >= (next - 1)->end) {
+    return nullptr;
+  }
+
+  return &*(next - 1);
+}
+
+bool isExecutable(const std::vector<Mapping>& mappings, const std::uintptr_t address)
+{
+  const Mapping* mapping{findMapping(mappings, address)};
+  return nullptr != mapping && 0 != (mapping->protection & PROT_EXEC);
+}
+
+// Trampoline slots, carved from pages mapped near the targets.
+// The first slot of a page holds its header.
+struct Block
+{
+  Block* next;
+  void* free; // First free slot, each one holds the next.
+  std::size_t usedCount;
+};
+
+Block* blocks{nullptr};
+
+std::uintptr_t getDistance(const std::uintptr_t left, const std::uintptr_t right)
+{
+  return left > right ? left - right : right - left;
+}
+
+// Maps a page within kMaxMemoryRange of the origin. The kernel takes
+// the address as a hint only, so free gaps of /proc/self/maps are tried
+// from the nearest one on until one of them is honoured.
+Block* mapBlock(const std::uintptr_t origin)
+{
+  const std::uintptr_t low{origin > kMinAddress + kMaxMemoryRange
+    ? origin - kMaxMemoryRange : kMinAddress};
+  const std::uintptr_t high{origin < kMaxAddress - kMaxMemoryRange
+    ? origin + kMaxMemoryRange : kMaxAddress};
+
+  const std::vector<Mapping> mappings{readMappings()};
+  std::vector<std::uintptr_t> hints{};
+
+  for (std::size_t i{0u}; i <= mappings.size(); ++i)
+  {
+    std::uintptr_t begin{0u != i ? mappings[i - 1u].end : 0u};
+    std::uintptr_t end{i < mappings.size() ? mappings[i].begin : kMaxAddress};
+
+    begin = begin > low ? begin : low;
+    end = end < high ? end : high;
+
+    if (begin >= end || end - begin < kPageSize) {
+      continue;
+    }
+
+    // Nearest page of the gap.
+    const std::uintptr_t page{origin & ~(kPageSize - 1u)};
+
+    hints.push_back(page < begin ? begin
+      : page + kPageSize > end ? end - kPageSize : page);
+  }
+
+  std::sort(hints.begin(), hints.end(),
+    [origin](const std::uintptr_t left, const std::uintptr_t right) {
+      return getDistance(left, origin) < getDistance(right, origin);
+    });
+
+  for (const std::uintptr_t hint : hints)
+  {
+#ifdef MAP_FIXED_NOREPLACE
+    const int flags{MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE};
+#else
+    const int flags{MAP_PRIVATE | MAP_ANONYMOUS};
+#endif
+
+    void* pointer{::mmap(reinterpret_cast<void*>(hint), kPageSize,
+      PROT_READ | PROT_WRITE | PROT_EXEC, flags, -1, 0)};
+
+    if (MAP_FAILED == pointer) {
+      continue;
+    }
+
+    const std::uintptr_t address{reinterpret_cast<std::uintptr_t>(pointer)};
+
+    if (address < low || address + kPageSize > high)
+    {
+      ::munmap(pointer, kPageSize);
+      continue;
+    }
+
+    Block* block{static_cast<Block*>(pointer)};
+    block->next = blocks;
+    block->free = nullptr;
+    block->usedCount = 0u;
+
+    for (std::uintptr_t slot{address + kPageSize - kSlotSize}; slot > address; slot -= kSlotSize)
+    {
+      *reinterpret_cast<void**>(slot) = block->free;
+      block->free = reinterpret_cast<void*>(slot);
+    }
+
+    blocks = block;
+    return block;
+  }
+
+  return nullptr;
+}
+
+std::uintptr_t allocateSlot(const std::uintptr_t origin)
+{
+  Block* block{blocks};
+
+  while (nullptr != block && (nullptr == block->free
+    || getDistance(reinterpret_cast<std::uintptr_t>(block), origin) > kMaxMemoryRange - kPageSize))
+  {
+    block = block->next;
+  }
+
+  if (nullptr == block && nullptr == (block = mapBlock(origin))) {
+    return 0u;
+  }
+
+  void* slot{block->free};
+  block->free = *static_cast<void**>(slot);
+  ++block->usedCount;
+
+  std::memset(slot, 0xCC, kSlotSize);
+  return reinterpret_cast<std::uintptr_t>(slot);
+}
+
+void freeSlot(const std::uintptr_t slot)
+{
+  Block* block{reinterpret_cast<Block*>(slot & ~(kPageSize - 1u))};
+
+  *reinterpret_cast<void**>(slot) = block->free;
+  block->free = reinterpret_cast<void*>(slot);
+
+  if (0u != --block->usedCount) {
+    return;
+  }
+
+  for (Block** link{&blocks}; nullptr != *link; link = &(*link)->next)
+  {
+    if (*link == block)
+    {
+      *link = block->next;
+      break;
+    }
+  }
+
+  ::munmap(block, kPageSize);
+}
+
+struct Entry
+{
+  std::uintptr_t target;
+  std::uintptr_t relay; // Jumps to the detour, the patch jumps here.
+  std::uintptr_t trampoline;
+  bool patchAbove; // The jump is in the padding above the target.
+  bool isEnabled;
+  bool queueEnable;
+
+  std::uint8_t backup[kMaxPatchSize];
+
+  // Instruction boundaries of the target and of the trampoline.
+  std::size_t ipCount;
+  std::uint8_t oldIPs[kMaxInstructions];
+  std::uint8_t newIPs[kMaxInstructions];
+};
+
+std::uintptr_t getPatchAddress(const Entry& entry)
+{
+  return entry.patchAbove ? entry.target - kJmpRelSize : entry.target;
+}
+
+std::size_t getPatchSize(const Entry& entry)
+{
+  return entry.patchAbove ? kMaxPatchSize : kJmpRelSize;
+}
+
+bool isCodePadding(const std::uint8_t* code, const std::size_t size)
+{
+  if (0x00u != code[0] && 0x90u != code[0] && 0xCCu != code[0]) {
+    return false;
+  }
+
+  for (std::size_t i{1u}; i < size; ++i)
+  {
+    if (code[i] != code[0]) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+void writeAbsolute(std::uint8_t* code, const std::uint8_t* prefix,
+  const std::size_t prefixSize, const std::uintptr_t address)
+{
+  std::memcpy(code, prefix, prefixSize);
+  std::memcpy(code + prefixSize, &address, sizeof(address));
+}
+
+// Port of MinHook's CreateTrampolineFunction for x64. Copies instructions
+// of the target until kJmpRelSize bytes are covered, rewriting relative
+// ones, then jumps back and appends the relay.
+bool buildTrampoline(Entry& entry, const std::uintptr_t detour,
+  const std::vector<Mapping>& mappings)
+{
+  static const std::uint8_t kJmpAbs[]{0xFFu, 0x25u, 0x00u, 0x00u, 0x00u, 0x00u};
+  static const std::uint8_t kCallAbs[]{
+    0xFFu, 0x15u, 0x02u, 0x00u, 0x00u, 0x00u, 0xEBu, 0x08u};
+
+  std::uint8_t* trampoline{reinterpret_cast<std::uint8_t*>(entry.trampoline)};
+  std::size_t oldPos{0u};
+  std::size_t newPos{0u};
+  std::uintptr_t jmpDest{0u}; // Farthest internal jump.
+  bool isFinished{false};
+
+  entry.patchAbove = false;
+  entry.ipCount = 0u;
+
+  do
+  {
+    const std::uintptr_t oldInst{entry.target + oldPos};
+    const std::uintptr_t newInst{entry.trampoline + newPos};
+
+    hde64s hs{};
+    const std::size_t length{hde64_disasm(reinterpret_cast<const void*>(oldInst), &hs)};
+
+    if (0u != (hs.flags & F_ERROR)) {
+      return false;
+    }
+
+    std::uint8_t buffer[kJccAbsSize]{};
+    const std::uint8_t* copySource{reinterpret_cast<const std::uint8_t*>(oldInst)};
+    std::size_t copySize{length};
+
+    if (oldPos >= kJmpRelSize)
+    {
+      // Long enough, back to the rest of the target.
+      writeAbsolute(buffer, kJmpAbs, sizeof(kJmpAbs), oldInst);
+      copySource = buffer;
+      copySize = kJmpAbsSize;
+      isFinished = true;
+    }
+    else if (0x05u == (hs.modrm & 0xC7u))
+    {
+      // [ rip + disp32 ], the displacement precedes the immediate.
+      std::memcpy(buffer, copySource, length);
+
+      const std::size_t immediateSize{(hs.flags & 0x3Cu) >> 2};
+      const std::uint32_t displacement{static_cast<std::uint32_t>(
+        oldInst + length + static_cast<std::int32_t>(hs.disp.disp32) - (newInst + length))};
+
+      std::memcpy(buffer + length - immediateSize - 4u, &displacement, sizeof(displacement));
+      copySource = buffer;
+
+      // jmp [ rip + disp32 ] leaves the function.
+      isFinished = 0xFFu == hs.opcode && 4u == hs.modrm_reg;
+    }
+    else if (0xE8u == hs.opcode)
+    {
+      writeAbsolute(buffer, kCallAbs, sizeof(kCallAbs),
+        oldInst + length + static_cast<std::int32_t>(hs.imm.imm32));
+      copySource = buffer;
+      copySize = kCallAbsSize;
+    }
+    else if (0xE9u == (hs.opcode & 0xFDu))
+    {
+      const std::uintptr_t dest{oldInst + length + (0xEBu == hs.opcode
+        ? static_cast<std::intptr_t>(static_cast<std::int8_t>(hs.imm.imm8))
+        : static_cast<std::intptr_t>(static_cast<std::int32_t>(hs.imm.imm32)))};
+
+      if (entry.target <= dest && dest < entry.target + kJmpRelSize) {
+        jmpDest = dest > jmpDest ? dest : jmpDest;
+      }
+      else
+      {
+        writeAbsolute(buffer, kJmpAbs, sizeof(kJmpAbs), dest);
+        copySource = buffer;
+        copySize = kJmpAbsSize;
+
+        // The function ends here unless an earlier branch jumps past it.
+        isFinished = oldInst >= jmpDest;
+      }
+    }
+    else if (0x70u == (hs.opcode & 0xF0u) || 0xE0u == (hs.opcode & 0xFCu)
+      || 0x80u == (hs.opcode2 & 0xF0u))
+    {
+      const bool isShort{0x0Fu != hs.opcode};
+      const std::uintptr_t dest{oldInst + length + (isShort
+        ? static_cast<std::intptr_t>(static_cast<std::int8_t>(hs.imm.imm8))
+        : static_cast<std::intptr_t>(static_cast<std::int32_t>(hs.imm.imm32)))};
+
+      if (entry.target <= dest && dest < entry.target + kJmpRelSize) {
+        jmpDest = dest > jmpDest ? dest : jmpDest;
+      }
+      else if (0xE0u == (hs.opcode & 0xFCu))
+      {
+        // loop and jrcxz to the outside have no long form.
+        return false;
+      }
+      else
+      {
+        // Inverted condition skips the absolute jump.
+        const std::uint8_t condition{
+          static_cast<std::uint8_t>((isShort ? hs.opcode : hs.opcode2) & 0x0Fu)};
+        const std::uint8_t jcc[]{static_cast<std::uint8_t>(0x71u ^ condition), 0x0Eu};
+
+        writeAbsolute(buffer, jcc, sizeof(jcc), 0u);
+        writeAbsolute(buffer + sizeof(jcc), kJmpAbs, sizeof(kJmpAbs), dest);
+        copySource = buffer;
+        copySize = kJccAbsSize;
+      }
+    }
+    else if (0xC2u == (hs.opcode & 0xFEu))
+    {
+      // ret ends the function unless an earlier branch jumps past it.
+      isFinished = oldInst >= jmpDest;
+    }
+
+    // Instructions inside a branch can't change their length.
+    if (oldInst < jmpDest && copySize != length) {
+      return false;
+    }
+
+    if (newPos + copySize > kMaxTrampolineSize || entry.ipCount >= kMaxInstructions) {
+      return false;
+    }
+
+    entry.oldIPs[entry.ipCount] = static_cast<std::uint8_t>(oldPos);
+    entry.newIPs[entry.ipCount] = static_cast<std::uint8_t>(newPos);
+    ++entry.ipCount;
+
+    std::memcpy(trampoline + newPos, copySource, copySize);
+    newPos += copySize;
+    oldPos += length;
+  }
+  while (!isFinished);
+
+  const std::uint8_t* target{reinterpret_cast<const std::uint8_t*>(entry.target)};
+
+  // A function shorter than the jump needs padding after it,
+  // or a short jump to a long one in the padding above it.
+  if (oldPos < kJmpRelSize && !isCodePadding(target + oldPos, kJmpRelSize - oldPos))
+  {
+    if (oldPos < kJmpRelShortSize
+      && !isCodePadding(target + oldPos, kJmpRelShortSize - oldPos))
+    {
+      return false;
+    }
+
+    if (!isExecutable(mappings, entry.target - kJmpRelSize)
+      || !isCodePadding(target - kJmpRelSize, kJmpRelSize))
+    {
+      return false;
+    }
+
+    entry.patchAbove = true;
+  }
+
+  entry.relay = entry.trampoline + newPos;
+  writeAbsolute(trampoline + newPos, kJmpAbs, sizeof(kJmpAbs), detour);
+
+  return true;
+}
+
+// Patch bytes of the hook in the given state.
+void getPatch(const Entry& entry, const bool enable, std::uint8_t* patch)
+{
+  if (!enable)
+  {
+    std::memcpy(patch, entry.backup, getPatchSize(entry));
+    return;
+  }
+
+  const std::uintptr_t jump{getPatchAddress(entry)};
+  const std::int32_t operand{static_cast<std::int32_t>(entry.relay - (jump + kJmpRelSize))};
+
+  patch[0] = 0xE9u;
+  std::memcpy(patch + 1u, &operand, sizeof(operand));
+
+  if (entry.patchAbove)
+  {
+    // jmp short to the long jump above.
+    patch[kJmpRelSize] = 0xEBu;
+    patch[kJmpRelSize + 1u] = static_cast<std::uint8_t>(
+      -static_cast<std::int8_t>(kMaxPatchSize));
+  }
+}
+
+// Writes code while other threads are frozen, so it doesn't allocate.
+// The pages are made writable for the write, keeping them executable,
+// since the caller may run on them. If the protection can't be changed,
+// the write goes through /proc/self/mem, which ignores it.
+bool writeCode(const std::vector<Mapping>& mappings, const int memory,
+  const std::uintptr_t address, const std::uint8_t* bytes, const std::size_t size)
+{
+  const std::uintptr_t first{address & ~(kPageSize - 1u)};
+  const std::uintptr_t last{(address + size - 1u) & ~(kPageSize - 1u)};
+
+  const Mapping* firstMapping{findMapping(mappings, first)};
+  const Mapping* lastMapping{findMapping(mappings, last)};
+
+  if (nullptr == firstMapping || nullptr == lastMapping) {
+    return false;
+  }
+
+  const int writable{PROT_READ | PROT_WRITE | PROT_EXEC};
+
+  if (0 == ::mprotect(reinterpret_cast<void*>(first), kPageSize, writable)
+    && (first == last || 0 == ::mprotect(reinterpret_cast<void*>(last), kPageSize, writable)))
+  {
+    std::memcpy(reinterpret_cast<void*>(address), bytes, size);
+
+    ::mprotect(reinterpret_cast<void*>(first), kPageSize, firstMapping->protection);
+    ::mprotect(reinterpret_cast<void*>(last), kPageSize, lastMapping->protection);
+
+    return true;
+  }
+
+  ::mprotect(reinterpret_cast<void*>(first), kPageSize, firstMapping->protection);
+
+  return -1 != memory
+    && static_cast<ssize_t>(size) == ::pwrite(memory, bytes, size, static_cast<off_t>(address));
+}
+
+// Stopped threads, see freezeThreads. Kept in pages which are never
+// unmapped, since a late signal handler may still read them.
+enum ThreadState : int
+{
+  kPending,
+  kStopped,
+  kReleased,
+  kAbandoned,
+};
+
+// The low bits hold ThreadState, the rest the generation of the freeze,
+// so a handler of an earlier freeze can't claim a reused entry.
+constexpr int kStateBits{2};
+constexpr int kStateMask{(1 << kStateBits) - 1};
+
+struct FrozenThread
+{
+  std::atomic<int> tid;
+  std::atomic<int> state;
+  ucontext_t* context;
+};
+
+static_assert(sizeof(std::atomic<int>) == sizeof(int),
+  "futex needs std::atomic<int> to be a plain int");
+
+struct ThreadPage
+{
+  static constexpr std::size_t kCapacity{
+    (kPageSize - sizeof(void*)) / sizeof(FrozenThread)};
+
+  std::atomic<ThreadPage*> next;
+  FrozenThread threads[kCapacity];
+};
+
+constexpr std::size_t ThreadPage::kCapacity;
+
+std::atomic<ThreadPage*> threadPages{nullptr};
+std::atomic<std::size_t> frozenCount{0u};
+int freezeGeneration{0};
+
+int getFreezeSignal()
+{
+  return SIGRTMIN + 3;
+}
+
+struct sigaction previousAction{};
+
+long futex(std::atomic<int>& word, const int operation, const int value)
+{
+  return ::syscall(SYS_futex, reinterpret_cast<int*>(&word), operation, value,
+    nullptr, nullptr, 0);
+}
+
+int getThreadId()
+{
+  return static_cast<int>(::syscall(SYS_gettid));
+}
+
+// Returns entry i, mapping a new page if needed. Doesn't allocate,
+// so it's usable while threads are frozen.
+FrozenThread* getFrozenThread(const std::size_t index)
+{
+  std::atomic<ThreadPage*>* link{&threadPages};
+  std::size_t first{0u};
+
+  for (;;)
+  {
+    ThreadPage* page{link->load(std::memory_order_acquire)};
+
+    if (nullptr == page)
+    {
+      void* memory{::mmap(nullptr, sizeof(ThreadPage), PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0)};
+
+      if (MAP_FAILED == memory) {
+        return nullptr;
+      }
+
+      page = new (memory) ThreadPage{};
+      link->store(page, std::memory_order_release);
+    }
+
+    if (index < first + ThreadPage::kCapacity) {
+      return &page->threads[index - first];
+    }
+
+    first += ThreadPage::kCapacity;
+    link = &page->next;
+  }
+}
+
+// Handler of the freeze signal, async-signal-safe. Publishes the context
+// and sleeps until the freeze is over. The thread resumes with the context,
+// so instruction pointers moved by the freezing thread take effect
+// and the return from the signal serializes the processor.
+void onFreezeSignal(int, siginfo_t* info, void* context)
+{
+  const int savedErrno{errno};
+  const int tid{getThreadId()};
+  const int generation{info->si_value.sival_int};
+  const std::size_t count{frozenCount.load(std::memory_order_acquire)};
+
+  std::size_t i{0u};
+
+  for (ThreadPage* page{threadPages.load(std::memory_order_acquire)};
+    nullptr != page && i < count; page = page->next.load(std::memory_order_acquire))
+  {
+    for (std::size_t j{0u}; j < ThreadPage::kCapacity && i < count; ++j, ++i)
+    {
+      FrozenThread& thread{page->threads[j]};
+
+      if (thread.tid.load(std::memory_order_relaxed) != tid) {
+        continue;
+      }
+
+      thread.context = static_cast<ucontext_t*>(context);
+
+      int expected{generation << kStateBits | kPending};
+      const int stopped{generation << kStateBits | kStopped};
+
+      if (thread.state.compare_exchange_strong(expected, stopped, std::memory_order_acq_rel))
+      {
+        while (stopped == thread.state.load(std::memory_order_acquire)) {
+          futex(thread.state, FUTEX_WAIT_PRIVATE, stopped);
+        }
+      }
+
+      errno = savedErrno;
+      return;
+    }
+  }
+
+  errno = savedErrno;
+}
+
+bool isPastDeadline(const ::timespec& deadline)
+{
+  ::timespec now{};
+  ::clock_gettime(CLOCK_MONOTONIC, &now);
+
+  return now.tv_sec > deadline.tv_sec
+    || (now.tv_sec == deadline.tv_sec && now.tv_nsec >= deadline.tv_nsec);
+}
+
+// Adds threads of /proc/self/task which aren't listed yet and signals them.
+// Returns count of added threads or -1 if the list can't be read.
+long signalNewThreads(const int self, const int generation)
+{
+  struct LinuxDirent
+  {
+    std::uint64_t ino;
+    std::int64_t offset;
+    unsigned short length;
+    unsigned char type;
+    char name[1];
+  };
+
+  const int directory{::open("/proc/self/task", O_RDONLY | O_DIRECTORY | O_CLOEXEC)};
+
+  if (-1 == directory) {
+    return -1;
+  }
+
+  const int process{static_cast<int>(::getpid())};
+  long added{0};
+  alignas(8) char buffer[4096];
+
+  for (;;)
+  {
+    const long size{::syscall(SYS_getdents64, directory, buffer, sizeof(buffer))};
+
+    if (size <= 0) {
+      break;
+    }
+
+    for (long position{0}; position < size;)
+    {
+      const LinuxDirent* dirent{reinterpret_cast<const LinuxDirent*>(buffer + position)};
+      position += dirent->length;
+
+      int tid{0};
+
+      for (const char* digit{dirent->name}; '\0' != *digit; ++digit) {
+        tid = '0' <= *digit && *digit <= '9' ? tid * 10 + (*digit - '0') : -1;
+      }
+
+      if (tid <= 0 || tid == self) {
+        continue;
+      }
+
+      const std::size_t count{frozenCount.load(std::memory_order_relaxed)};
+      bool isListed{false};
+
+      for (std::size_t i{0u}; i < count && !isListed; ++i) {
+        isListed = getFrozenThread(i)->tid.load(std::memory_order_relaxed) == tid;
+      }
+
+      FrozenThread* thread{isListed ? nullptr : getFrozenThread(count)};
+
+      if (nullptr == thread) {
+        continue;
+      }
+
+      thread->tid.store(tid, std::memory_order_relaxed);
+      thread->context = nullptr;
+      thread->state.store(generation << kStateBits | kPending, std::memory_order_relaxed);
+      frozenCount.store(count + 1u, std::memory_order_release);
+
+      // The generation travels with the signal.
+      ::siginfo_t info{};
+      info.si_signo = getFreezeSignal();
+      info.si_code = SI_QUEUE;
+      info.si_pid = process;
+      info.si_uid = ::getuid();
+      info.si_value.sival_int = generation;
+
+      if (0 != ::syscall(SYS_rt_tgsigqueueinfo, process, tid, getFreezeSignal(), &info))
+      {
+        // Exited meanwhile.
+        thread->state.store(generation << kStateBits | kAbandoned, std::memory_order_relaxed);
+      }
+
+      ++added;
+    }
+  }
+
+  ::close(directory);
+  return added;
+}
+
+// Linux counterpart of MinHook's Freeze: stops every other thread
+// in onFreezeSignal. Threads started meanwhile are caught by listing
+// the threads again until no new ones show up. Threads which don't stop
+// in time, for instance because they block the signal, are skipped.
+bool freezeThreads()
+{
+  const int self{getThreadId()};
+  const int generation{freezeGeneration = (freezeGeneration + 1) & (INT32_MAX >> kStateBits)};
+
+  frozenCount.store(0u, std::memory_order_release);
+
+  for (;;)
+  {
+    const long added{signalNewThreads(self, generation)};
+
+    if (-1 == added) {
+      return false;
+    }
+    else if (0 == added) {
+      break;
+    }
+  }
+
+  ::timespec deadline{};
+  ::clock_gettime(CLOCK_MONOTONIC, &deadline);
+  deadline.tv_sec += deadline.tv_nsec + kFreezeTimeoutNs >= 1000000000 ? 1 : 0;
+  deadline.tv_nsec = (deadline.tv_nsec + kFreezeTimeoutNs) % 1000000000;
+
+  const int pending{generation << kStateBits | kPending};
+  const std::size_t count{frozenCount.load(std::memory_order_relaxed)};
+
+  for (std::size_t i{0u}; i < count; ++i)
+  {
+    FrozenThread* thread{getFrozenThread(i)};
+
+    while (pending == thread->state.load(std::memory_order_acquire))
+    {
+      if (isPastDeadline(deadline))
+      {
+        int expected{pending};
+        thread->state.compare_exchange_strong(expected,
+          generation << kStateBits | kAbandoned, std::memory_order_acq_rel);
+      }
+      else {
+        ::sched_yield();
+      }
+    }
+  }
+
+  return true;
+}
+
+void unfreezeThreads()
+{
+  const std::size_t count{frozenCount.load(std::memory_order_relaxed)};
+  const int released{freezeGeneration << kStateBits | kReleased};
+
+  for (std::size_t i{0u}; i < count; ++i)
+  {
+    FrozenThread* thread{getFrozenThread(i)};
+
+    if (kStopped == (thread->state.load(std::memory_order_acquire) & kStateMask))
+    {
+      thread->state.store(released, std::memory_order_release);
+      futex(thread->state, FUTEX_WAKE_PRIVATE, 1);
+    }
+  }
+}
+
+// MinHook's FindNewIP and FindOldIP.
+std::uintptr_t findNewIP(const Entry& entry, const std::uintptr_t ip)
+{
+  for (std::size_t i{0u}; i < entry.ipCount; ++i)
+  {
+    if (ip == entry.target + entry.oldIPs[i]) {
+      return entry.trampoline + entry.newIPs[i];
+    }
+  }
+
+  return 0u;
+}
+
+std::uintptr_t findOldIP(const Entry& entry, const std::uintptr_t ip)
+{
+  if (entry.patchAbove && ip == entry.target - kJmpRelSize) {
+    return entry.target;
+  }
+
+  for (std::size_t i{0u}; i < entry.ipCount; ++i)
+  {
+    if (ip == entry.trampoline + entry.newIPs[i]) {
+      return entry.target + entry.oldIPs[i];
+    }
+  }
+
+  return ip == entry.relay ? entry.target : 0u;
+}
+
+// Linux counterpart of MinHook's ProcessThreadIPs: moves instruction
+// pointers of the stopped threads out of the bytes being changed.
+void processThreadIPs(Entry& entry, const bool enable)
+{
+  const std::size_t count{frozenCount.load(std::memory_order_relaxed)};
+
+  for (std::size_t i{0u}; i < count; ++i)
+  {
+    FrozenThread* thread{getFrozenThread(i)};
+
+    if (kStopped != (thread->state.load(std::memory_order_acquire) & kStateMask)) {
+      continue;
+    }
+
+    greg_t& rip{thread->context->uc_mcontext.gregs[REG_RIP]};
+    const std::uintptr_t ip{static_cast<std::uintptr_t>(rip)};
+    const std::uintptr_t moved{enable ? findNewIP(entry, ip) : findOldIP(entry, ip)};
+
+    if (0u != moved) {
+      rip = static_cast<greg_t>(moved);
+    }
+  }
+}
+
+std::mutex mutex{};
+bool isInitialized{false};
+std::unordered_map<std::uintptr_t, Entry> hooks{};
+
+// Changes the hooks to the given states under one freeze.
+// Either all of them are changed or none.
+bool applyStates(const std::vector<Entry*>& entries, const std::vector<bool>& states)
+{
+  if (entries.empty()) {
+    return true;
+  }
+
+  const std::vector<Mapping> mappings{readMappings()};
+  const int memory{::open("/proc/self/mem", O_RDWR | O_CLOEXEC)};
+
+  if (!freezeThreads())
+  {
+    if (-1 != memory) {
+      ::close(memory);
+    }
+
+    return false;
+  }
+
+  std::size_t written{0u};
+
+  for (; written < entries.size(); ++written)
+  {
+    std::uint8_t patch[kMaxPatchSize]{};
+    getPatch(*entries[written], states[written], patch);
+
+    if (!writeCode(mappings, memory, getPatchAddress(*entries[written]),
+      patch, getPatchSize(*entries[written])))
+    {
+      break;
+    }
+  }
+
+  const bool isApplied{written == entries.size()};
+
+  if (!isApplied)
+  {
+    // Put back what was written.
+    while (0u != written--)
+    {
+      std::uint8_t patch[kMaxPatchSize]{};
+      getPatch(*entries[written], !states[written], patch);
+
+      writeCode(mappings, memory, getPatchAddress(*entries[written]),
+        patch, getPatchSize(*entries[written]));
+    }
+  }
+  else
+  {
+    for (std::size_t i{0u}; i < entries.size(); ++i)
+    {
+      processThreadIPs(*entries[i], states[i]);
+      entries[i]->isEnabled = states[i];
+    }
+  }
+
+  unfreezeThreads();
+
+  if (-1 != memory) {
+    ::close(memory);
+  }
+
+  return isApplied;
+}
+
+Entry* findEntry(const std::uintptr_t address)
+{
+  const auto hook = hooks.find(address);
+  return hook != hooks.end() ? &hook->second : nullptr;
+}
+
+bool setEnabled(const std::uintptr_t address, const bool enable)
+{
+  std::lock_guard<std::mutex> lock{mutex};
+
+  Entry* entry{isInitialized ? findEntry(address) : nullptr};
+
+  if (nullptr == entry || entry->isEnabled == enable) {
+    return false;
+  }
+
+  if (!applyStates(std::vector<Entry*>{entry}, std::vector<bool>{enable})) {
+    return false;
+  }
+
+  entry->queueEnable = enable;
+  return true;
+}
+
+bool queue(const std::uintptr_t address, const bool enable)
+{
+  std::lock_guard<std::mutex> lock{mutex};
+
+  Entry* entry{isInitialized ? findEntry(address) : nullptr};
+
+  if (nullptr == entry) {
+    return false;
+  }
+
+  entry->queueEnable = enable;
+  return true;
+}
+
+} // namespace
+
+bool Initialize()
+{
+  std::lock_guard<std::mutex> lock{mutex};
+
+  if (isInitialized) {
+    return false;
+  }
+
+  struct sigaction action{};
+  action.sa_sigaction = &onFreezeSignal;
+  action.sa_flags = SA_SIGINFO | SA_RESTART;
+  sigemptyset(&action.sa_mask);
+
+  if (0 != ::sigaction(getFreezeSignal(), &action, &previousAction)) {
+    return false;
+  }
+
+  // Resolves syscall now rather than in the handler.
+  getThreadId();
+
+  isInitialized = true;
+  return true;
+}
+
+bool Uninitialize()
+{
+  std::lock_guard<std::mutex> lock{mutex};
+
+  if (!isInitialized) {
+    return false;
+  }
+
+  std::vector<Entry*> entries{};
+
+  for (auto& hook : hooks)
+  {
+    if (hook.second.isEnabled) {
+      entries.push_back(&hook.second);
+    }
+  }
+
+  if (!applyStates(entries, std::vector<bool>(entries.size(), false))) {
+    return false;
+  }
+
+  for (const auto& hook : hooks) {
+    freeSlot(hook.second.trampoline);
+  }
+
+  hooks.clear();
+  ::sigaction(getFreezeSignal(), &previousAction, nullptr);
+
+  isInitialized = false;
+  return true;
+}
+
+bool Create(const std::uintptr_t address, const void* function, void** original)
+{
+  std::lock_guard<std::mutex> lock{mutex};
+
+  const std::uintptr_t detour{reinterpret_cast<std::uintptr_t>(function)};
+  const std::vector<Mapping> mappings{readMappings()};
+
+  if (!isInitialized || nullptr != findEntry(address)
+    || !isExecutable(mappings, address) || !isExecutable(mappings, detour))
+  {
+    return false;
+  }
+
+  Entry entry{};
+  entry.target = address;
+  entry.trampoline = allocateSlot(address);
+
+  if (0u == entry.trampoline) {
+    return false;
+  }
+
+  if (!buildTrampoline(entry, detour, mappings))
+  {
+    freeSlot(entry.trampoline);
+    return false;
+  }
+
+  std::memcpy(entry.backup, reinterpret_cast<const void*>(getPatchAddress(entry)),
+    getPatchSize(entry));
+
+  hooks.emplace(address, entry);
+
+  if (nullptr != original) {
+    *original = reinterpret_cast<void*>(entry.trampoline);
+  }
+
+  return true;
+}
+
+bool Remove(const std::uintptr_t address)
+{
+  std::lock_guard<std::mutex> lock{mutex};
+
+  Entry* entry{isInitialized ? findEntry(address) : nullptr};
+
+  if (nullptr == entry) {
+    return false;
+  }
+
+  if (entry->isEnabled
+    && !applyStates(std::vector<Entry*>{entry}, std::vector<bool>{false}))
+  {
+    return false;
+  }
+
+  freeSlot(entry->trampoline);
+  hooks.erase(address);
+
+  return true;
+}
+
+bool Enable(const std::uintptr_t address)
+{
+  return setEnabled(address, true);
+}
+
+bool Disable(const std::uintptr_t address)
+{
+  return setEnabled(address, false);
+}
+
+bool QueueEnable(const std::uintptr_t address)
+{
+  return queue(address, true);
+}
+
+bool QueueDisable(const std::uintptr_t address)
+{
+  return queue(address, false);
+}
+
+bool ApplyQueued()
+{
+  std::lock_guard<std::mutex> lock{mutex};
+
+  if (!isInitialized) {
+    return false;
+  }
+
+  std::vector<Entry*> entries{};
+  std::vector<bool> states{};
+
+  for (auto& hook : hooks)
+  {
+    if (hook.second.isEnabled != hook.second.queueEnable)
+    {
+      entries.push_back(&hook.second);
+      states.push_back(hook.second.queueEnable);
+    }
+  }
+
+  if (applyStates(entries, states)) {
+    return true;
+  }
+
+  // Nothing is applied, the queue is dropped.
+  for (Entry* entry : entries) {
+    entry->queueEnable = entry->isEnabled;
+  }
+
+  return false;
+}
+
+void UseBreakpointPatching(const bool)
+{
+}
+
+bool isEnabled(const std::uintptr_t address)
+{
+  std::lock_guard<std::mutex> lock{mutex};
+
+  const Entry* entry{isInitialized ? findEntry(address) : nullptr};
+  return nullptr != entry && entry->isEnabled;
+}
+
+} // namespace backend
+} // namespace hook
+} // namespace llmo
+
+#endif // !_WIN32
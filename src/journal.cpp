@@ -0,0 +1,139 @@
+#include "../include/journal.hpp"
+
+#include <atomic> // std::atomic
+
+namespace llmo {
+namespace rwe {
+
+namespace {
+
+// Journal which records rwe mutations, nullptr if none.
+std::atomic<Journal*> g_journal{nullptr};
+
+} // namespace
+
+constexpr std::size_t Journal::kNoRecord;
+
+Journal::~Journal()
+{
+  Deactivate();
+}
+
+void Journal::Activate()
+{
+  g_journal.store(this, std::memory_order_release);
+}
+
+void Journal::Deactivate()
+{
+  Journal* expected{this};
+  g_journal.compare_exchange_strong(expected, nullptr);
+}
+
+bool Journal::isActive() const
+{
+  return g_journal.load(std::memory_order_acquire) == this;
+}
+
+Journal::Checkpoint Journal::CreateCheckpoint()
+{
+  m_checkpoint = m_log.size();
+  return m_checkpoint;
+}
+
+void Journal::Record(const std::uintptr_t address, const std::size_t size)
+{
+  if (0u == size) {
+    return;
+  }
+
+  const std::uint8_t* source{reinterpret_cast<const std::uint8_t*>(address)};
+  const std::uintptr_t end{address + size};
+
+  // Merge with the last record if it's after the checkpoint.
+  if (kNoRecord != m_last && m_last >= m_checkpoint)
+  {
+    RecordHeader last{readHeader(m_last)};
+    const std::uintptr_t lastEnd{last.address + last.size};
+
+    if (address >= last.address && address <= lastEnd)
+    {
+      // The last record is at the end of the log, so it can simply grow.
+      if (end > lastEnd)
+      {
+        m_log.insert(m_log.end(), source + (lastEnd - address), source + size);
+        last.size += end - lastEnd;
+        writeHeader(m_last, last);
+      }
+
+      return;
+    }
+  }
+
+  const std::size_t offset{m_log.size()};
+
+  m_log.resize(offset + sizeof(RecordHeader));
+  writeHeader(offset, RecordHeader{address, size, m_last});
+  m_log.insert(m_log.end(), source, source + size);
+
+  m_last = offset;
+}
+
+void Journal::Rollback(const Checkpoint checkpoint)
+{
+  BatchedProtectionRemover remover{};
+
+  while (kNoRecord != m_last && m_last >= checkpoint)
+  {
+    const RecordHeader header{readHeader(m_last)};
+
+    remover.Unprotect(header.address, header.size);
+
+    std::memcpy(reinterpret_cast<void*>(header.address),
+      &m_log[m_last + sizeof(RecordHeader)], header.size);
+
+    m_log.resize(m_last);
+    m_last = header.previous;
+  }
+
+  remover.Restore();
+
+  if (m_checkpoint > m_log.size()) {
+    m_checkpoint = m_log.size();
+  }
+}
+
+void Journal::Clear()
+{
+  m_log.clear();
+  m_last = kNoRecord;
+  m_checkpoint = 0u;
+}
+
+Journal::RecordHeader Journal::readHeader(const std::size_t offset) const
+{
+  RecordHeader header{};
+  std::memcpy(&header, &m_log[offset], sizeof(header));
+  return header;
+}
+
+void Journal::writeHeader(const std::size_t offset, const RecordHeader& header)
+{
+  std::memcpy(&m_log[offset], &header, sizeof(header));
+}
+
+} // namespace rwe
+
+namespace detail {
+
+void journalRange(const std::uintptr_t address, const std::size_t size)
+{
+  rwe::Journal* journal{rwe::g_journal.load(std::memory_order_acquire)};
+
+  if (nullptr != journal) {
+    journal->Record(address, size);
+  }
+}
+
+} // namespace detail
+} // namespace llmo
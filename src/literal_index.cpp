@@ -0,0 +1,702 @@
+#include "../include/literal_index.hpp"
+
+#include <algorithm> // std::sort, std::unique, std::lower_bound, std::upper_bound, std::min
+#include <atomic> // std::atomic
+#include <cstring> // std::memcpy, std::strlen
+#include <thread> // std::thread
+
+#include <emmintrin.h> // SSE2
+
+#include "../include/disasm.hpp"
+#include "../include/module.hpp"
+#include "../include/rwe.hpp"
+
+namespace llmo {
+namespace xref {
+
+namespace {
+
+// "LLLI"
+constexpr std::uint32_t kMagic{0x494C4C4Cu};
+constexpr std::uint32_t kVersion{1u};
+
+struct Header
+{
+  std::uint32_t magic;
+  std::uint32_t version;
+
+  // Image identity.
+  std::uint32_t timeDateStamp;
+  std::uint32_t sizeOfImage;
+
+  // StoredString, then two StoredReference arrays follow.
+  std::uint32_t stringCount;
+  std::uint32_t referenceCount;
+  std::uint32_t constantCount;
+  std::uint32_t reserved;
+};
+
+struct StoredString
+{
+  std::uint32_t rva;
+  std::uint32_t length;
+  std::uint32_t encoding;
+};
+
+struct StoredReference
+{
+  std::uint64_t target; // RVA of the string or the constant.
+  std::uint32_t source; // RVA.
+  std::uint8_t kind;
+  std::uint8_t length;
+  std::uint16_t reserved;
+};
+
+static_assert(sizeof(Header) == 32u, "Unexpected literal index header size");
+static_assert(sizeof(StoredString) == 12u, "Unexpected literal index string size");
+static_assert(sizeof(StoredReference) == 16u, "Unexpected literal index reference size");
+
+constexpr std::size_t kChunkSize{256u * 1024u};
+constexpr std::size_t kBatchSize{256u};
+
+// FNV-1a.
+constexpr std::uint64_t kHashBasis{0xCBF29CE484222325u};
+constexpr std::uint64_t kHashPrime{0x100000001B3u};
+
+template <typename T>
+bool isPrintable(const T value)
+{
+  return (value >= 0x20u && value <= 0x7Eu) || 0x09u == value || 0x0Au == value || 0x0Du == value;
+}
+
+// Movemask of the printable bytes, or of both bytes of the printable
+// 16-bit units. Signed comparisons also reject values with the top bit.
+template <typename T>
+unsigned getPrintableMask(const __m128i block);
+
+template <>
+unsigned getPrintableMask<std::uint8_t>(const __m128i block)
+{
+  const __m128i printable{_mm_and_si128(
+    _mm_cmpgt_epi8(block, _mm_set1_epi8(0x1F)),
+    _mm_cmplt_epi8(block, _mm_set1_epi8(0x7F)))};
+
+  const __m128i controls{_mm_or_si128(_mm_or_si128(
+    _mm_cmpeq_epi8(block, _mm_set1_epi8(0x09)),
+    _mm_cmpeq_epi8(block, _mm_set1_epi8(0x0A))),
+    _mm_cmpeq_epi8(block, _mm_set1_epi8(0x0D)))};
+
+  return static_cast<unsigned>(_mm_movemask_epi8(_mm_or_si128(printable, controls)));
+}
+
+template <>
+unsigned getPrintableMask<std::uint16_t>(const __m128i block)
+{
+  const __m128i printable{_mm_and_si128(
+    _mm_cmpgt_epi16(block, _mm_set1_epi16(0x1F)),
+    _mm_cmplt_epi16(block, _mm_set1_epi16(0x7F)))};
+
+  const __m128i controls{_mm_or_si128(_mm_or_si128(
+    _mm_cmpeq_epi16(block, _mm_set1_epi16(0x09)),
+    _mm_cmpeq_epi16(block, _mm_set1_epi16(0x0A))),
+    _mm_cmpeq_epi16(block, _mm_set1_epi16(0x0D)))};
+
+  return static_cast<unsigned>(_mm_movemask_epi8(_mm_or_si128(printable, controls)));
+}
+
+// Appends null-terminated runs of at least minLength printable characters
+// of type T from [ begin, begin + size ) to strings.
+template <typename T>
+void findStrings(
+  const std::uint8_t* begin,
+  const std::size_t size,
+  const std::size_t minLength,
+  const String::Encoding encoding,
+  std::vector<String>& strings)
+{
+  constexpr std::size_t kBlockLength{16u / sizeof(T)};
+
+  const std::size_t length{size / sizeof(T)};
+
+  std::size_t runStart{0u};
+  bool isInRun{false};
+
+  std::size_t i{0u};
+
+  while (i < length)
+  {
+    if (i + kBlockLength <= length)
+    {
+      const unsigned mask{getPrintableMask<T>(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(begin + i * sizeof(T))))};
+
+      // The whole block continues the run or has nothing to start one.
+      if ((isInRun && 0xFFFFu == mask) || (!isInRun && 0u == mask))
+      {
+        i += kBlockLength;
+        continue;
+      }
+    }
+
+    const std::size_t end{std::min(i + kBlockLength, length)};
+
+    for (; i < end; ++i)
+    {
+      T value{};
+      std::memcpy(&value, begin + i * sizeof(T), sizeof(T));
+
+      if (isPrintable(value))
+      {
+        if (!isInRun)
+        {
+          runStart = i;
+          isInRun = true;
+        }
+
+        continue;
+      }
+
+      if (isInRun && 0u == value && i - runStart >= minLength)
+      {
+        strings.push_back(String{
+          reinterpret_cast<std::uintptr_t>(begin + runStart * sizeof(T)),
+          static_cast<std::uint32_t>(i - runStart), encoding});
+      }
+
+      isInRun = false;
+    }
+  }
+}
+
+template <typename T>
+std::uint64_t hashCharacters(const T* characters, const std::size_t length)
+{
+  std::uint64_t hash{kHashBasis};
+
+  for (std::size_t i{0u}; i < length; ++i)
+  {
+    T value{};
+    std::memcpy(&value, characters + i, sizeof(T));
+
+    hash = (hash ^ static_cast<std::uint8_t>(value)) * kHashPrime;
+  }
+
+  return hash;
+}
+
+std::uint64_t hashString(const String& string)
+{
+  if (String::Encoding::kAscii == string.encoding) {
+    return hashCharacters(reinterpret_cast<const std::uint8_t*>(string.address), string.length);
+  }
+
+  return hashCharacters(reinterpret_cast<const std::uint16_t*>(string.address), string.length);
+}
+
+bool isEqual(const String& string, const char* text, const std::size_t length)
+{
+  if (string.length != length) {
+    return false;
+  }
+
+  if (String::Encoding::kAscii == string.encoding) {
+    return 0 == std::memcmp(reinterpret_cast<const void*>(string.address), text, length);
+  }
+
+  for (std::size_t i{0u}; i < length; ++i)
+  {
+    std::uint16_t value{};
+    std::memcpy(&value, reinterpret_cast<const std::uint8_t*>(string.address) + i * 2u, 2u);
+
+    if (value != static_cast<std::uint8_t>(text[i])) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+// Returns true if the address is inside one of the sorted strings.
+bool isInString(const std::vector<String>& strings, const std::uintptr_t address)
+{
+  const auto string = std::upper_bound(strings.begin(), strings.end(), address,
+    [](const std::uintptr_t value, const String& string) {
+      return value < string.address;
+    });
+
+  return string != strings.begin() && address - (string - 1)->address < (string - 1)->getSize();
+}
+
+std::uint64_t readValue(const std::uint8_t* pointer, const std::size_t size)
+{
+  std::uint64_t value{0u};
+  std::memcpy(&value, pointer, size);
+  return value;
+}
+
+bool isLess(const Reference& left, const Reference& right)
+{
+  if (left.target != right.target) {
+    return left.target < right.target;
+  }
+
+  return left.source < right.source;
+}
+
+struct CodeChunk
+{
+  std::uintptr_t begin;
+  std::uintptr_t end;
+  std::uintptr_t sectionEnd;
+  std::vector<Reference> references;
+  std::vector<Reference> constants;
+};
+
+void addInstruction(
+  const std::uintptr_t address,
+  const disasm::Record& record,
+  const std::vector<String>& strings,
+  CodeChunk& chunk)
+{
+  const std::uint8_t* end{reinterpret_cast<const std::uint8_t*>(address) + record.length};
+  const std::size_t immediateSize{record.getImmediateSize()};
+
+  if (0u != (record.flags & disasm::Record::kRelative)) {
+    return;
+  }
+
+  if (4u == immediateSize || 8u == immediateSize)
+  {
+    const std::uint64_t value{readValue(end - immediateSize, immediateSize)};
+
+    chunk.constants.push_back(Reference{address,
+      static_cast<std::uintptr_t>(value), Kind::kImmediate, record.length});
+
+    if (sizeof(std::uintptr_t) == immediateSize
+      && isInString(strings, static_cast<std::uintptr_t>(value)))
+    {
+      chunk.references.push_back(Reference{address,
+        static_cast<std::uintptr_t>(value), Kind::kAbsolute, record.length});
+    }
+  }
+
+  if (4u != record.getDisplacementSize()) {
+    return;
+  }
+
+  const std::int32_t displacement{static_cast<std::int32_t>(
+    readValue(end - immediateSize - 4u, 4u))};
+
+#if defined(_M_X64) || defined(__x86_64__)
+  if (0u == (record.flags & disasm::Record::kRipRelative)) {
+    return;
+  }
+
+  const std::uintptr_t target{address + record.length
+    + static_cast<std::uintptr_t>(static_cast<std::intptr_t>(displacement))};
+  const Kind kind{Kind::kRipRelative};
+#else
+  const std::uintptr_t target{static_cast<std::uintptr_t>(displacement)};
+  const Kind kind{Kind::kAbsolute};
+#endif
+
+  if (isInString(strings, target)) {
+    chunk.references.push_back(Reference{address, target, kind, record.length});
+  }
+}
+
+// Linear sweep from the first instruction boundary of the chunk.
+void decodeChunk(
+  const disasm::BoundaryIndex& boundaries,
+  const std::vector<String>& strings,
+  CodeChunk& chunk)
+{
+  std::uintptr_t position{boundaries.isBoundary(chunk.begin)
+    ? chunk.begin : boundaries.getNext(chunk.begin)};
+
+  if (0u == position) {
+    return;
+  }
+
+  disasm::Record records[kBatchSize];
+
+  while (position < chunk.end)
+  {
+    const std::size_t count{disasm::DecodeBatch(reinterpret_cast<const void*>(position),
+      chunk.sectionEnd - position, records, kBatchSize)};
+
+    std::uintptr_t next{chunk.end};
+
+    for (std::size_t i{0u}; i < count; ++i)
+    {
+      const disasm::Record& record{records[i]};
+      const std::uintptr_t address{position + record.offset};
+
+      if (address >= chunk.end) {
+        break;
+      }
+
+      // The last instruction may be cut by the end of the section.
+      if (0u == (record.flags & disasm::Record::kError)
+        && record.length <= chunk.sectionEnd - address)
+      {
+        addInstruction(address, record, strings, chunk);
+      }
+
+      next = address + record.length;
+    }
+
+    position = next;
+  }
+}
+
+} // namespace
+
+LiteralIndex::LiteralIndex(
+  const std::uintptr_t module,
+  const std::size_t minLength,
+  const disasm::BoundaryIndex* boundaries,
+  const unsigned threadCount)
+{
+  const ::IMAGE_NT_HEADERS* ntHeaders{module::getNtHeaders(module)};
+
+  if (nullptr == ntHeaders) {
+    throw disasm::Exception{module, disasm::Code::kInvalidModule};
+  }
+
+  disasm::BoundaryIndex ownBoundaries{};
+
+  if (nullptr == boundaries)
+  {
+    ownBoundaries = disasm::BoundaryIndex{module, {}, threadCount};
+    boundaries = &ownBoundaries;
+  }
+
+  m_module = module;
+  m_timeDateStamp = ntHeaders->FileHeader.TimeDateStamp;
+  m_sizeOfImage = ntHeaders->OptionalHeader.SizeOfImage;
+
+  std::vector<CodeChunk> chunks{};
+
+  for (const module::Section& section : module::getSections(module))
+  {
+    const std::size_t size{rwe::getReadableSize(section.address, section.size)};
+
+    if (section.isExecutable())
+    {
+      for (std::size_t offset{0u}; offset < size; offset += kChunkSize)
+      {
+        chunks.push_back(CodeChunk{section.address + offset,
+          section.address + std::min(offset + kChunkSize, size), section.address + size, {}, {}});
+      }
+    }
+    else if (!section.isWritable()
+      && 0u != (section.characteristics & IMAGE_SCN_CNT_INITIALIZED_DATA))
+    {
+      const std::uint8_t* begin{reinterpret_cast<const std::uint8_t*>(section.address)};
+
+      findStrings<std::uint8_t>(begin, size, minLength, String::Encoding::kAscii, m_strings);
+      findStrings<std::uint16_t>(begin, size, minLength, String::Encoding::kUtf16, m_strings);
+    }
+  }
+
+  std::sort(m_strings.begin(), m_strings.end(),
+    [](const String& left, const String& right) {
+      return left.address < right.address;
+    });
+
+  unsigned threads{0u != threadCount ? threadCount : std::thread::hardware_concurrency()};
+
+  if (0u == threads) {
+    threads = 1u;
+  }
+
+  std::atomic<std::size_t> nextChunk{0u};
+
+  const auto decode = [&]()
+  {
+    for (std::size_t i{nextChunk++}; i < chunks.size(); i = nextChunk++) {
+      decodeChunk(*boundaries, m_strings, chunks[i]);
+    }
+  };
+
+  std::vector<std::thread> workers{};
+
+  for (unsigned i{1u}; i < threads && i < chunks.size(); ++i) {
+    workers.emplace_back(decode);
+  }
+
+  decode();
+
+  for (std::thread& worker : workers) {
+    worker.join();
+  }
+
+  for (const CodeChunk& chunk : chunks)
+  {
+    m_references.insert(m_references.end(), chunk.references.begin(), chunk.references.end());
+    m_constants.insert(m_constants.end(), chunk.constants.begin(), chunk.constants.end());
+  }
+
+  std::sort(m_references.begin(), m_references.end(), isLess);
+  std::sort(m_constants.begin(), m_constants.end(), isLess);
+
+  buildHashes();
+}
+
+LiteralIndex LiteralIndex::Deserialize(
+  const std::uintptr_t module,
+  const void* data,
+  const std::size_t size)
+{
+  const ::IMAGE_NT_HEADERS* ntHeaders{module::getNtHeaders(module)};
+
+  if (nullptr == ntHeaders) {
+    throw disasm::Exception{module, disasm::Code::kInvalidModule};
+  }
+
+  Header header{};
+
+  if (size < sizeof(header)) {
+    throw disasm::Exception{disasm::Code::kInvalidFormat};
+  }
+
+  std::memcpy(&header, data, sizeof(header));
+
+  // Counts are 32-bit, so the sizes can't overflow 64 bits even on x86.
+  const std::uint64_t stringsSize{std::uint64_t{header.stringCount} * sizeof(StoredString)};
+  const std::uint64_t referencesSize{
+    (std::uint64_t{header.referenceCount} + header.constantCount) * sizeof(StoredReference)};
+
+  if (kMagic != header.magic || kVersion != header.version
+    || size - sizeof(header) != stringsSize + referencesSize)
+  {
+    throw disasm::Exception{disasm::Code::kInvalidFormat};
+  }
+
+  if (header.timeDateStamp != ntHeaders->FileHeader.TimeDateStamp
+    || header.sizeOfImage != ntHeaders->OptionalHeader.SizeOfImage)
+  {
+    throw disasm::Exception{module, disasm::Code::kModuleMismatch};
+  }
+
+  LiteralIndex index{};
+  index.m_module = module;
+  index.m_timeDateStamp = header.timeDateStamp;
+  index.m_sizeOfImage = header.sizeOfImage;
+
+  const std::uint8_t* position{static_cast<const std::uint8_t*>(data) + sizeof(header)};
+
+  index.m_strings.reserve(header.stringCount);
+
+  for (std::uint32_t i{0u}; i < header.stringCount; ++i, position += sizeof(StoredString))
+  {
+    StoredString stored{};
+    std::memcpy(&stored, position, sizeof(stored));
+
+    const String string{module + stored.rva, stored.length,
+      static_cast<String::Encoding>(stored.encoding)};
+
+    // Strings are hashed from the image, so they have to lie inside it.
+    if (stored.encoding > static_cast<std::uint32_t>(String::Encoding::kUtf16)
+      || stored.rva > header.sizeOfImage
+      || string.getSize() > header.sizeOfImage - stored.rva)
+    {
+      throw disasm::Exception{disasm::Code::kInvalidFormat};
+    }
+
+    index.m_strings.push_back(string);
+  }
+
+  const auto readReferences = [&](const std::uint32_t count, const bool isRva,
+    std::vector<Reference>& references)
+  {
+    references.reserve(count);
+
+    for (std::uint32_t i{0u}; i < count; ++i, position += sizeof(StoredReference))
+    {
+      StoredReference stored{};
+      std::memcpy(&stored, position, sizeof(stored));
+
+      // Instructions and referenced strings lie inside the image too,
+      // constants are values and can be anything.
+      if (stored.kind > static_cast<std::uint8_t>(Kind::kImmediate)
+        || stored.source >= header.sizeOfImage
+        || stored.length > header.sizeOfImage - stored.source
+        || (isRva && stored.target >= header.sizeOfImage))
+      {
+        throw disasm::Exception{disasm::Code::kInvalidFormat};
+      }
+
+      references.push_back(Reference{module + stored.source,
+        static_cast<std::uintptr_t>(isRva ? module + stored.target : stored.target),
+        static_cast<Kind>(stored.kind), stored.length});
+    }
+  };
+
+  readReferences(header.referenceCount, true, index.m_references);
+  readReferences(header.constantCount, false, index.m_constants);
+
+  index.buildHashes();
+
+  return index;
+}
+
+std::vector<std::uint8_t> LiteralIndex::Serialize() const
+{
+  Header header{};
+  header.magic = kMagic;
+  header.version = kVersion;
+  header.timeDateStamp = m_timeDateStamp;
+  header.sizeOfImage = m_sizeOfImage;
+  header.stringCount = static_cast<std::uint32_t>(m_strings.size());
+  header.referenceCount = static_cast<std::uint32_t>(m_references.size());
+  header.constantCount = static_cast<std::uint32_t>(m_constants.size());
+
+  std::vector<std::uint8_t> data(sizeof(header)
+    + m_strings.size() * sizeof(StoredString)
+    + (m_references.size() + m_constants.size()) * sizeof(StoredReference));
+
+  std::uint8_t* position{data.data()};
+
+  std::memcpy(position, &header, sizeof(header));
+  position += sizeof(header);
+
+  for (const String& string : m_strings)
+  {
+    const StoredString stored{static_cast<std::uint32_t>(string.address - m_module),
+      string.length, static_cast<std::uint32_t>(string.encoding)};
+
+    std::memcpy(position, &stored, sizeof(stored));
+    position += sizeof(stored);
+  }
+
+  const auto writeReferences = [&](const std::vector<Reference>& references, const bool isRva)
+  {
+    for (const Reference& reference : references)
+    {
+      const StoredReference stored{
+        isRva ? reference.target - m_module : reference.target,
+        static_cast<std::uint32_t>(reference.source - m_module),
+        static_cast<std::uint8_t>(reference.kind), reference.length, 0u};
+
+      std::memcpy(position, &stored, sizeof(stored));
+      position += sizeof(stored);
+    }
+  };
+
+  writeReferences(m_references, true);
+  writeReferences(m_constants, false);
+
+  return data;
+}
+
+std::vector<String> LiteralIndex::FindStrings(const char* text) const
+{
+  std::vector<String> strings{};
+
+  const std::size_t length{std::strlen(text)};
+  const std::uint64_t hash{hashCharacters(reinterpret_cast<const std::uint8_t*>(text), length)};
+
+  const auto isBefore = [](const Hash& entry, const std::uint64_t value) {
+    return entry.hash < value;
+  };
+
+  for (auto entry = std::lower_bound(m_hashes.begin(), m_hashes.end(), hash, isBefore);
+    entry != m_hashes.end() && entry->hash == hash; ++entry)
+  {
+    if (isEqual(m_strings[entry->string], text, length)) {
+      strings.push_back(m_strings[entry->string]);
+    }
+  }
+
+  return strings;
+}
+
+References LiteralIndex::getReferencesTo(const String& string) const
+{
+  const auto isBefore = [](const Reference& reference, const std::uintptr_t target) {
+    return reference.target < target;
+  };
+
+  const Reference* first{std::lower_bound(m_references.data(),
+    m_references.data() + m_references.size(), string.address, isBefore)};
+
+  const Reference* last{std::lower_bound(first,
+    m_references.data() + m_references.size(), string.address + string.getSize(), isBefore)};
+
+  return References{first, last};
+}
+
+std::vector<Reference> LiteralIndex::getReferencesTo(const char* text) const
+{
+  std::vector<Reference> references{};
+
+  for (const String& string : FindStrings(text))
+  {
+    const References found{getReferencesTo(string)};
+    references.insert(references.end(), found.begin(), found.end());
+  }
+
+  return references;
+}
+
+References LiteralIndex::getConstantReferences(const std::uint64_t value) const
+{
+  const Reference* end{m_constants.data() + m_constants.size()};
+
+  // Doesn't fit the target of x86 references, so it can't be there.
+  if (static_cast<std::uintptr_t>(value) != value) {
+    return References{end, end};
+  }
+
+  const auto isBefore = [](const Reference& reference, const std::uintptr_t target) {
+    return reference.target < target;
+  };
+
+  const auto isAfter = [](const std::uintptr_t target, const Reference& reference) {
+    return target < reference.target;
+  };
+
+  const std::uintptr_t target{static_cast<std::uintptr_t>(value)};
+  const Reference* first{std::lower_bound(m_constants.data(), end, target, isBefore)};
+
+  return References{first, std::upper_bound(first, end, target, isAfter)};
+}
+
+std::vector<std::uintptr_t> LiteralIndex::getFunctions(
+  const std::vector<Reference>& references,
+  const module::FunctionTable& functions)
+{
+  std::vector<std::uintptr_t> begins{};
+  begins.reserve(references.size());
+
+  for (const Reference& reference : references)
+  {
+    const module::Function* function{functions.Find(reference.source)};
+    begins.push_back(nullptr != function ? function->begin : reference.source);
+  }
+
+  std::sort(begins.begin(), begins.end());
+  begins.erase(std::unique(begins.begin(), begins.end()), begins.end());
+
+  return begins;
+}
+
+void LiteralIndex::buildHashes()
+{
+  m_hashes.clear();
+  m_hashes.reserve(m_strings.size());
+
+  for (std::size_t i{0u}; i < m_strings.size(); ++i) {
+    m_hashes.push_back(Hash{hashString(m_strings[i]), i});
+  }
+
+  std::sort(m_hashes.begin(), m_hashes.end(),
+    [](const Hash& left, const Hash& right) {
+      return left.hash < right.hash;
+    });
+}
+
+} // namespace xref
+} // namespace llmo
@@ -0,0 +1,61 @@
+#include "../include/module.hpp"
+
+namespace llmo {
+namespace module {
+
+const ::IMAGE_NT_HEADERS* getNtHeaders(const std::uintptr_t module)
+{
+  if (0u == module) {
+    return nullptr;
+  }
+
+  const ::IMAGE_DOS_HEADER* dosHeader{
+    reinterpret_cast<const ::IMAGE_DOS_HEADER*>(module)};
+
+  if (IMAGE_DOS_SIGNATURE != dosHeader->e_magic) {
+    return nullptr;
+  }
+
+  const ::IMAGE_NT_HEADERS* ntHeaders{
+    reinterpret_cast<const ::IMAGE_NT_HEADERS*>(module + dosHeader->e_lfanew)};
+
+  if (IMAGE_NT_SIGNATURE != ntHeaders->Signature) {
+    return nullptr;
+  }
+
+  return ntHeaders;
+}
+
+std::vector<Section> getSections(const std::uintptr_t module)
+{
+  std::vector<Section> sections{};
+  const ::IMAGE_NT_HEADERS* ntHeaders{getNtHeaders(module)};
+
+  if (nullptr == ntHeaders) {
+    return sections;
+  }
+
+  // IMAGE_FIRST_SECTION isn't const-correct.
+  const ::IMAGE_SECTION_HEADER* header{
+    IMAGE_FIRST_SECTION(const_cast<::IMAGE_NT_HEADERS*>(ntHeaders))};
+
+  sections.reserve(ntHeaders->FileHeader.NumberOfSections);
+
+  for (::WORD i{0u}; i < ntHeaders->FileHeader.NumberOfSections; ++i, ++header)
+  {
+    sections.push_back(Section{
+      module + header->VirtualAddress,
+      header->Misc.VirtualSize,
+      static_cast<std::uint32_t>(header->Characteristics)});
+  }
+
+  return sections;
+}
+
+std::vector<Section> getSections(const void* module)
+{
+  return getSections(reinterpret_cast<std::uintptr_t>(module));
+}
+
+} // namespace module
+} // namespace llmo
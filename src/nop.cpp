@@ -0,0 +1,167 @@
+#include "../include/nop.hpp"
+
+#include <cstring> // std::memcpy
+#include <vector> // std::vector
+
+#include "../include/assembler.hpp"
+#include "../include/disasm.hpp"
+
+namespace llmo {
+namespace rwe {
+
+namespace {
+
+// Longer ranges are jumped over, the CPU doesn't have to decode them.
+constexpr std::size_t kMaxNopSize{9u};
+constexpr std::size_t kMinJumpSize{2u * kMaxNopSize + 1u};
+
+constexpr std::uint8_t kJmpRel8{0xEBu};
+constexpr std::uint8_t kJmpRel32{0xE9u};
+
+// Returns lengths of the instructions at the address which are at least count
+// and cover at least minSize bytes. The last one may end at unreadable page,
+// so each is decoded from a copy of its readable bytes.
+std::vector<std::size_t> measure(
+  const std::uintptr_t address,
+  const std::size_t count,
+  const std::size_t minSize,
+  const disasm::BoundaryIndex* index)
+{
+  if (0u == address) {
+    throw Exception{address, Code::kAddressIsNull};
+  }
+
+  if (0u == count && 0u == minSize) {
+    throw Exception{address, Code::kSizeIsZero};
+  }
+
+  if (nullptr != index && !index->isBoundary(address)) {
+    throw Exception{address, Code::kInvalidInstruction};
+  }
+
+  std::vector<std::size_t> lengths{};
+  std::size_t size{0u};
+
+  while (lengths.size() < count || size < minSize)
+  {
+    const std::uintptr_t position{address + size};
+    const std::size_t readable{getReadableSize(position, disasm::kMaxInstructionSize)};
+
+    if (0u == readable) {
+      throw Exception{position, Code::kRegionIsNotAvailable};
+    }
+
+    std::uint8_t window[disasm::kMaxInstructionSize]{};
+    std::memcpy(window, reinterpret_cast<const void*>(position), readable);
+
+    disasm::Record record{};
+    disasm::DecodeBatch(window, readable, &record, 1u);
+
+    if (0u != (record.flags & disasm::Record::kError) || record.length > readable) {
+      throw Exception{position, Code::kInvalidInstruction};
+    }
+
+    lengths.push_back(record.length);
+    size += record.length;
+  }
+
+  return lengths;
+}
+
+NoppedRange nop(const std::uintptr_t address, const std::vector<std::size_t>& lengths)
+{
+  std::size_t size{0u};
+
+  for (const std::size_t length : lengths) {
+    size += length;
+  }
+
+  NoppedRange range{address, std::vector<std::uint8_t>(size)};
+  std::memcpy(range.original.data(), reinterpret_cast<const void*>(address), size);
+
+  std::vector<std::uint8_t> code(size);
+  std::size_t offset{0u};
+  bool isJumpWritten{false};
+
+  // Every instruction gets nops of its own, so branches to any of them
+  // still land on an instruction. The jmp over the rest goes into the first
+  // instruction long enough for it.
+  for (const std::size_t length : lengths)
+  {
+    const std::size_t rest{size - offset};
+    std::size_t jumpSize{0u};
+
+    if (!isJumpWritten && rest >= kMinJumpSize)
+    {
+      if (rest - 2u <= INT8_MAX && length >= 2u)
+      {
+        code[offset] = kJmpRel8;
+        code[offset + 1u] = static_cast<std::uint8_t>(rest - 2u);
+        jumpSize = 2u;
+      }
+      else if (rest - 2u > INT8_MAX && length >= 5u)
+      {
+        const std::uint32_t distance{static_cast<std::uint32_t>(rest - 5u)};
+
+        code[offset] = kJmpRel32;
+        std::memcpy(&code[offset + 1u], &distance, sizeof(distance));
+        jumpSize = 5u;
+      }
+
+      isJumpWritten = 0u != jumpSize;
+    }
+
+    assembler::Assembler::WriteNops(code.data() + offset + jumpSize, length - jumpSize);
+    offset += length;
+  }
+
+  Copy(address, code.data(), size);
+  synchronizeProcessors();
+
+  return range;
+}
+
+} // namespace
+
+void NoppedRange::Restore() const
+{
+  if (!original.empty()) {
+    Copy(address, original.data(), original.size());
+    synchronizeProcessors();
+  }
+}
+
+NoppedRange NopInstructions(
+  const std::uintptr_t address,
+  const std::size_t count,
+  const disasm::BoundaryIndex* index)
+{
+  return nop(address, measure(address, count, 0u, index));
+}
+
+NoppedRange NopInstructionBytes(
+  const std::uintptr_t address,
+  const std::size_t size,
+  const disasm::BoundaryIndex* index)
+{
+  return nop(address, measure(address, 0u, size, index));
+}
+
+NoppedRange NopInstructions(
+  const void* pointer,
+  const std::size_t count,
+  const disasm::BoundaryIndex* index)
+{
+  return NopInstructions(reinterpret_cast<std::uintptr_t>(pointer), count, index);
+}
+
+NoppedRange NopInstructionBytes(
+  const void* pointer,
+  const std::size_t size,
+  const disasm::BoundaryIndex* index)
+{
+  return NopInstructionBytes(reinterpret_cast<std::uintptr_t>(pointer), size, index);
+}
+
+} // namespace rwe
+} // namespace llmo
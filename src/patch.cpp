@@ -0,0 +1,294 @@
+#include "../include/patch.hpp"
+
+#include <algorithm> // std::sort, std::find, std::find_if, std::max
+#include <iterator> // std::prev
+
+#include "../include/hook.hpp" // hook::Engine::isHooked
+
+namespace llmo {
+namespace rwe {
+
+namespace {
+
+constexpr std::uintptr_t kPageSize{4096u};
+
+} // namespace
+
+PatchSet::~PatchSet()
+{
+  try
+  {
+    for (Handle handle{0u}; handle < m_patches.size(); ++handle)
+    {
+      if (m_patches[handle].isRegistered) {
+        queue(handle, false);
+      }
+    }
+
+    ApplyQueued();
+  }
+  catch (Exception&) {
+    // Nothing to do, the memory is gone already.
+  }
+}
+
+PatchSet::Handle PatchSet::Register(
+  const std::string& name,
+  const std::uintptr_t address,
+  const void* replacement,
+  const void* original,
+  const std::size_t size)
+{
+  if (0u == address) {
+    throw Exception{address, Code::kAddressIsNull};
+  }
+  else if (0u == size) {
+    throw Exception{address, Code::kSizeIsZero};
+  }
+  else if (m_names.count(name) != 0u) {
+    throw Exception{address, Code::kPatchAlreadyRegistered};
+  }
+
+  const auto next = m_index.lower_bound(address);
+
+  if (next != m_index.end() && next->first < address + size) {
+    throw Exception{address, Code::kPatchOverlaps};
+  }
+
+  if (next != m_index.begin())
+  {
+    const auto previous = std::prev(next);
+
+    if (previous->first + m_patches[previous->second].size > address) {
+      throw Exception{address, Code::kPatchOverlaps};
+    }
+  }
+
+  if (hook::Engine::isHooked(address, size)) {
+    throw Exception{address, Code::kHookOverlaps};
+  }
+
+  // Takes the handle and the bytes of a removed patch if they fit.
+  const auto freeHandle = std::find_if(m_freeHandles.begin(), m_freeHandles.end(),
+    [this, size](const Handle handle) { return m_patches[handle].capacity >= size; });
+
+  const bool isReused{freeHandle != m_freeHandles.end()};
+  const Handle handle{isReused ? *freeHandle : m_patches.size()};
+  const std::size_t bytes{isReused ? m_patches[handle].bytes : m_bytes.size()};
+  const std::size_t capacity{isReused ? m_patches[handle].capacity : size};
+
+  if (!isReused) {
+    m_bytes.resize(bytes + size * 2u);
+  }
+
+  if (nullptr != original) {
+    std::memcpy(&m_bytes[bytes + size], original, size);
+  }
+  else
+  {
+    ScopedProtectionRemover instance{address, size};
+    std::memcpy(&m_bytes[bytes + size], reinterpret_cast<void*>(address), size);
+  }
+
+  std::memcpy(&m_bytes[bytes], replacement, size);
+
+  const Patch patch{address, size, bytes, capacity, name, true, false, false, false};
+
+  if (isReused)
+  {
+    m_freeHandles.erase(freeHandle);
+    m_patches[handle] = patch;
+  }
+  else {
+    m_patches.push_back(patch);
+  }
+
+  m_index.emplace(address, handle);
+  m_names.emplace(name, handle);
+
+  return handle;
+}
+
+void PatchSet::Remove(const Handle handle)
+{
+  Disable(handle);
+
+  Patch& patch{getPatch(handle)};
+
+  m_index.erase(patch.address);
+  m_names.erase(patch.name);
+
+  if (patch.isQueued) {
+    m_queued.erase(std::find(m_queued.begin(), m_queued.end(), handle));
+  }
+
+  patch.isRegistered = false;
+  patch.isQueued = false;
+  patch.name.clear();
+
+  // The handle and the bytes go to the next patch which fits in them.
+  m_freeHandles.push_back(handle);
+}
+
+PatchSet::Handle PatchSet::Find(const std::string& name) const
+{
+  const auto patch = m_names.find(name);
+
+  if (patch == m_names.end()) {
+    throw Exception{Code::kPatchIsNotRegistered};
+  }
+
+  return patch->second;
+}
+
+void PatchSet::Enable(const Handle handle)
+{
+  Patch& patch{getPatch(handle)};
+
+  if (!patch.isEnabled)
+  {
+    Copy(patch.address, getBytes(patch, true), patch.size);
+    synchronizeProcessors();
+    patch.isEnabled = true;
+  }
+}
+
+void PatchSet::Disable(const Handle handle)
+{
+  Patch& patch{getPatch(handle)};
+
+  if (patch.isEnabled)
+  {
+    Copy(patch.address, getBytes(patch, false), patch.size);
+    synchronizeProcessors();
+    patch.isEnabled = false;
+  }
+}
+
+void PatchSet::Toggle(const Handle handle)
+{
+  if (isEnabled(handle)) {
+    Disable(handle);
+  }
+  else {
+    Enable(handle);
+  }
+}
+
+bool PatchSet::isEnabled(const Handle handle) const
+{
+  return getPatch(handle).isEnabled;
+}
+
+void PatchSet::QueueEnable(const Handle handle)
+{
+  queue(handle, true);
+}
+
+void PatchSet::QueueDisable(const Handle handle)
+{
+  queue(handle, false);
+}
+
+void PatchSet::ApplyQueued()
+{
+  std::sort(m_queued.begin(), m_queued.end(),
+    [this](const Handle left, const Handle right) {
+      return m_patches[left].address < m_patches[right].address;
+    });
+
+  const auto isPending = [this](const Handle handle) {
+    return m_patches[handle].isEnabled != m_patches[handle].queueEnable;
+  };
+
+  BatchedProtectionRemover remover{};
+  std::uintptr_t unprotectedEnd{0u};
+  std::size_t applied{0u};
+
+  try
+  {
+    for (; applied < m_queued.size(); ++applied)
+    {
+      Patch& patch{m_patches[m_queued[applied]]};
+
+      if (isPending(m_queued[applied]))
+      {
+        if (patch.address + patch.size > unprotectedEnd)
+        {
+          // Unprotects the following patches which share pages with this one
+          // along with it, so every page changes protection once.
+          unprotectedEnd = (patch.address + patch.size + kPageSize - 1u) & ~(kPageSize - 1u);
+
+          for (std::size_t next{applied + 1u}; next < m_queued.size(); ++next)
+          {
+            const Patch& other{m_patches[m_queued[next]]};
+
+            if ((other.address & ~(kPageSize - 1u)) >= unprotectedEnd) {
+              break;
+            }
+            else if (isPending(m_queued[next])) {
+              unprotectedEnd = std::max(unprotectedEnd,
+                (other.address + other.size + kPageSize - 1u) & ~(kPageSize - 1u));
+            }
+          }
+
+          remover.Unprotect(patch.address, unprotectedEnd - patch.address);
+        }
+
+        detail::journalRange(patch.address, patch.size);
+
+        std::memcpy(reinterpret_cast<void*>(patch.address),
+          getBytes(patch, patch.queueEnable), patch.size);
+
+        patch.isEnabled = patch.queueEnable;
+      }
+
+      patch.isQueued = false;
+    }
+  }
+  catch (Exception&)
+  {
+    synchronizeProcessors();
+
+    // Keep the rest queued, so it can be applied again.
+    m_queued.erase(m_queued.begin(), m_queued.begin() + applied);
+    throw;
+  }
+
+  synchronizeProcessors();
+  m_queued.clear();
+}
+
+PatchSet::Patch& PatchSet::getPatch(const Handle handle)
+{
+  if (handle >= m_patches.size() || !m_patches[handle].isRegistered) {
+    throw Exception{Code::kPatchIsNotRegistered};
+  }
+
+  return m_patches[handle];
+}
+
+const PatchSet::Patch& PatchSet::getPatch(const Handle handle) const
+{
+  if (handle >= m_patches.size() || !m_patches[handle].isRegistered) {
+    throw Exception{Code::kPatchIsNotRegistered};
+  }
+
+  return m_patches[handle];
+}
+
+void PatchSet::queue(const Handle handle, const bool enable)
+{
+  Patch& patch{getPatch(handle)};
+
+  patch.queueEnable = enable;
+
+  if (!patch.isQueued)
+  {
+    patch.isQueued = true;
+    m_queued.push_back(handle);
+  }
+}
+
+} // namespace rwe
+} // namespace llmo
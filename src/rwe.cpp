@@ -1,8 +1,119 @@
 #include "../include/rwe.hpp"
 
+#include <emmintrin.h> // SSE2
+
+#include "../include/detail.hpp"
+
 namespace llmo {
 namespace rwe {
 
+namespace {
+
+constexpr std::uintptr_t kPageSize{4096u};
+
+// Memory protection flags which allow reading.
+constexpr ::DWORD kReadableFlags{
+  PAGE_READONLY | PAGE_READWRITE | PAGE_WRITECOPY |
+  PAGE_EXECUTE_READ | PAGE_EXECUTE_READWRITE | PAGE_EXECUTE_WRITECOPY};
+
+// Returns movemask of zero elements in the block, one bit per byte.
+template <std::size_t ElementSize>
+unsigned zeroMask(const __m128i block);
+
+template <>
+unsigned zeroMask<1u>(const __m128i block) {
+  return static_cast<unsigned>(
+    _mm_movemask_epi8(_mm_cmpeq_epi8(block, _mm_setzero_si128())));
+}
+
+template <>
+unsigned zeroMask<2u>(const __m128i block) {
+  return static_cast<unsigned>(
+    _mm_movemask_epi8(_mm_cmpeq_epi16(block, _mm_setzero_si128())));
+}
+
+// Returns index of the first zero element in [ begin, begin + count )
+// or count if there is none. Works with aligned 16-byte blocks,
+// so it never touches a page which doesn't contain the range.
+template <typename T>
+std::size_t findTerminator(const T* const begin, const std::size_t count)
+{
+  const std::uintptr_t address{reinterpret_cast<std::uintptr_t>(begin)};
+
+  if (0u != address % sizeof(T))
+  {
+    // Misaligned wide string, elements don't match the SIMD lanes.
+    for (std::size_t i{0u}; i < count; ++i)
+    {
+      if (T{} == begin[i]) {
+        return i;
+      }
+    }
+
+    return count;
+  }
+
+  const std::size_t misalignment{address & 15u};
+  const std::size_t size{count * sizeof(T)};
+
+  const __m128i* block{reinterpret_cast<const __m128i*>(address - misalignment)};
+  unsigned mask{zeroMask<sizeof(T)>(_mm_load_si128(block)) >> misalignment};
+  std::size_t position{0u};
+  std::size_t step{16u - misalignment};
+
+  while (0u == mask)
+  {
+    position += step;
+
+    if (position >= size) {
+      return count;
+    }
+
+    step = 16u;
+    mask = zeroMask<sizeof(T)>(_mm_load_si128(++block));
+  }
+
+  position += detail::countTrailingZeros(mask);
+  return position < size ? position / sizeof(T) : count;
+}
+
+template <typename T>
+std::size_t readString(
+  const std::uintptr_t address,
+  T* const buffer,
+  const std::size_t maxLen)
+{
+  if (0u == address) {
+    throw Exception{address, Code::kAddressIsNull};
+  }
+  else if (0u == maxLen) {
+    throw Exception{address, Code::kSizeIsZero};
+  }
+
+  const std::size_t limit{maxLen - 1u};
+  std::size_t length{0u};
+
+  if (0u != limit)
+  {
+    const std::size_t readable{
+      getReadableSize(address, limit * sizeof(T)) / sizeof(T)};
+
+    if (0u == readable) {
+      throw Exception{address, Code::kRegionIsNotAvailable};
+    }
+
+    const T* const source{reinterpret_cast<const T*>(address)};
+
+    length = findTerminator(source, readable);
+    std::memcpy(buffer, source, length * sizeof(T));
+  }
+
+  buffer[length] = T{};
+  return length;
+}
+
+} // namespace
+
 ScopedProtectionRemover::ScopedProtectionRemover(
   const std::uintptr_t address, const std::size_t size) :
   m_address(address), m_size(size)
@@ -33,6 +144,56 @@ ScopedProtectionRemover::~ScopedProtectionRemover()
     m_protectionLevel);
 }
 
+void BatchedProtectionRemover::Unprotect(
+  const std::uintptr_t address,
+  const std::size_t size)
+{
+  if (0u == address) {
+    throw Exception{address, Code::kAddressIsNull};
+  }
+  else if (0u == size) {
+    throw Exception{address, Code::kSizeIsZero};
+  }
+
+  if (address >= m_begin && address + size <= m_end) {
+    return;
+  }
+
+  Restore();
+
+  if (!isRegionAvailable(address)) {
+    throw Exception{address, Code::kRegionIsNotAvailable};
+  }
+
+  const std::uintptr_t begin{address & ~(kPageSize - 1u)};
+  const std::uintptr_t end{(address + size + kPageSize - 1u) & ~(kPageSize - 1u)};
+
+  if (!setProtectionLevel(begin, end - begin,
+    MemoryProtection::kPageExecuteReadWrite,
+    m_protectionLevel))
+  {
+    throw Exception{address, Code::kVirtualProtectFailed};
+  }
+
+  m_begin = begin;
+  m_end = end;
+}
+
+void BatchedProtectionRemover::Restore()
+{
+  if (m_begin != m_end)
+  {
+    setProtectionLevel(
+      m_begin, m_end - m_begin,
+      m_protectionLevel,
+      m_protectionLevel);
+
+    flushInstructionCache(m_begin, m_end - m_begin);
+
+    m_begin = m_end = 0u;
+  }
+}
+
 void flushInstructionCache(
   const std::uintptr_t address, 
   const std::size_t size)
@@ -43,6 +204,11 @@ void flushInstructionCache(
     size);
 }
 
+void synchronizeProcessors()
+{
+  ::FlushProcessWriteBuffers();
+}
+
 bool isRegionAvailable(const std::uintptr_t address)
 {
   ::MEMORY_BASIC_INFORMATION mbi{};
@@ -70,12 +236,107 @@ bool setProtectionLevel(
     reinterpret_cast<::PDWORD>(&previous));
 }
 
+std::size_t getReadableSize(
+  const std::uintptr_t address,
+  const std::size_t size)
+{
+  std::size_t readable{0u};
+
+  while (readable < size)
+  {
+    ::MEMORY_BASIC_INFORMATION mbi{};
+    void* pointer{reinterpret_cast<void*>(address + readable)};
+
+    if (0u == ::VirtualQuery(pointer, &mbi, sizeof(mbi))) {
+      break;
+    }
+
+    if (mbi.State != MEM_COMMIT
+      || 0u != (mbi.Protect & PAGE_GUARD)
+      || 0u == (mbi.Protect & kReadableFlags))
+    {
+      break;
+    }
+
+    readable = reinterpret_cast<std::uintptr_t>(mbi.BaseAddress)
+      + mbi.RegionSize - address;
+  }
+
+  return readable < size ? readable : size;
+}
+
+bool isEqual(
+  const std::uintptr_t address,
+  const void* bytes,
+  const std::size_t size)
+{
+  if (getReadableSize(address, size) != size) {
+    return false;
+  }
+
+  const std::uint8_t* left{reinterpret_cast<const std::uint8_t*>(address)};
+  const std::uint8_t* right{static_cast<const std::uint8_t*>(bytes)};
+  std::size_t i{0u};
+
+  for (; i + 16u <= size; i += 16u)
+  {
+    const __m128i equal{_mm_cmpeq_epi8(
+      _mm_loadu_si128(reinterpret_cast<const __m128i*>(left + i)),
+      _mm_loadu_si128(reinterpret_cast<const __m128i*>(right + i)))};
+
+    if (0xFFFF != _mm_movemask_epi8(equal)) {
+      return false;
+    }
+  }
+
+  return 0 == std::memcmp(left + i, right + i, size - i);
+}
+
+bool getReadableRegion(
+  const std::uintptr_t address,
+  std::uintptr_t& begin,
+  std::uintptr_t& end)
+{
+  ::MEMORY_BASIC_INFORMATION mbi{};
+  void* pointer{reinterpret_cast<void*>(address)};
+
+  if (0u == ::VirtualQuery(pointer, &mbi, sizeof(mbi))
+    || mbi.State != MEM_COMMIT
+    || 0u != (mbi.Protect & PAGE_GUARD)
+    || 0u == (mbi.Protect & kReadableFlags))
+  {
+    return false;
+  }
+
+  begin = reinterpret_cast<std::uintptr_t>(mbi.BaseAddress);
+  end = begin + mbi.RegionSize;
+
+  return true;
+}
+
+std::size_t ReadString(
+  const std::uintptr_t address,
+  char* buffer,
+  const std::size_t maxLen)
+{
+  return readString(address, buffer, maxLen);
+}
+
+std::size_t ReadString(
+  const std::uintptr_t address,
+  wchar_t* buffer,
+  const std::size_t maxLen)
+{
+  return readString(address, buffer, maxLen);
+}
+
 void Set(
   const std::uintptr_t address, 
   const std::int32_t value, 
   const std::size_t size)
 {
   ScopedProtectionRemover instance{address, size};
+  detail::journalRange(address, size);
   std::memset(reinterpret_cast<void*>(address), value, size);
   flushInstructionCache(address, size);
 }
@@ -102,5 +363,21 @@ void Nop(
   Nop(reinterpret_cast<std::uintptr_t>(pointer), size);
 }
 
+std::size_t ReadString(
+  const void* pointer,
+  char* buffer,
+  const std::size_t maxLen)
+{
+  return ReadString(reinterpret_cast<std::uintptr_t>(pointer), buffer, maxLen);
+}
+
+std::size_t ReadString(
+  const void* pointer,
+  wchar_t* buffer,
+  const std::size_t maxLen)
+{
+  return ReadString(reinterpret_cast<std::uintptr_t>(pointer), buffer, maxLen);
+}
+
 } // namespace rwe
 } // namepace llmo
@@ -0,0 +1,252 @@
+#include "../include/xref.hpp"
+
+#include <algorithm> // std::sort, std::lower_bound
+#include <cstring> // std::memcpy
+
+#include <emmintrin.h> // SSE2
+
+#include "../include/detail.hpp"
+#include "../include/disasm.hpp"
+#include "../include/module.hpp"
+#include "../include/rwe.hpp"
+
+namespace llmo {
+namespace xref {
+
+namespace {
+
+constexpr std::uint8_t kCallRel32{0xE8u};
+constexpr std::uint8_t kJmpRel32{0xE9u};
+constexpr std::uint8_t kTwoByteEscape{0x0Fu};
+
+// mod 00, rm 101, any reg.
+constexpr std::uint8_t kRipModrmMask{0xC7u};
+constexpr std::uint8_t kRipModrm{0x05u};
+
+bool isCandidate(const std::uint8_t value)
+{
+#if defined(_M_X64) || defined(__x86_64__)
+  if (kRipModrm == (value & kRipModrmMask)) {
+    return true;
+  }
+#endif
+
+  return kCallRel32 == value || kJmpRel32 == value || kTwoByteEscape == value;
+}
+
+// Movemask of the bytes isCandidate accepts.
+unsigned getCandidateMask(const __m128i block)
+{
+  __m128i mask{_mm_or_si128(_mm_or_si128(
+    _mm_cmpeq_epi8(block, _mm_set1_epi8(static_cast<char>(kCallRel32))),
+    _mm_cmpeq_epi8(block, _mm_set1_epi8(static_cast<char>(kJmpRel32)))),
+    _mm_cmpeq_epi8(block, _mm_set1_epi8(static_cast<char>(kTwoByteEscape))))};
+
+#if defined(_M_X64) || defined(__x86_64__)
+  mask = _mm_or_si128(mask, _mm_cmpeq_epi8(
+    _mm_and_si128(block, _mm_set1_epi8(static_cast<char>(kRipModrmMask))),
+    _mm_set1_epi8(static_cast<char>(kRipModrm))));
+#endif
+
+  return static_cast<unsigned>(_mm_movemask_epi8(mask));
+}
+
+std::int32_t readInt32(const std::uint8_t* pointer)
+{
+  std::int32_t value{};
+  std::memcpy(&value, pointer, sizeof(value));
+  return value;
+}
+
+// Collects references of the section, decoding each instruction
+// which contains a candidate byte once.
+class SectionScanner
+{
+public:
+  SectionScanner(
+    const module::Section& section,
+    const disasm::BoundaryIndex& boundaries,
+    std::vector<Reference>& references) :
+    m_code(reinterpret_cast<const std::uint8_t*>(section.address)),
+    m_address(section.address), m_size(section.size),
+    m_boundaries(boundaries), m_references(references) {}
+
+  void Scan()
+  {
+    std::size_t i{0u};
+
+    for (; i + 16u <= m_size; i += 16u)
+    {
+      unsigned mask{getCandidateMask(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(m_code + i)))};
+
+      while (0u != mask)
+      {
+        check(i + detail::countTrailingZeros(mask));
+        mask &= mask - 1u;
+      }
+    }
+
+    for (; i < m_size; ++i)
+    {
+      if (isCandidate(m_code[i])) {
+        check(i);
+      }
+    }
+  }
+
+private:
+  void check(const std::size_t offset)
+  {
+    const std::uintptr_t address{m_address + offset};
+    const std::uintptr_t source{m_boundaries.isBoundary(address)
+      ? address : m_boundaries.getPrevious(address)};
+
+    if (source < m_address || source == m_lastSource) {
+      return;
+    }
+
+    m_lastSource = source;
+
+    const std::size_t start{source - m_address};
+
+    disasm::Record record{};
+    disasm::DecodeBatch(m_code + start, m_size - start, &record, 1u);
+
+    // The last instruction may be cut by the end of the section.
+    if (0u != (record.flags & disasm::Record::kError)
+      || record.length > m_size - start || start + record.length <= offset)
+    {
+      return;
+    }
+
+    const std::uint8_t* end{m_code + start + record.length};
+    const std::uintptr_t next{source + record.length};
+
+    Reference reference{source, 0u, Kind::kCall, record.length};
+
+    if (0u != (record.flags & disasm::Record::kRelative) && 4u == record.getImmediateSize())
+    {
+      if (0u != (record.flags & disasm::Record::kTwoByte)) {
+        reference.kind = Kind::kConditionalJump;
+      }
+      else if (kCallRel32 == record.opcode) {
+        reference.kind = Kind::kCall;
+      }
+      else if (kJmpRel32 == record.opcode) {
+        reference.kind = Kind::kJump;
+      }
+      else {
+        return;
+      }
+
+      reference.target = next + static_cast<std::uintptr_t>(
+        static_cast<std::intptr_t>(readInt32(end - 4)));
+    }
+    else if (0u != (record.flags & disasm::Record::kRipRelative))
+    {
+      reference.kind = Kind::kRipRelative;
+      reference.target = next + static_cast<std::uintptr_t>(
+        static_cast<std::intptr_t>(readInt32(end - record.getImmediateSize() - 4)));
+    }
+    else {
+      return;
+    }
+
+    m_references.push_back(reference);
+  }
+
+  const std::uint8_t* m_code;
+  std::uintptr_t m_address;
+  std::size_t m_size;
+  const disasm::BoundaryIndex& m_boundaries;
+  std::vector<Reference>& m_references;
+  std::uintptr_t m_lastSource{0u};
+};
+
+} // namespace
+
+Index::Index(
+  const std::uintptr_t module,
+  const disasm::BoundaryIndex* boundaries)
+{
+  disasm::BoundaryIndex ownBoundaries{};
+
+  if (nullptr == boundaries)
+  {
+    ownBoundaries = disasm::BoundaryIndex{module};
+    boundaries = &ownBoundaries;
+  }
+
+  for (const module::Section& section : module::getSections(module))
+  {
+    const std::size_t size{rwe::getReadableSize(section.address, section.size)};
+
+    if (section.isExecutable() && 0u != size)
+    {
+      SectionScanner{module::Section{section.address, size, section.characteristics},
+        *boundaries, m_references}.Scan();
+    }
+  }
+
+  std::sort(m_references.begin(), m_references.end(),
+    [](const Reference& left, const Reference& right)
+    {
+      if (left.target != right.target) {
+        return left.target < right.target;
+      }
+
+      return left.source < right.source;
+    });
+}
+
+References Index::getReferencesTo(const std::uintptr_t target) const
+{
+  return getReferencesTo(target, target + 1u);
+}
+
+References Index::getReferencesTo(
+  const std::uintptr_t begin,
+  const std::uintptr_t end) const
+{
+  const auto isBefore = [](const Reference& reference, const std::uintptr_t target) {
+    return reference.target < target;
+  };
+
+  const Reference* first{std::lower_bound(m_references.data(),
+    m_references.data() + m_references.size(), begin, isBefore)};
+
+  const Reference* last{std::lower_bound(first,
+    m_references.data() + m_references.size(), end, isBefore)};
+
+  return References{first, last};
+}
+
+std::vector<std::uintptr_t> Index::getCallers(const std::uintptr_t target) const
+{
+  std::vector<std::uintptr_t> callers{};
+
+  for (const Reference& reference : getReferencesTo(target))
+  {
+    if (Kind::kCall == reference.kind) {
+      callers.push_back(reference.source);
+    }
+  }
+
+  return callers;
+}
+
+bool Index::isBranchTarget(const std::uintptr_t address) const
+{
+  for (const Reference& reference : getReferencesTo(address))
+  {
+    if (Kind::kRipRelative != reference.kind) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+} // namespace xref
+} // namespace llmo
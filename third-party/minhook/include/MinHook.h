@@ -83,6 +83,26 @@ typedef enum MH_STATUS
 }
 MH_STATUS;
 
+// How MH_EnableHook, MH_DisableHook and MH_ApplyQueued write the patches.
+typedef enum MH_PATCH_MODE
+{
+    // Suspends all other threads and moves their instruction pointers
+    // out of the patched bytes. The default.
+    MH_PATCH_MODE_FREEZE = 0,
+
+    // Writes int3 over the first byte, then the rest, then the first byte,
+    // with a cross-processor sync after each step, and sends threads which
+    // hit the int3 to the detour or the trampoline. Other threads keep running.
+    // Used for hooks whose patch covers one instruction of the target,
+    // others are still frozen. MH_RemoveHook always freezes, since threads
+    // have to leave the trampoline before it's freed. MH_ApplyQueued and
+    // MH_EnableHook or MH_DisableHook with MH_ALL_HOOKS patch live only when
+    // a single hook changes, more hooks are changed under one freeze, so no
+    // thread sees them half-applied.
+    MH_PATCH_MODE_BREAKPOINT
+}
+MH_PATCH_MODE;
+
 // Can be passed as a parameter to MH_EnableHook, MH_DisableHook,
 // MH_QueueEnableHook or MH_QueueDisableHook.
 #define MH_ALL_HOOKS NULL
@@ -175,8 +195,22 @@ extern "C" {
     MH_STATUS WINAPI MH_QueueDisableHook(LPVOID pTarget);
 
     // Applies all queued changes in one go.
+    // Either all of them are applied or none, the queue is dropped then.
     MH_STATUS WINAPI MH_ApplyQueued(VOID);
 
+    // Retrieves whether an already created hook is enabled.
+    // Lookups like this one don't wait for each other, only for changes.
+    // Parameters:
+    //   pTarget    [in]  A pointer to the target function.
+    //   pIsEnabled [out] TRUE if the hook is enabled. This parameter can be NULL.
+    MH_STATUS WINAPI MH_IsHookEnabled(LPVOID pTarget, BOOL *pIsEnabled);
+
+    // Selects how hooks are enabled and disabled from now on.
+    // Parameters:
+    //   mode [in] MH_PATCH_MODE_FREEZE or MH_PATCH_MODE_BREAKPOINT.
+    //             Other values select MH_PATCH_MODE_FREEZE.
+    MH_STATUS WINAPI MH_SetPatchMode(MH_PATCH_MODE mode);
+
     // Translates the MH_STATUS to its name as a string.
     const char * WINAPI MH_StatusToString(MH_STATUS status);
 
@@ -57,13 +57,25 @@ typedef struct _MEMORY_SLOT
 #endif
 
 // Memory block info. Placed at the head of each block.
+// With MH_DUAL_MAPPED_BUFFER, the block is mapped twice and the info is placed
+// at the head of the writable view, slots are executed from the other view.
 typedef struct _MEMORY_BLOCK
 {
     struct _MEMORY_BLOCK *pNext;
     PMEMORY_SLOT pFree;         // First element of the free slot list.
     UINT usedCount;
+#ifdef MH_DUAL_MAPPED_BUFFER
+    LPBYTE pExecutable;         // Executable view of the block.
+#endif
 } MEMORY_BLOCK, *PMEMORY_BLOCK;
 
+// Address the slots of the block are executed at.
+#ifdef MH_DUAL_MAPPED_BUFFER
+    #define BLOCK_EXECUTABLE(pBlock) ((ULONG_PTR)(pBlock)->pExecutable)
+#else
+    #define BLOCK_EXECUTABLE(pBlock) ((ULONG_PTR)(pBlock))
+#endif
+
 //-------------------------------------------------------------------------
 // Global Variables:
 //-------------------------------------------------------------------------
@@ -71,6 +83,10 @@ typedef struct _MEMORY_BLOCK
 // First element of the memory block list.
 PMEMORY_BLOCK g_pMemoryBlocks;
 
+// Guards the block list. MH_CreateHook() allocates and builds trampolines
+// under the shared hook lock, so several threads may be in here at once.
+SRWLOCK g_bufferLock = SRWLOCK_INIT;
+
 //-------------------------------------------------------------------------
 VOID InitializeBuffer(VOID)
 {
@@ -80,20 +96,72 @@ VOID InitializeBuffer(VOID)
 //-------------------------------------------------------------------------
 VOID UninitializeBuffer(VOID)
 {
-    PMEMORY_BLOCK pBlock = g_pMemoryBlocks;
+    PMEMORY_BLOCK pBlock;
+
+    AcquireSRWLockExclusive(&g_bufferLock);
+    pBlock = g_pMemoryBlocks;
     g_pMemoryBlocks = NULL;
+    ReleaseSRWLockExclusive(&g_bufferLock);
 
     while (pBlock)
     {
         PMEMORY_BLOCK pNext = pBlock->pNext;
+#ifdef MH_DUAL_MAPPED_BUFFER
+        UnmapViewOfFile(pBlock->pExecutable);
+        UnmapViewOfFile(pBlock);
+#else
         VirtualFree(pBlock, 0, MEM_RELEASE);
+#endif
         pBlock = pNext;
     }
 }
 
+//-------------------------------------------------------------------------
+LPVOID MapDualView(LPVOID pAddress, SIZE_T size, LPVOID *ppWritable)
+{
+    LPVOID pExecutable = NULL;
+    HANDLE hSection = CreateFileMappingW(
+        INVALID_HANDLE_VALUE, NULL, PAGE_EXECUTE_READWRITE | SEC_COMMIT, 0, (DWORD)size, NULL);
+    if (hSection == NULL)
+        return NULL;
+
+    pExecutable = MapViewOfFileEx(hSection, FILE_MAP_READ | FILE_MAP_EXECUTE, 0, 0, size, pAddress);
+    if (pExecutable != NULL)
+    {
+        *ppWritable = MapViewOfFile(hSection, FILE_MAP_WRITE, 0, 0, size);
+        if (*ppWritable == NULL)
+        {
+            UnmapViewOfFile(pExecutable);
+            pExecutable = NULL;
+        }
+    }
+
+    // The views keep the section alive.
+    CloseHandle(hSection);
+
+    return pExecutable;
+}
+
+//-------------------------------------------------------------------------
+static PMEMORY_BLOCK AllocateBlock(LPVOID pAddress)
+{
+#ifdef MH_DUAL_MAPPED_BUFFER
+    PMEMORY_BLOCK pBlock = NULL;
+    LPVOID pExecutable = MapDualView(pAddress, MEMORY_BLOCK_SIZE, (LPVOID *)&pBlock);
+    if (pExecutable == NULL)
+        return NULL;
+
+    pBlock->pExecutable = (LPBYTE)pExecutable;
+    return pBlock;
+#else
+    return (PMEMORY_BLOCK)VirtualAlloc(
+        pAddress, MEMORY_BLOCK_SIZE, MEM_COMMIT | MEM_RESERVE, PAGE_EXECUTE_READWRITE);
+#endif
+}
+
 //-------------------------------------------------------------------------
 #if defined(_M_X64) || defined(__x86_64__)
-static LPVOID FindPrevFreeRegion(LPVOID pAddress, LPVOID pMinAddr, DWORD dwAllocationGranularity)
+LPVOID FindPrevFreeRegion(LPVOID pAddress, LPVOID pMinAddr, DWORD dwAllocationGranularity)
 {
     ULONG_PTR tryAddr = (ULONG_PTR)pAddress;
 
@@ -124,7 +192,7 @@ static LPVOID FindPrevFreeRegion(LPVOID pAddress, LPVOID pMinAddr, DWORD dwAlloc
 
 //-------------------------------------------------------------------------
 #if defined(_M_X64) || defined(__x86_64__)
-static LPVOID FindNextFreeRegion(LPVOID pAddress, LPVOID pMaxAddr, DWORD dwAllocationGranularity)
+LPVOID FindNextFreeRegion(LPVOID pAddress, LPVOID pMaxAddr, DWORD dwAllocationGranularity)
 {
     ULONG_PTR tryAddr = (ULONG_PTR)pAddress;
 
@@ -185,7 +253,7 @@ static PMEMORY_BLOCK GetMemoryBlock(LPVOID pOrigin)
     {
 #if defined(_M_X64) || defined(__x86_64__)
         // Ignore the blocks too far.
-        if ((ULONG_PTR)pBlock < minAddr || (ULONG_PTR)pBlock >= maxAddr)
+        if (BLOCK_EXECUTABLE(pBlock) < minAddr || BLOCK_EXECUTABLE(pBlock) >= maxAddr)
             continue;
 #endif
         // The block has at least one unused slot.
@@ -203,8 +271,7 @@ static PMEMORY_BLOCK GetMemoryBlock(LPVOID pOrigin)
             if (pAlloc == NULL)
                 break;
 
-            pBlock = (PMEMORY_BLOCK)VirtualAlloc(
-                pAlloc, MEMORY_BLOCK_SIZE, MEM_COMMIT | MEM_RESERVE, PAGE_EXECUTE_READWRITE);
+            pBlock = AllocateBlock(pAlloc);
             if (pBlock != NULL)
                 break;
         }
@@ -220,16 +287,14 @@ static PMEMORY_BLOCK GetMemoryBlock(LPVOID pOrigin)
             if (pAlloc == NULL)
                 break;
 
-            pBlock = (PMEMORY_BLOCK)VirtualAlloc(
-                pAlloc, MEMORY_BLOCK_SIZE, MEM_COMMIT | MEM_RESERVE, PAGE_EXECUTE_READWRITE);
+            pBlock = AllocateBlock(pAlloc);
             if (pBlock != NULL)
                 break;
         }
     }
 #else
     // In x86 mode, a memory block can be placed anywhere.
-    pBlock = (PMEMORY_BLOCK)VirtualAlloc(
-        NULL, MEMORY_BLOCK_SIZE, MEM_COMMIT | MEM_RESERVE, PAGE_EXECUTE_READWRITE);
+    pBlock = AllocateBlock(NULL);
 #endif
 
     if (pBlock != NULL)
@@ -256,33 +321,73 @@ static PMEMORY_BLOCK GetMemoryBlock(LPVOID pOrigin)
 LPVOID AllocateBuffer(LPVOID pOrigin)
 {
     PMEMORY_SLOT  pSlot;
-    PMEMORY_BLOCK pBlock = GetMemoryBlock(pOrigin);
-    if (pBlock == NULL)
-        return NULL;
+    PMEMORY_BLOCK pBlock;
+    LPVOID        pBuffer = NULL;
+
+    AcquireSRWLockExclusive(&g_bufferLock);
 
-    // Remove an unused slot from the list.
-    pSlot = pBlock->pFree;
-    pBlock->pFree = pSlot->pNext;
-    pBlock->usedCount++;
+    pBlock = GetMemoryBlock(pOrigin);
+    if (pBlock != NULL)
+    {
+        // Remove an unused slot from the list.
+        pSlot = pBlock->pFree;
+        pBlock->pFree = pSlot->pNext;
+        pBlock->usedCount++;
 #ifdef _DEBUG
-    // Fill the slot with INT3 for debugging.
-    memset(pSlot, 0xCC, sizeof(MEMORY_SLOT));
+        // Fill the slot with INT3 for debugging.
+        memset(pSlot, 0xCC, sizeof(MEMORY_SLOT));
+#endif
+        pBuffer = (LPVOID)(BLOCK_EXECUTABLE(pBlock) + ((ULONG_PTR)pSlot - (ULONG_PTR)pBlock));
+    }
+
+    ReleaseSRWLockExclusive(&g_bufferLock);
+
+    return pBuffer;
+}
+
+//-------------------------------------------------------------------------
+LPVOID GetWritableBuffer(LPVOID pBuffer)
+{
+#ifdef MH_DUAL_MAPPED_BUFFER
+    PMEMORY_BLOCK pBlock;
+    LPVOID pWritable = NULL;
+    ULONG_PTR pTargetBlock = ((ULONG_PTR)pBuffer / MEMORY_BLOCK_SIZE) * MEMORY_BLOCK_SIZE;
+
+    AcquireSRWLockShared(&g_bufferLock);
+
+    for (pBlock = g_pMemoryBlocks; pBlock != NULL; pBlock = pBlock->pNext)
+    {
+        if (BLOCK_EXECUTABLE(pBlock) == pTargetBlock)
+        {
+            pWritable = (LPBYTE)pBlock + ((ULONG_PTR)pBuffer - pTargetBlock);
+            break;
+        }
+    }
+
+    ReleaseSRWLockShared(&g_bufferLock);
+
+    return pWritable;
+#else
+    return pBuffer;
 #endif
-    return pSlot;
 }
 
 //-------------------------------------------------------------------------
 VOID FreeBuffer(LPVOID pBuffer)
 {
-    PMEMORY_BLOCK pBlock = g_pMemoryBlocks;
+    PMEMORY_BLOCK pBlock;
     PMEMORY_BLOCK pPrev = NULL;
     ULONG_PTR pTargetBlock = ((ULONG_PTR)pBuffer / MEMORY_BLOCK_SIZE) * MEMORY_BLOCK_SIZE;
 
+    AcquireSRWLockExclusive(&g_bufferLock);
+
+    pBlock = g_pMemoryBlocks;
+
     while (pBlock != NULL)
     {
-        if ((ULONG_PTR)pBlock == pTargetBlock)
+        if (BLOCK_EXECUTABLE(pBlock) == pTargetBlock)
         {
-            PMEMORY_SLOT pSlot = (PMEMORY_SLOT)pBuffer;
+            PMEMORY_SLOT pSlot = (PMEMORY_SLOT)((LPBYTE)pBlock + ((ULONG_PTR)pBuffer - pTargetBlock));
 #ifdef _DEBUG
             // Clear the released slot for debugging.
             memset(pSlot, 0x00, sizeof(MEMORY_SLOT));
@@ -300,7 +405,12 @@ VOID FreeBuffer(LPVOID pBuffer)
                 else
                     g_pMemoryBlocks = pBlock->pNext;
 
+#ifdef MH_DUAL_MAPPED_BUFFER
+                UnmapViewOfFile(pBlock->pExecutable);
+                UnmapViewOfFile(pBlock);
+#else
                 VirtualFree(pBlock, 0, MEM_RELEASE);
+#endif
             }
 
             break;
@@ -309,6 +419,8 @@ VOID FreeBuffer(LPVOID pBuffer)
         pPrev = pBlock;
         pBlock = pBlock->pNext;
     }
+
+    ReleaseSRWLockExclusive(&g_bufferLock);
 }
 
 //-------------------------------------------------------------------------
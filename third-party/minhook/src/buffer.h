@@ -35,8 +35,31 @@
     #define MEMORY_SLOT_SIZE 32
 #endif
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 VOID   InitializeBuffer(VOID);
 VOID   UninitializeBuffer(VOID);
 LPVOID AllocateBuffer(LPVOID pOrigin);
 VOID   FreeBuffer(LPVOID pBuffer);
 BOOL   IsExecutableAddress(LPVOID pAddress);
+
+// Returns the address the buffer should be written at.
+// Differs from pBuffer only with MH_DUAL_MAPPED_BUFFER, where the buffers
+// are executable but not writable and the writes go to another view.
+LPVOID GetWritableBuffer(LPVOID pBuffer);
+
+// Maps a new section twice: executable view at pAddress (anywhere if NULL)
+// and writable view at *ppWritable. Returns the executable view or NULL.
+LPVOID MapDualView(LPVOID pAddress, SIZE_T size, LPVOID *ppWritable);
+
+#if defined(_M_X64) || defined(__x86_64__)
+// Find a free region of the allocation granularity below/above pAddress.
+LPVOID FindPrevFreeRegion(LPVOID pAddress, LPVOID pMinAddr, DWORD dwAllocationGranularity);
+LPVOID FindNextFreeRegion(LPVOID pAddress, LPVOID pMaxAddr, DWORD dwAllocationGranularity);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
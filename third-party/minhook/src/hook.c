@@ -41,9 +41,12 @@
 // Initial capacity of the HOOK_ENTRY buffer.
 #define INITIAL_HOOK_CAPACITY   32
 
-// Initial capacity of the thread IDs buffer.
+// Initial capacity of the thread handles buffer.
 #define INITIAL_THREAD_CAPACITY 128
 
+// NTSTATUS of NtGetNextThread when all threads are enumerated.
+#define STATUS_NO_MORE_ENTRIES ((LONG)0x8000001A)
+
 // Special hook position values.
 #define INVALID_HOOK_POS UINT_MAX
 #define ALL_HOOKS_POS    UINT_MAX
@@ -53,6 +56,9 @@
 #define ACTION_ENABLE       1
 #define ACTION_APPLY_QUEUED 2
 
+// Opcode written over the first byte of a patch by WriteHookPatchLive().
+#define INT3_OPCODE 0xCC
+
 // Thread access rights for suspending/resuming threads.
 #define THREAD_ACCESS \
     (THREAD_SUSPEND_RESUME | THREAD_GET_CONTEXT | THREAD_QUERY_INFORMATION | THREAD_SET_CONTEXT)
@@ -77,21 +83,67 @@ typedef struct _HOOK_ENTRY
 // Suspended threads for Freeze()/Unfreeze().
 typedef struct _FROZEN_THREADS
 {
-    LPDWORD pItems;         // Data heap
-    UINT    capacity;       // Size of allocated data heap, items
-    UINT    size;           // Actual number of data items
+    LPHANDLE pItems;        // Data heap, handles opened with THREAD_ACCESS
+    UINT     capacity;      // Size of allocated data heap, items
+    UINT     size;          // Actual number of data items
 } FROZEN_THREADS, *PFROZEN_THREADS;
 
+// Patch range of a queued hook for MH_ApplyQueued().
+typedef struct _QUEUED_PATCH
+{
+    LPBYTE pTarget;         // Beginning of the patch, above the target with patchAbove
+    SIZE_T size;
+    DWORD  oldProtect;
+    UINT   pos;             // Position of the hook entry
+} QUEUED_PATCH, *PQUEUED_PATCH;
+
+// ntdll!NtGetNextThread, Vista and later. Opens the threads of a process
+// one by one, without a system-wide snapshot.
+typedef LONG (NTAPI *NT_GET_NEXT_THREAD)(
+    HANDLE ProcessHandle, HANDLE ThreadHandle, ACCESS_MASK DesiredAccess,
+    ULONG HandleAttributes, ULONG Flags, PHANDLE NewThreadHandle);
+
 //-------------------------------------------------------------------------
 // Global Variables:
 //-------------------------------------------------------------------------
 
-// Spin lock flag for EnterSpinLock()/LeaveSpinLock().
-volatile LONG g_isLocked = FALSE;
+// Reader-writer lock for EnterLock()/EnterSharedLock(). Waiting threads
+// sleep on a keyed event until it's released instead of polling.
+// SRWLOCK makes Vista the minimum, unlike NtGetNextThread, which is optional.
+SRWLOCK g_lock = SRWLOCK_INIT;
 
 // Private heap handle. If not NULL, this library is initialized.
 HANDLE g_hHeap = NULL;
 
+// Incremented by MH_Uninitialize(), so MH_CreateHook() can tell its buffer
+// was freed while it wasn't holding the lock.
+UINT g_generation = 0;
+
+// NULL if ntdll doesn't export it, threads are enumerated by Toolhelp then.
+NT_GET_NEXT_THREAD g_pNtGetNextThread = NULL;
+
+// How hooks are enabled and disabled, see MH_SetPatchMode().
+MH_PATCH_MODE g_patchMode = MH_PATCH_MODE_FREEZE;
+
+// Handle of BreakpointHandler(), registered while the library is initialized.
+PVOID g_hBreakpointHandler = NULL;
+
+// Patch of WriteHookPatchLive() in progress, read by BreakpointHandler()
+// without the lock. The sequence is odd while the rest is being changed.
+struct
+{
+    volatile LONG   sequence;
+    LPVOID volatile pTarget;        // First byte of the patch, holds int3 meanwhile
+    LPVOID volatile pDestination;   // Where threads which hit the int3 go
+} g_livePatch;
+
+// Targets recently patched by WriteHookPatchLive(), in a ring. A thread which
+// hit the int3 may reach BreakpointHandler() after g_livePatch is cleared,
+// the handler only resumes such threads at these addresses.
+#define LIVE_PATCH_HISTORY 16
+LPVOID volatile g_livePatchHistory[LIVE_PATCH_HISTORY];
+UINT g_livePatchHistoryPos = 0;
+
 // Hook entries.
 struct
 {
@@ -100,25 +152,117 @@ struct
     UINT        size;       // Actual number of data items
 } g_hooks;
 
+// Open-addressed index of g_hooks by target, with linear probing.
+// Has twice the capacity of g_hooks, so it's at most half full.
+struct
+{
+    PUINT pSlots;           // Hook position + 1, 0 if empty
+    UINT  capacity;         // Power of two
+    UINT  shift;            // 32 - log2(capacity)
+} g_hookIndex;
+
+//-------------------------------------------------------------------------
+// Fibonacci hashing, the high bits are taken since functions are aligned.
+static UINT GetHomeSlot(LPVOID pTarget)
+{
+    ULONG_PTR value = (ULONG_PTR)pTarget;
+#if defined(_M_X64) || defined(__x86_64__)
+    value ^= value >> 32;
+#endif
+    return (UINT)(((UINT32)value * 2654435761u) >> g_hookIndex.shift);
+}
+
+//-------------------------------------------------------------------------
+// Returns the slot which holds the target or the empty one it should take.
+static UINT FindHookSlot(LPVOID pTarget)
+{
+    UINT mask = g_hookIndex.capacity - 1;
+    UINT slot = GetHomeSlot(pTarget);
+
+    while (g_hookIndex.pSlots[slot] != 0
+        && (ULONG_PTR)g_hooks.pItems[g_hookIndex.pSlots[slot] - 1].pTarget != (ULONG_PTR)pTarget)
+    {
+        slot = (slot + 1) & mask;
+    }
+
+    return slot;
+}
+
 //-------------------------------------------------------------------------
 // Returns INVALID_HOOK_POS if not found.
 static UINT FindHookEntry(LPVOID pTarget)
 {
+    if (g_hookIndex.pSlots == NULL)
+        return INVALID_HOOK_POS;
+
+    return g_hookIndex.pSlots[FindHookSlot(pTarget)] - 1;
+}
+
+//-------------------------------------------------------------------------
+// Replaces the index with an empty one for the given capacity of g_hooks
+// and inserts the current entries.
+static BOOL RebuildHookIndex(UINT hookCapacity)
+{
+    UINT capacity = hookCapacity * 2;
+    UINT shift = 32;
     UINT i;
+
+    PUINT pSlots = (PUINT)HeapAlloc(g_hHeap, HEAP_ZERO_MEMORY, capacity * sizeof(UINT));
+    if (pSlots == NULL)
+        return FALSE;
+
+    while ((1u << (32 - shift)) < capacity)
+        --shift;
+
+    if (g_hookIndex.pSlots != NULL)
+        HeapFree(g_hHeap, 0, g_hookIndex.pSlots);
+
+    g_hookIndex.pSlots   = pSlots;
+    g_hookIndex.capacity = capacity;
+    g_hookIndex.shift    = shift;
+
     for (i = 0; i < g_hooks.size; ++i)
+        g_hookIndex.pSlots[FindHookSlot(g_hooks.pItems[i].pTarget)] = i + 1;
+
+    return TRUE;
+}
+
+//-------------------------------------------------------------------------
+// Removes the slot, moving later entries of its probe run back,
+// so lookups don't need tombstones.
+static VOID DeleteHookSlot(UINT slot)
+{
+    UINT mask = g_hookIndex.capacity - 1;
+    UINT next = (slot + 1) & mask;
+
+    while (g_hookIndex.pSlots[next] != 0)
     {
-        if ((ULONG_PTR)pTarget == (ULONG_PTR)g_hooks.pItems[i].pTarget)
-            return i;
+        UINT home = GetHomeSlot(g_hooks.pItems[g_hookIndex.pSlots[next] - 1].pTarget);
+
+        // Moved if its home isn't cyclically in (slot, next].
+        if (((next - home) & mask) >= ((next - slot) & mask))
+        {
+            g_hookIndex.pSlots[slot] = g_hookIndex.pSlots[next];
+            slot = next;
+        }
+
+        next = (next + 1) & mask;
     }
 
-    return INVALID_HOOK_POS;
+    g_hookIndex.pSlots[slot] = 0;
 }
 
 //-------------------------------------------------------------------------
-static PHOOK_ENTRY AddHookEntry()
+// The target should not be added yet.
+static PHOOK_ENTRY AddHookEntry(LPVOID pTarget)
 {
+    PHOOK_ENTRY pHook;
+
     if (g_hooks.pItems == NULL)
     {
+        if (!RebuildHookIndex(INITIAL_HOOK_CAPACITY))
+            return NULL;
+
         g_hooks.capacity = INITIAL_HOOK_CAPACITY;
         g_hooks.pItems = (PHOOK_ENTRY)HeapAlloc(
             g_hHeap, 0, g_hooks.capacity * sizeof(HOOK_ENTRY));
@@ -132,22 +276,38 @@ static PHOOK_ENTRY AddHookEntry()
         if (p == NULL)
             return NULL;
 
-        g_hooks.capacity *= 2;
         g_hooks.pItems = p;
+
+        if (!RebuildHookIndex(g_hooks.capacity * 2))
+            return NULL;
+
+        g_hooks.capacity *= 2;
     }
 
-    return &g_hooks.pItems[g_hooks.size++];
+    pHook = &g_hooks.pItems[g_hooks.size];
+    pHook->pTarget = pTarget;
+    g_hookIndex.pSlots[FindHookSlot(pTarget)] = ++g_hooks.size;
+
+    return pHook;
 }
 
 //-------------------------------------------------------------------------
+// Moves the last entry into the position.
 static VOID DeleteHookEntry(UINT pos)
 {
+    DeleteHookSlot(FindHookSlot(g_hooks.pItems[pos].pTarget));
+
     if (pos < g_hooks.size - 1)
+    {
         g_hooks.pItems[pos] = g_hooks.pItems[g_hooks.size - 1];
+        g_hookIndex.pSlots[FindHookSlot(g_hooks.pItems[pos].pTarget)] = pos + 1;
+    }
 
     g_hooks.size--;
 
-    if (g_hooks.capacity / 2 >= INITIAL_HOOK_CAPACITY && g_hooks.capacity / 2 >= g_hooks.size)
+    // Shrinks at a quarter, so creating and removing one hook
+    // at the boundary doesn't reallocate each time.
+    if (g_hooks.capacity / 2 >= INITIAL_HOOK_CAPACITY && g_hooks.capacity / 4 >= g_hooks.size)
     {
         PHOOK_ENTRY p = (PHOOK_ENTRY)HeapReAlloc(
             g_hHeap, 0, g_hooks.pItems, (g_hooks.capacity / 2) * sizeof(HOOK_ENTRY));
@@ -156,6 +316,9 @@ static VOID DeleteHookEntry(UINT pos)
 
         g_hooks.capacity /= 2;
         g_hooks.pItems = p;
+
+        // The old index is larger, so it still works if this fails.
+        RebuildHookIndex(g_hooks.capacity);
     }
 }
 
@@ -260,7 +423,100 @@ static VOID ProcessThreadIPs(HANDLE hThread, UINT pos, UINT action)
 }
 
 //-------------------------------------------------------------------------
-static BOOL EnumerateThreads(PFROZEN_THREADS pThreads)
+static BOOL AddFrozenThread(PFROZEN_THREADS pThreads, HANDLE hThread)
+{
+    if (pThreads->pItems == NULL)
+    {
+        pThreads->capacity = INITIAL_THREAD_CAPACITY;
+        pThreads->pItems
+            = (LPHANDLE)HeapAlloc(g_hHeap, 0, pThreads->capacity * sizeof(HANDLE));
+        if (pThreads->pItems == NULL)
+            return FALSE;
+    }
+    else if (pThreads->size >= pThreads->capacity)
+    {
+        LPHANDLE p = (LPHANDLE)HeapReAlloc(
+            g_hHeap, 0, pThreads->pItems, pThreads->capacity * 2 * sizeof(HANDLE));
+        if (p == NULL)
+            return FALSE;
+
+        pThreads->capacity *= 2;
+        pThreads->pItems = p;
+    }
+
+    pThreads->pItems[pThreads->size++] = hThread;
+    return TRUE;
+}
+
+//-------------------------------------------------------------------------
+static VOID CloseFrozenThreads(PFROZEN_THREADS pThreads)
+{
+    if (pThreads->pItems != NULL)
+    {
+        UINT i;
+        for (i = 0; i < pThreads->size; ++i)
+        {
+            if (pThreads->pItems[i] != NULL)
+                CloseHandle(pThreads->pItems[i]);
+        }
+
+        HeapFree(g_hHeap, 0, pThreads->pItems);
+        pThreads->pItems = NULL;
+    }
+
+    pThreads->capacity = 0;
+    pThreads->size     = 0;
+}
+
+//-------------------------------------------------------------------------
+static BOOL EnumerateThreadsByNtGetNextThread(PFROZEN_THREADS pThreads)
+{
+    HANDLE hThread = NULL;
+    HANDLE hCurrent = NULL;
+    LONG   status;
+
+    // The previous handle is the cursor, so the handle of the current
+    // thread is closed only after the enumeration has moved past it.
+    for (;;)
+    {
+        HANDLE hNext;
+        status = g_pNtGetNextThread(
+            GetCurrentProcess(), hThread, THREAD_ACCESS, 0, 0, &hNext);
+        if (status < 0)
+            break;
+
+        if (hCurrent != NULL)
+        {
+            CloseHandle(hCurrent);
+            hCurrent = NULL;
+        }
+
+        hThread = hNext;
+        if (GetThreadId(hThread) == GetCurrentThreadId())
+        {
+            hCurrent = hThread;
+        }
+        else if (!AddFrozenThread(pThreads, hThread))
+        {
+            CloseHandle(hThread);
+            break;
+        }
+    }
+
+    if (hCurrent != NULL)
+        CloseHandle(hCurrent);
+
+    if (status != STATUS_NO_MORE_ENTRIES)
+    {
+        CloseFrozenThreads(pThreads);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+//-------------------------------------------------------------------------
+static BOOL EnumerateThreadsByToolhelp(PFROZEN_THREADS pThreads)
 {
     BOOL succeeded = FALSE;
 
@@ -278,31 +534,13 @@ static BOOL EnumerateThreads(PFROZEN_THREADS pThreads)
                     && te.th32OwnerProcessID == GetCurrentProcessId()
                     && te.th32ThreadID != GetCurrentThreadId())
                 {
-                    if (pThreads->pItems == NULL)
+                    HANDLE hThread = OpenThread(THREAD_ACCESS, FALSE, te.th32ThreadID);
+                    if (hThread != NULL && !AddFrozenThread(pThreads, hThread))
                     {
-                        pThreads->capacity = INITIAL_THREAD_CAPACITY;
-                        pThreads->pItems
-                            = (LPDWORD)HeapAlloc(g_hHeap, 0, pThreads->capacity * sizeof(DWORD));
-                        if (pThreads->pItems == NULL)
-                        {
-                            succeeded = FALSE;
-                            break;
-                        }
-                    }
-                    else if (pThreads->size >= pThreads->capacity)
-                    {
-                        pThreads->capacity *= 2;
-                        LPDWORD p = (LPDWORD)HeapReAlloc(
-                            g_hHeap, 0, pThreads->pItems, pThreads->capacity * sizeof(DWORD));
-                        if (p == NULL)
-                        {
-                            succeeded = FALSE;
-                            break;
-                        }
-
-                        pThreads->pItems = p;
+                        CloseHandle(hThread);
+                        succeeded = FALSE;
+                        break;
                     }
-                    pThreads->pItems[pThreads->size++] = te.th32ThreadID;
                 }
 
                 te.dwSize = sizeof(THREADENTRY32);
@@ -311,11 +549,8 @@ static BOOL EnumerateThreads(PFROZEN_THREADS pThreads)
             if (succeeded && GetLastError() != ERROR_NO_MORE_FILES)
                 succeeded = FALSE;
 
-            if (!succeeded && pThreads->pItems != NULL)
-            {
-                HeapFree(g_hHeap, 0, pThreads->pItems);
-                pThreads->pItems = NULL;
-            }
+            if (!succeeded)
+                CloseFrozenThreads(pThreads);
         }
         CloseHandle(hSnapshot);
     }
@@ -323,6 +558,17 @@ static BOOL EnumerateThreads(PFROZEN_THREADS pThreads)
     return succeeded;
 }
 
+//-------------------------------------------------------------------------
+static BOOL EnumerateThreads(PFROZEN_THREADS pThreads)
+{
+    // NtGetNextThread fails on threads which can't be opened,
+    // Toolhelp just skips them, as before.
+    if (g_pNtGetNextThread != NULL && EnumerateThreadsByNtGetNextThread(pThreads))
+        return TRUE;
+
+    return EnumerateThreadsByToolhelp(pThreads);
+}
+
 //-------------------------------------------------------------------------
 static MH_STATUS Freeze(PFROZEN_THREADS pThreads, UINT pos, UINT action)
 {
@@ -338,16 +584,23 @@ static MH_STATUS Freeze(PFROZEN_THREADS pThreads, UINT pos, UINT action)
     else if (pThreads->pItems != NULL)
     {
         UINT i;
+
+        // Suspension is asynchronous, so all threads are asked first and
+        // stop in parallel. GetThreadContext waits for each one to stop.
         for (i = 0; i < pThreads->size; ++i)
         {
-            HANDLE hThread = OpenThread(THREAD_ACCESS, FALSE, pThreads->pItems[i]);
-            if (hThread != NULL)
+            if (SuspendThread(pThreads->pItems[i]) == (DWORD)-1)
             {
-                SuspendThread(hThread);
-                ProcessThreadIPs(hThread, pos, action);
-                CloseHandle(hThread);
+                CloseHandle(pThreads->pItems[i]);
+                pThreads->pItems[i] = NULL;
             }
         }
+
+        for (i = 0; i < pThreads->size; ++i)
+        {
+            if (pThreads->pItems[i] != NULL)
+                ProcessThreadIPs(pThreads->pItems[i], pos, action);
+        }
     }
 
     return status;
@@ -361,34 +614,45 @@ static VOID Unfreeze(PFROZEN_THREADS pThreads)
         UINT i;
         for (i = 0; i < pThreads->size; ++i)
         {
-            HANDLE hThread = OpenThread(THREAD_ACCESS, FALSE, pThreads->pItems[i]);
-            if (hThread != NULL)
-            {
-                ResumeThread(hThread);
-                CloseHandle(hThread);
-            }
+            if (pThreads->pItems[i] != NULL)
+                ResumeThread(pThreads->pItems[i]);
         }
 
-        HeapFree(g_hHeap, 0, pThreads->pItems);
+        CloseFrozenThreads(pThreads);
     }
 }
 
 //-------------------------------------------------------------------------
-static MH_STATUS EnableHookLL(UINT pos, BOOL enable)
+// Makes the writes visible to the instruction streams of all processors
+// which run threads of the process. The IPIs of FlushProcessWriteBuffers()
+// serialize each of them.
+static VOID SyncPatch(LPVOID pAddress, SIZE_T size)
 {
-    PHOOK_ENTRY pHook = &g_hooks.pItems[pos];
-    DWORD  oldProtect;
-    SIZE_T patchSize    = sizeof(JMP_REL);
-    LPBYTE pPatchTarget = (LPBYTE)pHook->pTarget;
+    FlushInstructionCache(GetCurrentProcess(), pAddress, size);
+    FlushProcessWriteBuffers();
+}
+
+//-------------------------------------------------------------------------
+static VOID GetPatchRange(PHOOK_ENTRY pHook, LPBYTE *ppPatchTarget, SIZE_T *pPatchSize)
+{
+    *ppPatchTarget = (LPBYTE)pHook->pTarget;
+    *pPatchSize    = sizeof(JMP_REL);
 
     if (pHook->patchAbove)
     {
-        pPatchTarget -= sizeof(JMP_REL);
-        patchSize    += sizeof(JMP_REL_SHORT);
+        *ppPatchTarget -= sizeof(JMP_REL);
+        *pPatchSize    += sizeof(JMP_REL_SHORT);
     }
+}
 
-    if (!VirtualProtect(pPatchTarget, patchSize, PAGE_EXECUTE_READWRITE, &oldProtect))
-        return MH_ERROR_MEMORY_PROTECT;
+//-------------------------------------------------------------------------
+// Writes or restores the jump, the patch range should be writable.
+static VOID WriteHookPatch(PHOOK_ENTRY pHook, BOOL enable)
+{
+    LPBYTE pPatchTarget;
+    SIZE_T patchSize;
+
+    GetPatchRange(pHook, &pPatchTarget, &patchSize);
 
     if (enable)
     {
@@ -405,38 +669,221 @@ static MH_STATUS EnableHookLL(UINT pos, BOOL enable)
     }
     else
     {
-        if (pHook->patchAbove)
-            memcpy(pPatchTarget, pHook->backup, sizeof(JMP_REL) + sizeof(JMP_REL_SHORT));
-        else
-            memcpy(pPatchTarget, pHook->backup, sizeof(JMP_REL));
+        memcpy(pPatchTarget, pHook->backup, patchSize);
     }
 
+    pHook->isEnabled   = enable;
+    pHook->queueEnable = enable;
+}
+
+//-------------------------------------------------------------------------
+static MH_STATUS EnableHookLL(UINT pos, BOOL enable)
+{
+    PHOOK_ENTRY pHook = &g_hooks.pItems[pos];
+    DWORD  oldProtect;
+    LPBYTE pPatchTarget;
+    SIZE_T patchSize;
+
+    GetPatchRange(pHook, &pPatchTarget, &patchSize);
+
+    if (!VirtualProtect(pPatchTarget, patchSize, PAGE_EXECUTE_READWRITE, &oldProtect))
+        return MH_ERROR_MEMORY_PROTECT;
+
+    WriteHookPatch(pHook, enable);
+
     VirtualProtect(pPatchTarget, patchSize, oldProtect, &oldProtect);
 
-    // Just-in-case measure.
-    FlushInstructionCache(GetCurrentProcess(), pPatchTarget, patchSize);
+    // Resuming a frozen thread doesn't serialize the processor which runs
+    // it next, a thread of the process running there now is interrupted.
+    SyncPatch(pPatchTarget, patchSize);
+
+    return MH_OK;
+}
+
+//-------------------------------------------------------------------------
+// For everything which changes the hooks or the memory.
+static VOID EnterLock(VOID)
+{
+    AcquireSRWLockExclusive(&g_lock);
+}
+
+//-------------------------------------------------------------------------
+static VOID LeaveLock(VOID)
+{
+    ReleaseSRWLockExclusive(&g_lock);
+}
+
+//-------------------------------------------------------------------------
+// For lookups, which may run concurrently.
+static VOID EnterSharedLock(VOID)
+{
+    AcquireSRWLockShared(&g_lock);
+}
+
+//-------------------------------------------------------------------------
+static VOID LeaveSharedLock(VOID)
+{
+    ReleaseSRWLockShared(&g_lock);
+}
+
+//-------------------------------------------------------------------------
+// Returns TRUE if the patch covers one instruction of the target, so no
+// thread can be stopped inside it and WriteHookPatchLive() is safe.
+static BOOL CanPatchLive(PHOOK_ENTRY pHook)
+{
+    return !pHook->patchAbove
+        && (pHook->nIP == 1 || pHook->oldIPs[1] >= sizeof(JMP_REL));
+}
+
+//-------------------------------------------------------------------------
+static VOID SetLivePatch(LPVOID pTarget, LPVOID pDestination)
+{
+    // Interlocked functions are full barriers.
+    InterlockedIncrement(&g_livePatch.sequence);
+
+    g_livePatch.pTarget      = pTarget;
+    g_livePatch.pDestination = pDestination;
+
+    InterlockedIncrement(&g_livePatch.sequence);
+}
+
+//-------------------------------------------------------------------------
+// Writes or restores the jump while other threads keep running, like
+// text_poke_bp() of Linux: int3 over the first byte, then the rest,
+// then the first byte, syncing processors after each step. Threads which
+// hit the int3 meanwhile are sent to the detour when enabling or to the
+// trampoline when disabling. The patch range should be writable.
+static VOID WriteHookPatchLive(PHOOK_ENTRY pHook, BOOL enable)
+{
+    LPBYTE pTarget = (LPBYTE)pHook->pTarget;
+    UINT8  patch[sizeof(JMP_REL)];
+
+    if (enable)
+    {
+        PJMP_REL pJmp = (PJMP_REL)patch;
+        pJmp->opcode = 0xE9;
+        pJmp->operand = (UINT32)((LPBYTE)pHook->pDetour - (pTarget + sizeof(JMP_REL)));
+    }
+    else
+    {
+        memcpy(patch, pHook->backup, sizeof(patch));
+    }
+
+    SetLivePatch(pTarget, enable ? pHook->pDetour : pHook->pTrampoline);
+
+    // Written under the lock, read by BreakpointHandler() without it.
+    g_livePatchHistory[g_livePatchHistoryPos] = pTarget;
+    g_livePatchHistoryPos = (g_livePatchHistoryPos + 1) % LIVE_PATCH_HISTORY;
+
+    *(volatile UINT8 *)pTarget = INT3_OPCODE;
+    SyncPatch(pTarget, 1);
+
+    memcpy(pTarget + 1, patch + 1, sizeof(patch) - 1);
+    SyncPatch(pTarget, sizeof(patch));
+
+    *(volatile UINT8 *)pTarget = patch[0];
+    SyncPatch(pTarget, 1);
+
+    SetLivePatch(NULL, NULL);
 
     pHook->isEnabled   = enable;
     pHook->queueEnable = enable;
+}
+
+//-------------------------------------------------------------------------
+static MH_STATUS EnableHookLiveLL(UINT pos, BOOL enable)
+{
+    PHOOK_ENTRY pHook = &g_hooks.pItems[pos];
+    DWORD oldProtect;
+
+    if (!VirtualProtect(pHook->pTarget, sizeof(JMP_REL), PAGE_EXECUTE_READWRITE, &oldProtect))
+        return MH_ERROR_MEMORY_PROTECT;
+
+    WriteHookPatchLive(pHook, enable);
+
+    VirtualProtect(pHook->pTarget, sizeof(JMP_REL), oldProtect, &oldProtect);
 
     return MH_OK;
 }
 
+//-------------------------------------------------------------------------
+static LONG CALLBACK BreakpointHandler(PEXCEPTION_POINTERS pInfo)
+{
+    LPBYTE pAddress = (LPBYTE)pInfo->ExceptionRecord->ExceptionAddress;
+    LPVOID pTarget;
+    LPVOID pDestination;
+    LONG   sequence;
+    UINT   i;
+
+    if (pInfo->ExceptionRecord->ExceptionCode != EXCEPTION_BREAKPOINT)
+        return EXCEPTION_CONTINUE_SEARCH;
+
+    do
+    {
+        sequence = g_livePatch.sequence;
+        MemoryBarrier();
+
+        pTarget      = g_livePatch.pTarget;
+        pDestination = g_livePatch.pDestination;
+
+        MemoryBarrier();
+    }
+    while ((sequence & 1) != 0 || sequence != g_livePatch.sequence);
+
+    if ((ULONG_PTR)pTarget == (ULONG_PTR)pAddress)
+    {
+#if defined(_M_X64) || defined(__x86_64__)
+        pInfo->ContextRecord->Rip = (DWORD64)pDestination;
+#else
+        pInfo->ContextRecord->Eip = (DWORD)pDestination;
+#endif
+        return EXCEPTION_CONTINUE_EXECUTION;
+    }
+
+    // The thread may reach the handler after the patch is done, the final
+    // instruction is executed again then. No lock here: a thread holding it
+    // may be the one waiting for this thread to get past the int3.
+    // Breakpoints elsewhere aren't ours and are passed on.
+    for (i = 0; i < LIVE_PATCH_HISTORY; ++i)
+    {
+        if ((ULONG_PTR)g_livePatchHistory[i] == (ULONG_PTR)pAddress)
+        {
+            if (*pAddress != INT3_OPCODE)
+                return EXCEPTION_CONTINUE_EXECUTION;
+
+            break;
+        }
+    }
+
+    return EXCEPTION_CONTINUE_SEARCH;
+}
+
 //-------------------------------------------------------------------------
 static MH_STATUS EnableAllHooksLL(BOOL enable)
 {
     MH_STATUS status = MH_OK;
-    UINT i, first = INVALID_HOOK_POS;
+    UINT i, first = INVALID_HOOK_POS, count = 0;
 
     for (i = 0; i < g_hooks.size; ++i)
     {
         if (g_hooks.pItems[i].isEnabled != (UINT)enable)
         {
-            first = i;
-            break;
+            if (first == INVALID_HOOK_POS)
+                first = i;
+
+            ++count;
         }
     }
 
+    // Like MH_ApplyQueued(), only a single hook is patched live, so no
+    // thread runs with a part of the hooks changed.
+    if (count == 1
+        && g_patchMode == MH_PATCH_MODE_BREAKPOINT
+        && CanPatchLive(&g_hooks.pItems[first]))
+    {
+        return EnableHookLiveLL(first, enable);
+    }
+
     if (first != INVALID_HOOK_POS)
     {
         FROZEN_THREADS threads;
@@ -460,42 +907,12 @@ static MH_STATUS EnableAllHooksLL(BOOL enable)
     return status;
 }
 
-//-------------------------------------------------------------------------
-static VOID EnterSpinLock(VOID)
-{
-    SIZE_T spinCount = 0;
-
-    // Wait until the flag is FALSE.
-    while (InterlockedCompareExchange(&g_isLocked, TRUE, FALSE) != FALSE)
-    {
-        // No need to generate a memory barrier here, since InterlockedCompareExchange()
-        // generates a full memory barrier itself.
-
-        // Prevent the loop from being too busy.
-        if (spinCount < 32)
-            Sleep(0);
-        else
-            Sleep(1);
-
-        spinCount++;
-    }
-}
-
-//-------------------------------------------------------------------------
-static VOID LeaveSpinLock(VOID)
-{
-    // No need to generate a memory barrier here, since InterlockedExchange()
-    // generates a full memory barrier itself.
-
-    InterlockedExchange(&g_isLocked, FALSE);
-}
-
 //-------------------------------------------------------------------------
 MH_STATUS WINAPI MH_Initialize(VOID)
 {
     MH_STATUS status = MH_OK;
 
-    EnterSpinLock();
+    EnterLock();
 
     if (g_hHeap == NULL)
     {
@@ -504,6 +921,11 @@ MH_STATUS WINAPI MH_Initialize(VOID)
         {
             // Initialize the internal function buffer.
             InitializeBuffer();
+
+            g_pNtGetNextThread = (NT_GET_NEXT_THREAD)GetProcAddress(
+                GetModuleHandleW(L"ntdll.dll"), "NtGetNextThread");
+
+            g_hBreakpointHandler = AddVectoredExceptionHandler(TRUE, BreakpointHandler);
         }
         else
         {
@@ -515,7 +937,7 @@ MH_STATUS WINAPI MH_Initialize(VOID)
         status = MH_ERROR_ALREADY_INITIALIZED;
     }
 
-    LeaveSpinLock();
+    LeaveLock();
 
     return status;
 }
@@ -525,7 +947,7 @@ MH_STATUS WINAPI MH_Uninitialize(VOID)
 {
     MH_STATUS status = MH_OK;
 
-    EnterSpinLock();
+    EnterLock();
 
     if (g_hHeap != NULL)
     {
@@ -539,7 +961,14 @@ MH_STATUS WINAPI MH_Uninitialize(VOID)
 
             UninitializeBuffer();
 
+            if (g_hBreakpointHandler != NULL)
+            {
+                RemoveVectoredExceptionHandler(g_hBreakpointHandler);
+                g_hBreakpointHandler = NULL;
+            }
+
             HeapFree(g_hHeap, 0, g_hooks.pItems);
+            HeapFree(g_hHeap, 0, g_hookIndex.pSlots);
             HeapDestroy(g_hHeap);
 
             g_hHeap = NULL;
@@ -547,6 +976,12 @@ MH_STATUS WINAPI MH_Uninitialize(VOID)
             g_hooks.pItems   = NULL;
             g_hooks.capacity = 0;
             g_hooks.size     = 0;
+
+            g_hookIndex.pSlots   = NULL;
+            g_hookIndex.capacity = 0;
+            g_hookIndex.shift    = 0;
+
+            g_generation++;
         }
     }
     else
@@ -554,7 +989,7 @@ MH_STATUS WINAPI MH_Uninitialize(VOID)
         status = MH_ERROR_NOT_INITIALIZED;
     }
 
-    LeaveSpinLock();
+    LeaveLock();
 
     return status;
 }
@@ -562,74 +997,37 @@ MH_STATUS WINAPI MH_Uninitialize(VOID)
 //-------------------------------------------------------------------------
 MH_STATUS WINAPI MH_CreateHook(LPVOID pTarget, LPVOID pDetour, LPVOID *ppOriginal)
 {
-    MH_STATUS status = MH_OK;
+    MH_STATUS  status = MH_OK;
+    LPVOID     pBuffer = NULL;
+    UINT       generation = 0;
+    TRAMPOLINE ct;
 
-    EnterSpinLock();
+    // Only queries the memory, so it's done before taking the lock.
+    BOOL isExecutable = IsExecutableAddress(pTarget) && IsExecutableAddress(pDetour);
+
+    // The trampoline is built under the shared lock, so creations of hooks
+    // on different targets and lookups run concurrently. The buffer list
+    // has a lock of its own.
+    EnterSharedLock();
 
     if (g_hHeap != NULL)
     {
-        if (IsExecutableAddress(pTarget) && IsExecutableAddress(pDetour))
+        if (isExecutable)
         {
-            UINT pos = FindHookEntry(pTarget);
-            if (pos == INVALID_HOOK_POS)
+            if (FindHookEntry(pTarget) == INVALID_HOOK_POS)
             {
-                LPVOID pBuffer = AllocateBuffer(pTarget);
+                generation = g_generation;
+
+                pBuffer = AllocateBuffer(pTarget);
                 if (pBuffer != NULL)
                 {
-                    TRAMPOLINE ct;
-
                     ct.pTarget     = pTarget;
                     ct.pDetour     = pDetour;
                     ct.pTrampoline = pBuffer;
-                    if (CreateTrampolineFunction(&ct))
-                    {
-                        PHOOK_ENTRY pHook = AddHookEntry();
-                        if (pHook != NULL)
-                        {
-                            pHook->pTarget     = ct.pTarget;
-#if defined(_M_X64) || defined(__x86_64__)
-                            pHook->pDetour     = ct.pRelay;
-#else
-                            pHook->pDetour     = ct.pDetour;
-#endif
-                            pHook->pTrampoline = ct.pTrampoline;
-                            pHook->patchAbove  = ct.patchAbove;
-                            pHook->isEnabled   = FALSE;
-                            pHook->queueEnable = FALSE;
-                            pHook->nIP         = ct.nIP;
-                            memcpy(pHook->oldIPs, ct.oldIPs, ARRAYSIZE(ct.oldIPs));
-                            memcpy(pHook->newIPs, ct.newIPs, ARRAYSIZE(ct.newIPs));
-
-                            // Back up the target function.
-
-                            if (ct.patchAbove)
-                            {
-                                memcpy(
-                                    pHook->backup,
-                                    (LPBYTE)pTarget - sizeof(JMP_REL),
-                                    sizeof(JMP_REL) + sizeof(JMP_REL_SHORT));
-                            }
-                            else
-                            {
-                                memcpy(pHook->backup, pTarget, sizeof(JMP_REL));
-                            }
-
-                            if (ppOriginal != NULL)
-                                *ppOriginal = pHook->pTrampoline;
-                        }
-                        else
-                        {
-                            status = MH_ERROR_MEMORY_ALLOC;
-                        }
-                    }
-                    else
-                    {
-                        status = MH_ERROR_UNSUPPORTED_FUNCTION;
-                    }
-
-                    if (status != MH_OK)
+                    if (!CreateTrampolineFunction(&ct))
                     {
                         FreeBuffer(pBuffer);
+                        status = MH_ERROR_UNSUPPORTED_FUNCTION;
                     }
                 }
                 else
@@ -652,7 +1050,71 @@ MH_STATUS WINAPI MH_CreateHook(LPVOID pTarget, LPVOID pDetour, LPVOID *ppOrigina
         status = MH_ERROR_NOT_INITIALIZED;
     }
 
-    LeaveSpinLock();
+    LeaveSharedLock();
+
+    if (status != MH_OK)
+        return status;
+
+    // Only the registry insertion is exclusive. The lock was released
+    // meanwhile, so check again what may have changed.
+    EnterLock();
+
+    if (g_hHeap == NULL || g_generation != generation)
+    {
+        // MH_Uninitialize() has freed the buffer already.
+        status = MH_ERROR_NOT_INITIALIZED;
+    }
+    else if (FindHookEntry(pTarget) != INVALID_HOOK_POS)
+    {
+        status = MH_ERROR_ALREADY_CREATED;
+    }
+    else
+    {
+        PHOOK_ENTRY pHook = AddHookEntry(ct.pTarget);
+        if (pHook != NULL)
+        {
+#if defined(_M_X64) || defined(__x86_64__)
+            pHook->pDetour     = ct.pRelay;
+#else
+            pHook->pDetour     = ct.pDetour;
+#endif
+            pHook->pTrampoline = ct.pTrampoline;
+            pHook->patchAbove  = ct.patchAbove;
+            pHook->isEnabled   = FALSE;
+            pHook->queueEnable = FALSE;
+            pHook->nIP         = ct.nIP;
+            memcpy(pHook->oldIPs, ct.oldIPs, ARRAYSIZE(ct.oldIPs));
+            memcpy(pHook->newIPs, ct.newIPs, ARRAYSIZE(ct.newIPs));
+
+            // Back up the target function.
+
+            if (ct.patchAbove)
+            {
+                memcpy(
+                    pHook->backup,
+                    (LPBYTE)pTarget - sizeof(JMP_REL),
+                    sizeof(JMP_REL) + sizeof(JMP_REL_SHORT));
+            }
+            else
+            {
+                memcpy(pHook->backup, pTarget, sizeof(JMP_REL));
+            }
+
+            if (ppOriginal != NULL)
+                *ppOriginal = pHook->pTrampoline;
+        }
+        else
+        {
+            status = MH_ERROR_MEMORY_ALLOC;
+        }
+    }
+
+    if (status == MH_ERROR_ALREADY_CREATED || status == MH_ERROR_MEMORY_ALLOC)
+    {
+        FreeBuffer(pBuffer);
+    }
+
+    LeaveLock();
 
     return status;
 }
@@ -662,7 +1124,7 @@ MH_STATUS WINAPI MH_RemoveHook(LPVOID pTarget)
 {
     MH_STATUS status = MH_OK;
 
-    EnterSpinLock();
+    EnterLock();
 
     if (g_hHeap != NULL)
     {
@@ -697,7 +1159,7 @@ MH_STATUS WINAPI MH_RemoveHook(LPVOID pTarget)
         status = MH_ERROR_NOT_INITIALIZED;
     }
 
-    LeaveSpinLock();
+    LeaveLock();
 
     return status;
 }
@@ -707,7 +1169,7 @@ static MH_STATUS EnableHook(LPVOID pTarget, BOOL enable)
 {
     MH_STATUS status = MH_OK;
 
-    EnterSpinLock();
+    EnterLock();
 
     if (g_hHeap != NULL)
     {
@@ -720,7 +1182,13 @@ static MH_STATUS EnableHook(LPVOID pTarget, BOOL enable)
             UINT pos = FindHookEntry(pTarget);
             if (pos != INVALID_HOOK_POS)
             {
-                if (g_hooks.pItems[pos].isEnabled != (UINT)enable)
+                if (g_hooks.pItems[pos].isEnabled != (UINT)enable
+                    && g_patchMode == MH_PATCH_MODE_BREAKPOINT
+                    && CanPatchLive(&g_hooks.pItems[pos]))
+                {
+                    status = EnableHookLiveLL(pos, enable);
+                }
+                else if (g_hooks.pItems[pos].isEnabled != (UINT)enable)
                 {
                     FROZEN_THREADS threads;
                     status = Freeze(&threads, pos, ACTION_ENABLE);
@@ -747,7 +1215,7 @@ static MH_STATUS EnableHook(LPVOID pTarget, BOOL enable)
         status = MH_ERROR_NOT_INITIALIZED;
     }
 
-    LeaveSpinLock();
+    LeaveLock();
 
     return status;
 }
@@ -769,7 +1237,7 @@ static MH_STATUS QueueHook(LPVOID pTarget, BOOL queueEnable)
 {
     MH_STATUS status = MH_OK;
 
-    EnterSpinLock();
+    EnterLock();
 
     if (g_hHeap != NULL)
     {
@@ -797,7 +1265,7 @@ static MH_STATUS QueueHook(LPVOID pTarget, BOOL queueEnable)
         status = MH_ERROR_NOT_INITIALIZED;
     }
 
-    LeaveSpinLock();
+    LeaveLock();
 
     return status;
 }
@@ -814,43 +1282,108 @@ MH_STATUS WINAPI MH_QueueDisableHook(LPVOID pTarget)
     return QueueHook(pTarget, FALSE);
 }
 
+//-------------------------------------------------------------------------
+// Restores protection of the patches in reverse order,
+// so pages shared by several of them end up as they were.
+static VOID RestoreQueuedPatches(PQUEUED_PATCH pPatches, UINT count)
+{
+    while (count > 0)
+    {
+        PQUEUED_PATCH pPatch = &pPatches[--count];
+        DWORD oldProtect;
+
+        VirtualProtect(pPatch->pTarget, pPatch->size, pPatch->oldProtect, &oldProtect);
+        FlushInstructionCache(GetCurrentProcess(), pPatch->pTarget, pPatch->size);
+    }
+}
+
 //-------------------------------------------------------------------------
 MH_STATUS WINAPI MH_ApplyQueued(VOID)
 {
     MH_STATUS status = MH_OK;
-    UINT i, first = INVALID_HOOK_POS;
+    UINT i, count = 0;
 
-    EnterSpinLock();
+    EnterLock();
 
     if (g_hHeap != NULL)
     {
         for (i = 0; i < g_hooks.size; ++i)
         {
             if (g_hooks.pItems[i].isEnabled != g_hooks.pItems[i].queueEnable)
-            {
-                first = i;
-                break;
-            }
+                ++count;
         }
 
-        if (first != INVALID_HOOK_POS)
+        if (count != 0)
         {
-            FROZEN_THREADS threads;
-            status = Freeze(&threads, ALL_HOOKS_POS, ACTION_APPLY_QUEUED);
-            if (status == MH_OK)
+            PQUEUED_PATCH pPatches
+                = (PQUEUED_PATCH)HeapAlloc(g_hHeap, 0, count * sizeof(QUEUED_PATCH));
+            UINT unprotected = 0;
+            BOOL live = (g_patchMode == MH_PATCH_MODE_BREAKPOINT);
+
+            if (pPatches == NULL)
+                status = MH_ERROR_MEMORY_ALLOC;
+
+            // Every patch is made writable before anything is written,
+            // so a failure leaves all hooks as they were.
+            for (i = 0; status == MH_OK && i < g_hooks.size; ++i)
             {
-                for (i = first; i < g_hooks.size; ++i)
+                PHOOK_ENTRY pHook = &g_hooks.pItems[i];
+                if (pHook->isEnabled != pHook->queueEnable)
                 {
-                    PHOOK_ENTRY pHook = &g_hooks.pItems[i];
-                    if (pHook->isEnabled != pHook->queueEnable)
+                    PQUEUED_PATCH pPatch = &pPatches[unprotected];
+                    GetPatchRange(pHook, &pPatch->pTarget, &pPatch->size);
+                    pPatch->pos = i;
+
+                    if (VirtualProtect(
+                        pPatch->pTarget, pPatch->size, PAGE_EXECUTE_READWRITE, &pPatch->oldProtect))
+                        ++unprotected;
+                    else
+                        status = MH_ERROR_MEMORY_PROTECT;
+                }
+            }
+
+            // Only a single hook is patched live. Several ones would be
+            // changed one by one, so they all go under one freeze instead.
+            live = live && unprotected == 1 && CanPatchLive(&g_hooks.pItems[pPatches[0].pos]);
+
+            if (status == MH_OK && live)
+            {
+                for (i = 0; i < unprotected; ++i)
+                {
+                    PHOOK_ENTRY pHook = &g_hooks.pItems[pPatches[i].pos];
+                    WriteHookPatchLive(pHook, pHook->queueEnable);
+                }
+            }
+            else if (status == MH_OK)
+            {
+                FROZEN_THREADS threads;
+                status = Freeze(&threads, ALL_HOOKS_POS, ACTION_APPLY_QUEUED);
+                if (status == MH_OK)
+                {
+                    for (i = 0; i < unprotected; ++i)
                     {
-                        status = EnableHookLL(i, pHook->queueEnable);
-                        if (status != MH_OK)
-                            break;
+                        PHOOK_ENTRY pHook = &g_hooks.pItems[pPatches[i].pos];
+                        WriteHookPatch(pHook, pHook->queueEnable);
                     }
+
+                    // One sync for the batch, see EnableHookLL().
+                    FlushProcessWriteBuffers();
+
+                    Unfreeze(&threads);
                 }
+            }
+
+            if (pPatches != NULL)
+            {
+                RestoreQueuedPatches(pPatches, unprotected);
+                HeapFree(g_hHeap, 0, pPatches);
+            }
 
-                Unfreeze(&threads);
+            // Nothing is applied, the queue is dropped.
+            if (status != MH_OK)
+            {
+                for (i = 0; i < g_hooks.size; ++i)
+                    g_hooks.pItems[i].queueEnable = g_hooks.pItems[i].isEnabled;
             }
         }
     }
@@ -859,11 +1392,54 @@ MH_STATUS WINAPI MH_ApplyQueued(VOID)
         status = MH_ERROR_NOT_INITIALIZED;
     }
 
-    LeaveSpinLock();
+    LeaveLock();
+
+    return status;
+}
+
+//-------------------------------------------------------------------------
+MH_STATUS WINAPI MH_IsHookEnabled(LPVOID pTarget, BOOL *pIsEnabled)
+{
+    MH_STATUS status = MH_OK;
+
+    EnterSharedLock();
+
+    if (g_hHeap != NULL)
+    {
+        UINT pos = FindHookEntry(pTarget);
+        if (pos != INVALID_HOOK_POS)
+        {
+            if (pIsEnabled != NULL)
+                *pIsEnabled = g_hooks.pItems[pos].isEnabled;
+        }
+        else
+        {
+            status = MH_ERROR_NOT_CREATED;
+        }
+    }
+    else
+    {
+        status = MH_ERROR_NOT_INITIALIZED;
+    }
+
+    LeaveSharedLock();
 
     return status;
 }
 
+//-------------------------------------------------------------------------
+MH_STATUS WINAPI MH_SetPatchMode(MH_PATCH_MODE mode)
+{
+    EnterLock();
+
+    g_patchMode = (mode == MH_PATCH_MODE_BREAKPOINT)
+        ? MH_PATCH_MODE_BREAKPOINT : MH_PATCH_MODE_FREEZE;
+
+    LeaveLock();
+
+    return MH_OK;
+}
+
 //-------------------------------------------------------------------------
 MH_STATUS WINAPI MH_CreateHookApiEx(
     LPCWSTR pszModule, LPCSTR pszProcName, LPVOID pDetour,
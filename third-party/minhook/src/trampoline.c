@@ -109,6 +109,7 @@ BOOL CreateTrampolineFunction(PTRAMPOLINE ct)
     UINT8     newPos   = 0;
     ULONG_PTR jmpDest  = 0;     // Destination address of an internal jump.
     BOOL      finished = FALSE; // Is the function completed?
+    LPBYTE    pWritable = (LPBYTE)GetWritableBuffer(ct->pTrampoline);
 #if defined(_M_X64) || defined(__x86_64__)
     UINT8     instBuf[16];
 #endif
@@ -278,9 +279,9 @@ BOOL CreateTrampolineFunction(PTRAMPOLINE ct)
 
         // Avoid using memcpy to reduce the footprint.
 #ifndef _MSC_VER
-        memcpy((LPBYTE)ct->pTrampoline + newPos, pCopySrc, copySize);
+        memcpy(pWritable + newPos, pCopySrc, copySize);
 #else
-        __movsb((LPBYTE)ct->pTrampoline + newPos, (LPBYTE)pCopySrc, copySize);
+        __movsb(pWritable + newPos, (LPBYTE)pCopySrc, copySize);
 #endif
         newPos += (UINT8)copySize;
         oldPos += hs.len;
@@ -313,7 +314,7 @@ BOOL CreateTrampolineFunction(PTRAMPOLINE ct)
     jmp.address = (ULONG_PTR)ct->pDetour;
 
     ct->pRelay = (LPBYTE)ct->pTrampoline + newPos;
-    memcpy(ct->pRelay, &jmp, sizeof(jmp));
+    memcpy(pWritable + newPos, &jmp, sizeof(jmp));
 #endif
 
     return TRUE;
@@ -0,0 +1,250 @@
+// Compiles text patch definitions into a binary bundle for llmo::bundle::Bundle.
+//
+// Usage: bundlec <input.txt> <output.llpb>
+//
+// Input format, one directive per line, '#' starts a comment:
+//   module game.exe            Module name, main executable if omitted.
+//   timestamp 0x5F3A1B2C       Expected PE TimeDateStamp, optional.
+//   image-size 0x123000        Expected PE SizeOfImage, optional.
+//   patch 0x1234 74 05 -> EB 05
+//                              RVA, expected original bytes, replacement.
+
+#include <algorithm> // std::sort
+#include <cstdint> // std::uint8_t, std::uint32_t
+#include <cstdio> // std::fprintf
+#include <cstdlib> // std::strtoul
+#include <cstring> // std::memset, std::strncpy
+#include <fstream> // std::ifstream, std::ofstream
+#include <sstream> // std::istringstream
+#include <string> // std::string
+#include <vector> // std::vector
+
+#include "../include/bundle_format.hpp"
+
+namespace {
+
+struct Patch
+{
+  std::uint32_t rva;
+  std::vector<std::uint8_t> original;
+  std::vector<std::uint8_t> replacement;
+  std::size_t line;
+};
+
+bool parseNumber(const std::string& text, std::uint32_t& value)
+{
+  if (text.empty()) {
+    return false;
+  }
+
+  char* end{};
+  const unsigned long number{std::strtoul(text.c_str(), &end, 0)};
+
+  if ('\0' != *end || number > 0xFFFFFFFFul) {
+    return false;
+  }
+
+  value = static_cast<std::uint32_t>(number);
+  return true;
+}
+
+bool parseByte(const std::string& text, std::uint8_t& value)
+{
+  char* end{};
+  const unsigned long number{std::strtoul(text.c_str(), &end, 16)};
+
+  if (text.size() != 2u || '\0' != *end) {
+    return false;
+  }
+
+  value = static_cast<std::uint8_t>(number);
+  return true;
+}
+
+// Parses "<rva> <bytes> -> <bytes>".
+bool parsePatch(std::istringstream& stream, Patch& patch)
+{
+  std::string token{};
+
+  if (!(stream >> token) || !parseNumber(token, patch.rva)) {
+    return false;
+  }
+
+  std::vector<std::uint8_t>* bytes{&patch.original};
+
+  while (stream >> token)
+  {
+    if ("->" == token)
+    {
+      if (bytes == &patch.replacement) {
+        return false;
+      }
+
+      bytes = &patch.replacement;
+      continue;
+    }
+
+    std::uint8_t value{};
+
+    if (!parseByte(token, value)) {
+      return false;
+    }
+
+    bytes->push_back(value);
+  }
+
+  return !patch.original.empty()
+    && patch.original.size() == patch.replacement.size();
+}
+
+void writeBundle(
+  std::ofstream& output,
+  const llmo::bundle::Header& header,
+  const std::vector<Patch>& patches)
+{
+  std::vector<llmo::bundle::Record> records{};
+  std::vector<std::uint8_t> data{};
+
+  for (const Patch& patch : patches)
+  {
+    const llmo::bundle::Record record{
+      patch.rva,
+      static_cast<std::uint32_t>(patch.original.size()),
+      static_cast<std::uint32_t>(data.size()),
+      static_cast<std::uint32_t>(data.size() + patch.original.size())};
+
+    data.insert(data.end(), patch.original.begin(), patch.original.end());
+    data.insert(data.end(), patch.replacement.begin(), patch.replacement.end());
+
+    records.push_back(record);
+  }
+
+  output.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  output.write(reinterpret_cast<const char*>(records.data()),
+    records.size() * sizeof(llmo::bundle::Record));
+  output.write(reinterpret_cast<const char*>(data.data()), data.size());
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+  if (argc != 3)
+  {
+    std::fprintf(stderr, "Usage: %s <input.txt> <output.llpb>\n", argv[0]);
+    return 1;
+  }
+
+  std::ifstream input{argv[1]};
+
+  if (!input)
+  {
+    std::fprintf(stderr, "Could not open %s\n", argv[1]);
+    return 1;
+  }
+
+  llmo::bundle::Header header{};
+  std::memset(&header, 0, sizeof(header));
+
+  header.magic = llmo::bundle::kMagic;
+  header.version = llmo::bundle::kVersion;
+
+  std::vector<Patch> patches{};
+  std::string line{};
+
+  for (std::size_t number{1u}; std::getline(input, line); ++number)
+  {
+    const std::size_t comment{line.find('#')};
+
+    if (std::string::npos != comment) {
+      line.erase(comment);
+    }
+
+    std::istringstream stream{line};
+    std::string directive{};
+    std::string value{};
+
+    if (!(stream >> directive)) {
+      continue;
+    }
+
+    bool isValid{false};
+
+    if ("module" == directive)
+    {
+      isValid = (stream >> value)
+        && value.size() < llmo::bundle::kModuleNameSize;
+
+      if (isValid) {
+        std::strncpy(header.module, value.c_str(), sizeof(header.module) - 1u);
+      }
+    }
+    else if ("timestamp" == directive) {
+      isValid = (stream >> value) && parseNumber(value, header.timeDateStamp);
+    }
+    else if ("image-size" == directive) {
+      isValid = (stream >> value) && parseNumber(value, header.sizeOfImage);
+    }
+    else if ("patch" == directive)
+    {
+      Patch patch{};
+      patch.line = number;
+
+      isValid = parsePatch(stream, patch);
+
+      if (isValid) {
+        patches.push_back(patch);
+      }
+    }
+
+    if (!isValid)
+    {
+      std::fprintf(stderr, "%s:%zu: invalid line\n", argv[1], number);
+      return 1;
+    }
+  }
+
+  std::sort(patches.begin(), patches.end(),
+    [](const Patch& left, const Patch& right) {
+      return left.rva < right.rva;
+    });
+
+  for (std::size_t i{1u}; i < patches.size(); ++i)
+  {
+    const Patch& previous{patches[i - 1u]};
+
+    if (std::uint64_t{previous.rva} + previous.original.size() > patches[i].rva)
+    {
+      std::fprintf(stderr, "%s:%zu: patch overlaps line %zu\n",
+        argv[1], patches[i].line, previous.line);
+      return 1;
+    }
+  }
+
+  header.patchCount = static_cast<std::uint32_t>(patches.size());
+  header.patchesOffset = sizeof(llmo::bundle::Header);
+  header.dataOffset = static_cast<std::uint32_t>(
+    header.patchesOffset + patches.size() * sizeof(llmo::bundle::Record));
+
+  for (const Patch& patch : patches) {
+    header.dataSize += static_cast<std::uint32_t>(patch.original.size() * 2u);
+  }
+
+  std::ofstream output{argv[2], std::ios::binary};
+
+  if (!output)
+  {
+    std::fprintf(stderr, "Could not create %s\n", argv[2]);
+    return 1;
+  }
+
+  writeBundle(output, header, patches);
+
+  if (!output)
+  {
+    std::fprintf(stderr, "Could not write %s\n", argv[2]);
+    return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,223 @@
+// Checks llmo::disasm::DecodeBatch against hde64 and measures both
+// on executable sections of real modules. x64 only.
+//
+// Usage: disasmbench <module.dll> [<module.dll> ...]
+//
+// Every byte offset of every executable section is decoded by both, so
+// misaligned and garbage bytes are covered too, differences in length,
+// flags and operand sizes are printed. Then each section is decoded
+// linearly kRounds times and the best instructions per second are printed.
+
+#if !defined(_M_X64) && !defined(__x86_64__)
+#error disasmbench is x64 only
+#endif
+
+#include <chrono> // std::chrono::steady_clock
+#include <cstdint> // std::uint8_t, std::uintptr_t
+#include <cstdio> // std::printf
+#include <cstring> // std::memcpy
+#include <vector> // std::vector
+
+#include <windows.h> // LoadLibraryExA
+
+#include "../include/disasm.hpp"
+#include "../include/module.hpp"
+#include "../third-party/minhook/src/hde/hde64.h"
+
+namespace {
+
+using llmo::disasm::Record;
+
+constexpr std::size_t kRounds{10u};
+
+// Decoders may look ahead this far, sections are copied with zero padding.
+constexpr std::size_t kPadding{32u};
+
+// Shown mismatches per section, the rest are only counted.
+constexpr std::size_t kMaxShown{10u};
+
+Record toExpected(const ::hde64s& hs)
+{
+  Record record{};
+
+  record.length = hs.len;
+  record.opcode = 0x0Fu == hs.opcode ? hs.opcode2 : hs.opcode;
+
+  std::uint8_t displacementSize{0u};
+  std::uint8_t immediateSize{0u};
+
+  if (0u != (hs.flags & F_DISP32)) {
+    displacementSize = 4u;
+  }
+  else if (0u != (hs.flags & F_DISP16)) {
+    displacementSize = 2u;
+  }
+  else if (0u != (hs.flags & F_DISP8)) {
+    displacementSize = 1u;
+  }
+
+  immediateSize += 0u != (hs.flags & F_IMM64) ? 8u : 0u;
+  immediateSize += 0u != (hs.flags & F_IMM32) ? 4u : 0u;
+  immediateSize += 0u != (hs.flags & F_IMM16) ? 2u : 0u;
+  immediateSize += 0u != (hs.flags & F_IMM8) ? 1u : 0u;
+
+  record.sizes = static_cast<std::uint8_t>(displacementSize << 4 | immediateSize);
+
+  if (0x0Fu == hs.opcode) {
+    record.flags |= Record::kTwoByte;
+  }
+
+  if (0u != (hs.flags & F_MODRM)) {
+    record.flags |= Record::kModrm;
+  }
+
+  if (0u != (hs.flags & F_RELATIVE)) {
+    record.flags |= Record::kRelative;
+  }
+
+  if (4u == displacementSize && 0x05u == (hs.modrm & 0xC7u)) {
+    record.flags |= Record::kRipRelative;
+  }
+
+  if (0u != (hs.flags & F_ERROR)) {
+    record.flags |= Record::kError;
+  }
+
+  return record;
+}
+
+std::size_t checkSection(const std::uint8_t* code, const std::size_t size)
+{
+  std::size_t mismatches{0u};
+
+  for (std::size_t offset{0u}; offset < size; ++offset)
+  {
+    ::hde64s hs{};
+    ::hde64_disasm(code + offset, &hs);
+
+    const Record expected{toExpected(hs)};
+    Record actual{};
+
+    llmo::disasm::DecodeBatch(code + offset, kPadding, &actual, 1u);
+
+    if (expected.length == actual.length && expected.opcode == actual.opcode
+      && expected.flags == actual.flags && expected.sizes == actual.sizes)
+    {
+      continue;
+    }
+
+    if (mismatches++ < kMaxShown)
+    {
+      std::printf("  mismatch at +0x%zx:", offset);
+
+      for (std::size_t i{0u}; i < llmo::disasm::kMaxInstructionSize; ++i) {
+        std::printf(" %02x", code[offset + i]);
+      }
+
+      std::printf("\n    hde64 %u/%02x/%02x, batch %u/%02x/%02x (length/flags/sizes)\n",
+        expected.length, expected.flags, expected.sizes,
+        actual.length, actual.flags, actual.sizes);
+    }
+  }
+
+  return mismatches;
+}
+
+double getSeconds(
+  const std::chrono::steady_clock::time_point begin,
+  const std::chrono::steady_clock::time_point end)
+{
+  return std::chrono::duration<double>(end - begin).count();
+}
+
+void benchmarkSection(const std::uint8_t* code, const std::size_t size)
+{
+  std::vector<Record> records(size);
+  double hdeRate{0.0};
+  double batchRate{0.0};
+
+  for (std::size_t round{0u}; round < kRounds; ++round)
+  {
+    const auto hdeBegin = std::chrono::steady_clock::now();
+
+    std::size_t hdeCount{0u};
+    ::hde64s hs{};
+
+    for (std::size_t offset{0u}; offset < size; ++hdeCount) {
+      offset += ::hde64_disasm(code + offset, &hs);
+    }
+
+    const auto batchBegin = std::chrono::steady_clock::now();
+
+    const std::size_t batchCount{
+      llmo::disasm::DecodeBatch(code, size, records.data(), records.size())};
+
+    const auto batchEnd = std::chrono::steady_clock::now();
+
+    const double hdeSeconds{getSeconds(hdeBegin, batchBegin)};
+    const double batchSeconds{getSeconds(batchBegin, batchEnd)};
+
+    if (hdeSeconds > 0.0 && hdeCount / hdeSeconds > hdeRate) {
+      hdeRate = hdeCount / hdeSeconds;
+    }
+
+    if (batchSeconds > 0.0 && batchCount / batchSeconds > batchRate) {
+      batchRate = batchCount / batchSeconds;
+    }
+  }
+
+  std::printf("  hde64:       %8.1f M instructions/s\n", hdeRate / 1e6);
+  std::printf("  DecodeBatch: %8.1f M instructions/s\n", batchRate / 1e6);
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+  if (argc < 2)
+  {
+    std::fprintf(stderr, "Usage: disasmbench <module.dll> [<module.dll> ...]\n");
+    return 1;
+  }
+
+  std::size_t totalMismatches{0u};
+
+  for (int i{1}; i < argc; ++i)
+  {
+    const ::HMODULE module{
+      ::LoadLibraryExA(argv[i], nullptr, DONT_RESOLVE_DLL_REFERENCES)};
+
+    if (nullptr == module)
+    {
+      std::fprintf(stderr, "%s: could not load\n", argv[i]);
+      return 1;
+    }
+
+    for (const llmo::module::Section& section : llmo::module::getSections(module))
+    {
+      if (!section.isExecutable() || 0u == section.size) {
+        continue;
+      }
+
+      // A zero-padded copy, so the last instructions don't run
+      // into whatever is mapped after the section.
+      std::vector<std::uint8_t> code(section.size + kPadding);
+      std::memcpy(code.data(), reinterpret_cast<const void*>(section.address), section.size);
+
+      std::printf("%s +0x%zx, %zu bytes\n", argv[i],
+        static_cast<std::size_t>(section.address - reinterpret_cast<std::uintptr_t>(module)),
+        section.size);
+
+      const std::size_t mismatches{checkSection(code.data(), section.size)};
+      totalMismatches += mismatches;
+
+      std::printf("  %zu mismatches\n", mismatches);
+
+      benchmarkSection(code.data(), section.size);
+    }
+
+    ::FreeLibrary(module);
+  }
+
+  return 0 != totalMismatches ? 2 : 0;
+}
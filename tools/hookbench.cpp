@@ -0,0 +1,155 @@
+// Measures MinHook's create, enable, disable and remove per hook
+// for growing numbers of hooks, which should stay flat.
+//
+// Usage: hookbench [<max hooks>]
+//
+// Targets are generated stubs, mov eax, imm32 and ret, 16 bytes apart
+// in one executable region, all hooked with the same detour.
+// Each count is measured kRounds times and the best is printed.
+
+#include <chrono> // std::chrono::steady_clock
+#include <cstddef> // std::size_t
+#include <cstdint> // std::uint8_t, std::uint32_t
+#include <cstdio> // std::printf
+#include <cstdlib> // std::strtoul
+#include <cstring> // std::memcpy, std::memset
+
+#include <windows.h> // VirtualAlloc
+
+#include "../third-party/minhook/include/MinHook.h"
+
+namespace {
+
+constexpr std::size_t kRounds{3u};
+constexpr std::size_t kDefaultMaxHooks{100000u};
+constexpr std::size_t kStubSize{16u};
+
+constexpr std::uint8_t kMovEaxImm32{0xB8u};
+constexpr std::uint8_t kRet{0xC3u};
+constexpr std::uint8_t kInt3{0xCCu};
+
+int detour()
+{
+  return -1;
+}
+
+std::uint8_t* createStubs(const std::size_t count)
+{
+  std::uint8_t* stubs{static_cast<std::uint8_t*>(::VirtualAlloc(nullptr,
+    count * kStubSize, MEM_COMMIT | MEM_RESERVE, PAGE_EXECUTE_READWRITE))};
+
+  if (nullptr == stubs) {
+    return nullptr;
+  }
+
+  std::memset(stubs, kInt3, count * kStubSize);
+
+  for (std::size_t i{0u}; i < count; ++i)
+  {
+    const std::uint32_t value{static_cast<std::uint32_t>(i)};
+    std::uint8_t* stub{stubs + i * kStubSize};
+
+    stub[0] = kMovEaxImm32;
+    std::memcpy(stub + 1, &value, sizeof(value));
+    stub[5] = kRet;
+  }
+
+  return stubs;
+}
+
+double getSeconds(
+  const std::chrono::steady_clock::time_point begin,
+  const std::chrono::steady_clock::time_point end)
+{
+  return std::chrono::duration<double>(end - begin).count();
+}
+
+// Calls the operation for each of the first count stubs, returns the seconds
+// or a negative value if some call fails.
+template <class F>
+double measure(std::uint8_t* stubs, const std::size_t count, F operation)
+{
+  const auto begin = std::chrono::steady_clock::now();
+
+  for (std::size_t i{0u}; i < count; ++i)
+  {
+    if (MH_OK != operation(stubs + i * kStubSize)) {
+      return -1.0;
+    }
+  }
+
+  return getSeconds(begin, std::chrono::steady_clock::now());
+}
+
+void keepBest(double& best, const double seconds)
+{
+  if (best < 0.0 || seconds < best) {
+    best = seconds;
+  }
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+  const std::size_t maxHooks{argc > 1
+    ? static_cast<std::size_t>(std::strtoul(argv[1], nullptr, 0)) : kDefaultMaxHooks};
+
+  std::uint8_t* stubs{createStubs(maxHooks)};
+
+  if (nullptr == stubs || MH_OK != MH_Initialize())
+  {
+    std::fprintf(stderr, "Could not initialize\n");
+    return 1;
+  }
+
+  std::printf("%10s %12s %12s %12s %12s (ns per hook)\n",
+    "hooks", "create", "enable", "disable", "remove");
+
+  for (std::size_t count{10u}; count <= maxHooks; count *= 10u)
+  {
+    double create{-1.0};
+    double enable{-1.0};
+    double disable{-1.0};
+    double remove{-1.0};
+
+    for (std::size_t round{0u}; round < kRounds; ++round)
+    {
+      const double createSeconds{measure(stubs, count, [](std::uint8_t* target) {
+        return MH_CreateHook(target, reinterpret_cast<LPVOID>(&detour), nullptr);
+      })};
+
+      const double enableSeconds{measure(stubs, count, [](std::uint8_t* target) {
+        return MH_EnableHook(target);
+      })};
+
+      const double disableSeconds{measure(stubs, count, [](std::uint8_t* target) {
+        return MH_DisableHook(target);
+      })};
+
+      const double removeSeconds{measure(stubs, count, [](std::uint8_t* target) {
+        return MH_RemoveHook(target);
+      })};
+
+      if (createSeconds < 0.0 || enableSeconds < 0.0
+        || disableSeconds < 0.0 || removeSeconds < 0.0)
+      {
+        std::fprintf(stderr, "%zu hooks: MinHook call failed\n", count);
+        return 2;
+      }
+
+      keepBest(create, createSeconds);
+      keepBest(enable, enableSeconds);
+      keepBest(disable, disableSeconds);
+      keepBest(remove, removeSeconds);
+    }
+
+    std::printf("%10zu %12.0f %12.0f %12.0f %12.0f\n", count,
+      create / count * 1e9, enable / count * 1e9,
+      disable / count * 1e9, remove / count * 1e9);
+  }
+
+  MH_Uninitialize();
+
+  return 0;
+}